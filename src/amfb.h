@@ -0,0 +1,261 @@
+#ifndef AMFB_H
+#define AMFB_H
+
+/*
+  The binary glyph metrics format (.amfb).
+
+  It holds the same information as an .amf-file, but it can be memory mapped and used
+  directly, without any parsing. The file is a header, followed by one fixed-size record
+  per glyph, sorted by code point, a lookup index, and a kerning table. All values are little-endian, and
+  the records and the index start at offsets that are multiples of 8, so on little-endian
+  machines the file can be used in place.
+
+  The index is a two-level page table over the code points. The first level has an entry for
+  every block of 256 code points, up to the largest code point in the file. The entry is the
+  number of a second level table, or AMFB_NO_ENTRY if no code point in the block has a glyph.
+  The second level tables have 256 entries, which are glyph record numbers, or AMFB_NO_ENTRY.
+  So finding a glyph takes two reads, however many glyphs there are.
+
+  The kerning table holds a record for every pair of characters whose spacing is adjusted,
+  sorted by left and then by right character, so a pair is found with a binary search.
+
+  This header has no dependencies, so it can be copied into the program that loads the atlases.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define AMFB_MAGIC "AMFB"
+
+#define AMFB_VERSION 3
+
+// version 1 files had no index, and version 2 files no kerning table. Both had shorter headers.
+#define AMFB_HEADER_SIZE_V1 48
+#define AMFB_HEADER_SIZE_V2 64
+
+#define AMFB_NO_ENTRY 0xFFFFFFFFu
+
+#define AMFB_INDEX_BLOCK_SIZE 256
+
+/*
+  The pixel formats of the atlas images.
+*/
+enum AmfbFormat {
+    AMFB_FORMAT_RGBA = 0,
+    AMFB_FORMAT_GREY = 1,
+    AMFB_FORMAT_LCD = 2,
+
+    // a signed distance field in a single channel. 128 is on the outline, and the values reach
+    // 0 and 255 at distance_range pixels out of and into the glyph.
+    AMFB_FORMAT_SDF = 3,
+
+    // a signed distance field in the RGB channels. The median of the three is the distance.
+    AMFB_FORMAT_MSDF = 4
+};
+
+struct AmfbHeader {
+    // AMFB_MAGIC, without the terminating zero.
+    char magic[4];
+
+    uint32_t version;
+
+    // the size of this header in bytes. Later versions may only add fields at the end.
+    uint32_t header_size;
+
+    // the size of a glyph record in bytes.
+    uint32_t glyph_size;
+
+    uint32_t glyph_count;
+
+    // the offset of the first glyph record from the start of the file.
+    uint32_t glyph_offset;
+
+    uint32_t page_count;
+
+    // an AmfbFormat.
+    uint32_t format;
+
+    // font-wide metrics, in pixels.
+    int32_t font_size;
+    int32_t ascender;
+    int32_t descender;
+    int32_t line_height;
+
+    // the offset of the first level of the index from the start of the file. The second
+    // level tables follow it directly.
+    uint32_t index_offset;
+
+    // the number of entries in the first level of the index.
+    uint32_t index_block_count;
+
+    // the number of second level tables.
+    uint32_t index_table_count;
+
+    // the offset of the first kerning record from the start of the file.
+    uint32_t kerning_offset;
+
+    uint32_t kerning_count;
+
+    // for distance fields, how many pixels they reach out of and into the glyphs. 0 otherwise.
+    uint32_t distance_range;
+};
+
+struct AmfbGlyph {
+    uint32_t codepoint;
+
+    // position and size of the bitmap in the atlas page.
+    uint16_t x;
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+
+    // offsets of the bitmap from the cursor. top is measured upwards from the baseline.
+    int16_t left;
+    int16_t top;
+
+    // how many pixels the cursor moves forward after the glyph.
+    int16_t advance;
+
+    uint16_t page;
+
+    uint32_t reserved;
+};
+
+struct AmfbKerningPair {
+    uint32_t left;
+    uint32_t right;
+
+    // added to the advance of the left character, in pixels, when the right one follows it.
+    int32_t value;
+};
+
+/*
+  Check that the size bytes at data are a valid .amfb-file, and return its header.
+  Returns NULL if they are not.
+*/
+inline const AmfbHeader* amfb_header(const void* data, size_t size) {
+    const AmfbHeader* header = (const AmfbHeader*)data;
+
+    if(size < AMFB_HEADER_SIZE_V1 || memcmp(header->magic, AMFB_MAGIC, 4) != 0 ||
+       header->version < 1 || header->version > AMFB_VERSION || header->header_size < AMFB_HEADER_SIZE_V1 ||
+       header->header_size > size || header->glyph_size < sizeof(AmfbGlyph) || header->glyph_offset % 8 != 0) {
+	return NULL;
+    }
+
+    if(header->glyph_offset > size ||
+       (size - header->glyph_offset) / header->glyph_size < header->glyph_count) {
+	return NULL;
+    }
+
+    if(header->version >= 2) {
+	if(header->header_size < AMFB_HEADER_SIZE_V2 || header->index_offset % 8 != 0 || header->index_offset > size) {
+	    return NULL;
+	}
+
+	const uint64_t index_entries = header->index_block_count + (uint64_t)header->index_table_count * AMFB_INDEX_BLOCK_SIZE;
+	if((size - header->index_offset) / 4 < index_entries) {
+	    return NULL;
+	}
+    }
+
+    if(header->version >= 3) {
+	if(header->header_size < sizeof(AmfbHeader) || header->kerning_offset % 4 != 0 || header->kerning_offset > size ||
+	   (size - header->kerning_offset) / sizeof(AmfbKerningPair) < header->kerning_count) {
+	    return NULL;
+	}
+    }
+
+    return header;
+}
+
+/*
+  The i-th glyph record, in order of code point.
+*/
+inline const AmfbGlyph* amfb_glyph(const AmfbHeader* header, uint32_t i) {
+    return (const AmfbGlyph*)((const char*)header + header->glyph_offset + (size_t)i * header->glyph_size);
+}
+
+/*
+  Find the glyph of a code point with a binary search. Returns NULL if there is no such glyph.
+  This works for files without an index.
+*/
+inline const AmfbGlyph* amfb_search_glyph(const AmfbHeader* header, uint32_t codepoint) {
+    uint32_t lo = 0;
+    uint32_t hi = header->glyph_count;
+
+    while(lo < hi) {
+	const uint32_t mid = lo + (hi - lo) / 2;
+	const AmfbGlyph* glyph = amfb_glyph(header, mid);
+
+	if(glyph->codepoint < codepoint) {
+	    lo = mid + 1;
+	} else if(glyph->codepoint > codepoint) {
+	    hi = mid;
+	} else {
+	    return glyph;
+	}
+    }
+
+    return NULL;
+}
+
+/*
+  Find the glyph of a code point with the index. Returns NULL if there is no such glyph.
+*/
+inline const AmfbGlyph* amfb_find_glyph(const AmfbHeader* header, uint32_t codepoint) {
+    if(header->version < 2) {
+	return amfb_search_glyph(header, codepoint);
+    }
+
+    const uint32_t block = codepoint / AMFB_INDEX_BLOCK_SIZE;
+    if(block >= header->index_block_count) {
+	return NULL;
+    }
+
+    const uint32_t* blocks = (const uint32_t*)((const char*)header + header->index_offset);
+    const uint32_t table = blocks[block];
+    if(table >= header->index_table_count) {
+	return NULL;
+    }
+
+    const uint32_t* tables = blocks + header->index_block_count;
+    const uint32_t glyph = tables[(size_t)table * AMFB_INDEX_BLOCK_SIZE + codepoint % AMFB_INDEX_BLOCK_SIZE];
+    if(glyph >= header->glyph_count) {
+	return NULL;
+    }
+
+    return amfb_glyph(header, glyph);
+}
+
+/*
+  The kerning between two characters, in pixels. Returns 0 if the pair is not kerned.
+*/
+inline int32_t amfb_kerning(const AmfbHeader* header, uint32_t left, uint32_t right) {
+    if(header->version < 3) {
+	return 0;
+    }
+
+    const AmfbKerningPair* pairs = (const AmfbKerningPair*)((const char*)header + header->kerning_offset);
+    const uint64_t key = ((uint64_t)left << 32) | right;
+
+    uint32_t lo = 0;
+    uint32_t hi = header->kerning_count;
+
+    while(lo < hi) {
+	const uint32_t mid = lo + (hi - lo) / 2;
+	const uint64_t mid_key = ((uint64_t)pairs[mid].left << 32) | pairs[mid].right;
+
+	if(mid_key < key) {
+	    lo = mid + 1;
+	} else if(mid_key > key) {
+	    hi = mid;
+	} else {
+	    return pairs[mid].value;
+	}
+    }
+
+    return 0;
+}
+
+#endif
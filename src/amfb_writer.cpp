@@ -0,0 +1,265 @@
+#include "amfb_writer.h"
+
+#include "lodepng.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+using std::string;
+
+/*
+  The file is always written as little-endian, whatever the byte order of this machine.
+*/
+
+static void put_u16(std::vector<unsigned char>& out, uint16_t value) {
+    out.push_back((unsigned char)(value & 0xFF));
+    out.push_back((unsigned char)(value >> 8));
+}
+
+static void put_u32(std::vector<unsigned char>& out, uint32_t value) {
+    put_u16(out, (uint16_t)(value & 0xFFFF));
+    put_u16(out, (uint16_t)(value >> 16));
+}
+
+static bool codepoint_less(const AmfbGlyph& a, const AmfbGlyph& b) {
+    return a.codepoint < b.codepoint;
+}
+
+static bool kerning_pair_less(const AmfbKerningPair& a, const AmfbKerningPair& b) {
+    return a.left < b.left || (a.left == b.left && a.right < b.right);
+}
+
+bool write_amfb_file(const string& filename, AmfbHeader header, std::vector<AmfbGlyph> glyphs,
+		     std::vector<AmfbKerningPair> kerning) {
+
+    std::sort(glyphs.begin(), glyphs.end(), codepoint_less);
+    std::sort(kerning.begin(), kerning.end(), kerning_pair_less);
+
+    memcpy(header.magic, AMFB_MAGIC, 4);
+    header.version = AMFB_VERSION;
+    header.header_size = sizeof(AmfbHeader);
+    header.glyph_size = sizeof(AmfbGlyph);
+    header.glyph_count = (uint32_t)glyphs.size();
+    header.glyph_offset = (sizeof(AmfbHeader) + 7) & ~7u;
+
+    /*
+      Build the two-level index.
+    */
+
+    const uint32_t max_codepoint = glyphs.empty() ? 0 : glyphs.back().codepoint;
+    std::vector<uint32_t> blocks(glyphs.empty() ? 0 : max_codepoint / AMFB_INDEX_BLOCK_SIZE + 1, AMFB_NO_ENTRY);
+    std::vector<uint32_t> tables;
+
+    for(size_t i = 0; i < glyphs.size(); ++i) {
+	uint32_t& table = blocks[glyphs[i].codepoint / AMFB_INDEX_BLOCK_SIZE];
+
+	if(table == AMFB_NO_ENTRY) {
+	    table = (uint32_t)(tables.size() / AMFB_INDEX_BLOCK_SIZE);
+	    tables.resize(tables.size() + AMFB_INDEX_BLOCK_SIZE, AMFB_NO_ENTRY);
+	}
+
+	tables[(size_t)table * AMFB_INDEX_BLOCK_SIZE + glyphs[i].codepoint % AMFB_INDEX_BLOCK_SIZE] = (uint32_t)i;
+    }
+
+    header.index_offset = (uint32_t)((header.glyph_offset + glyphs.size() * sizeof(AmfbGlyph) + 7) & ~(size_t)7);
+    header.index_block_count = (uint32_t)blocks.size();
+    header.index_table_count = (uint32_t)(tables.size() / AMFB_INDEX_BLOCK_SIZE);
+    header.kerning_offset = (uint32_t)(header.index_offset + (blocks.size() + tables.size()) * 4);
+    header.kerning_count = (uint32_t)kerning.size();
+
+    std::vector<unsigned char> out;
+    out.reserve(header.kerning_offset + kerning.size() * sizeof(AmfbKerningPair));
+
+    out.insert(out.end(), header.magic, header.magic + 4);
+    put_u32(out, header.version);
+    put_u32(out, header.header_size);
+    put_u32(out, header.glyph_size);
+    put_u32(out, header.glyph_count);
+    put_u32(out, header.glyph_offset);
+    put_u32(out, header.page_count);
+    put_u32(out, header.format);
+    put_u32(out, (uint32_t)header.font_size);
+    put_u32(out, (uint32_t)header.ascender);
+    put_u32(out, (uint32_t)header.descender);
+    put_u32(out, (uint32_t)header.line_height);
+    put_u32(out, header.index_offset);
+    put_u32(out, header.index_block_count);
+    put_u32(out, header.index_table_count);
+    put_u32(out, header.kerning_offset);
+    put_u32(out, header.kerning_count);
+    put_u32(out, header.distance_range);
+    out.resize(header.glyph_offset, 0);
+
+    for(size_t i = 0; i < glyphs.size(); ++i) {
+	const AmfbGlyph& glyph = glyphs[i];
+
+	put_u32(out, glyph.codepoint);
+	put_u16(out, glyph.x);
+	put_u16(out, glyph.y);
+	put_u16(out, glyph.width);
+	put_u16(out, glyph.height);
+	put_u16(out, (uint16_t)glyph.left);
+	put_u16(out, (uint16_t)glyph.top);
+	put_u16(out, (uint16_t)glyph.advance);
+	put_u16(out, glyph.page);
+	put_u32(out, 0);
+    }
+
+    out.resize(header.index_offset, 0);
+
+    for(size_t i = 0; i < blocks.size(); ++i) {
+	put_u32(out, blocks[i]);
+    }
+    for(size_t i = 0; i < tables.size(); ++i) {
+	put_u32(out, tables[i]);
+    }
+
+    for(size_t i = 0; i < kerning.size(); ++i) {
+	put_u32(out, kerning[i].left);
+	put_u32(out, kerning[i].right);
+	put_u32(out, (uint32_t)kerning[i].value);
+    }
+
+    return lodepng_save_file(out.empty() ? NULL : &out[0], out.size(), filename.c_str()) == 0;
+}
+
+/*
+  Decode the UTF-8 character at the start of a line. Returns its length in bytes, or 0 if it is not valid.
+*/
+static size_t decode_utf8(const string& line, uint32_t& codepoint) {
+    const unsigned char lead = (unsigned char)line[0];
+    size_t length;
+
+    if(lead < 0x80) {
+	codepoint = lead;
+	length = 1;
+    } else if((lead & 0xE0) == 0xC0) {
+	codepoint = lead & 0x1F;
+	length = 2;
+    } else if((lead & 0xF0) == 0xE0) {
+	codepoint = lead & 0x0F;
+	length = 3;
+    } else if((lead & 0xF8) == 0xF0) {
+	codepoint = lead & 0x07;
+	length = 4;
+    } else {
+	return 0;
+    }
+
+    if(line.size() < length) {
+	return 0;
+    }
+
+    for(size_t k = 1; k < length; ++k) {
+	if((line[k] & 0xC0) != 0x80) {
+	    return 0;
+	}
+	codepoint = (codepoint << 6) | (line[k] & 0x3F);
+    }
+
+    return length;
+}
+
+/*
+  Parse one line of an .amf-file. The character comes first, so even the line of the ','
+  character can be parsed: its first comma is the character, and the second one the separator.
+*/
+static bool parse_amf_line(const string& line, AmfbGlyph& glyph) {
+
+    const size_t length = decode_utf8(line, glyph.codepoint);
+    if(length == 0 || line.size() <= length || line[length] != ',') {
+	return false;
+    }
+
+    long fields[8];
+    const char* str = line.c_str() + length + 1;
+
+    // the page was only added later, so it is optional.
+    int num_fields = 0;
+    for(; num_fields < 8; ++num_fields) {
+	char* end;
+	fields[num_fields] = strtol(str, &end, 10);
+
+	if(end == str) {
+	    return false;
+	}
+
+	str = end;
+	if(*str != ',') {
+	    ++num_fields;
+	    break;
+	}
+	++str;
+    }
+
+    if(num_fields < 7 || (*str != '\0' && *str != '\r')) {
+	return false;
+    }
+
+    glyph.x = (uint16_t)fields[0];
+    glyph.y = (uint16_t)fields[1];
+    glyph.width = (uint16_t)fields[2];
+    glyph.height = (uint16_t)fields[3];
+    glyph.left = (int16_t)fields[4];
+    glyph.top = (int16_t)fields[5];
+    glyph.advance = (int16_t)fields[6];
+    glyph.page = num_fields == 8 ? (uint16_t)fields[7] : 0;
+    glyph.reserved = 0;
+
+    return true;
+}
+
+bool convert_amf_to_amfb(const string& amf_file, const string& amfb_file) {
+
+    std::vector<unsigned char> text;
+    lodepng::load_file(text, amf_file);
+
+    if(text.empty()) {
+	printf("ERROR: could not read %s\n", amf_file.c_str());
+	return false;
+    }
+
+    std::vector<AmfbGlyph> glyphs;
+    unsigned int page_count = 0;
+
+    string line;
+    unsigned int line_number = 0;
+
+    for(size_t i = 0; i < text.size(); ++i) {
+	if(text[i] != '\n') {
+	    line += (char)text[i];
+	    if(i + 1 < text.size()) {
+		continue;
+	    }
+	}
+
+	++line_number;
+
+	if(!line.empty()) {
+	    AmfbGlyph glyph;
+
+	    if(!parse_amf_line(line, glyph)) {
+		printf("ERROR: line %u of %s is not a valid glyph\n", line_number, amf_file.c_str());
+		return false;
+	    }
+
+	    glyphs.push_back(glyph);
+	    page_count = std::max(page_count, glyph.page + 1u);
+	}
+
+	line.clear();
+    }
+
+    AmfbHeader header;
+    memset(&header, 0, sizeof(header));
+    header.page_count = page_count;
+
+    if(!write_amfb_file(amfb_file, header, glyphs, std::vector<AmfbKerningPair>())) {
+	printf("ERROR: could not write %s\n", amfb_file.c_str());
+	return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef AMFB_WRITER_H
+#define AMFB_WRITER_H
+
+#include "amfb.h"
+
+#include <string>
+#include <vector>
+
+/*
+  Write an .amfb-file. The counts, sizes and offsets of the header are filled in here,
+  the glyphs and the kerning pairs are sorted, and the lookup index is built. Returns false
+  if the file could not be written.
+*/
+bool write_amfb_file(const std::string& filename, AmfbHeader header, std::vector<AmfbGlyph> glyphs,
+		     std::vector<AmfbKerningPair> kerning);
+
+/*
+  Convert an .amf-file to an .amfb-file. The .amf-file does not contain the font-wide metrics
+  or the kerning, so they are left at zero and empty. Returns false, after printing an error, if the conversion failed.
+*/
+bool convert_amf_to_amfb(const std::string& amf_file, const std::string& amfb_file);
+
+#endif
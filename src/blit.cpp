@@ -0,0 +1,159 @@
+#include "blit.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLIT_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+  Scalar versions, that work everywhere, and handle the ends of the rows for the SIMD versions.
+*/
+
+static void grey_to_rgba_row(unsigned char* dst, const unsigned char* src, unsigned int width) {
+    for(unsigned int x = 0; x < width; ++x) {
+	dst[4*x + 0] = 255;
+	dst[4*x + 1] = 255;
+	dst[4*x + 2] = 255;
+	dst[4*x + 3] = src[x];
+    }
+}
+
+static void lcd_to_rgba_row(unsigned char* dst, const unsigned char* src, unsigned int width) {
+    for(unsigned int x = 0; x < width; ++x) {
+	const unsigned char r = src[3*x + 0];
+	const unsigned char g = src[3*x + 1];
+	const unsigned char b = src[3*x + 2];
+
+	unsigned char a = r > g ? r : g;
+	a = a > b ? a : b;
+
+	dst[4*x + 0] = r;
+	dst[4*x + 1] = g;
+	dst[4*x + 2] = b;
+	dst[4*x + 3] = a;
+    }
+}
+
+#ifdef BLIT_X86
+
+/*
+  Widen 16 coverage values at a time: interleave them with 0xFF twice, which gives
+  the bytes (255,255,255,a) for every pixel.
+*/
+__attribute__((target("sse2")))
+static void grey_to_rgba_row_sse2(unsigned char* dst, const unsigned char* src, unsigned int width) {
+    const __m128i ones = _mm_set1_epi8((char)0xFF);
+
+    unsigned int x = 0;
+    for(; x + 16 <= width; x += 16) {
+	const __m128i a = _mm_loadu_si128((const __m128i*)(src + x));
+
+	const __m128i lo = _mm_unpacklo_epi8(ones, a);
+	const __m128i hi = _mm_unpackhi_epi8(ones, a);
+
+	_mm_storeu_si128((__m128i*)(dst + 4*x + 0), _mm_unpacklo_epi16(ones, lo));
+	_mm_storeu_si128((__m128i*)(dst + 4*x + 16), _mm_unpackhi_epi16(ones, lo));
+	_mm_storeu_si128((__m128i*)(dst + 4*x + 32), _mm_unpacklo_epi16(ones, hi));
+	_mm_storeu_si128((__m128i*)(dst + 4*x + 48), _mm_unpackhi_epi16(ones, hi));
+    }
+
+    grey_to_rgba_row(dst + 4*x, src + x, width - x);
+}
+
+/*
+  Zero extend 8 coverage values to 32 bits each, move them to the alpha byte, and set RGB to white.
+*/
+__attribute__((target("avx2")))
+static void grey_to_rgba_row_avx2(unsigned char* dst, const unsigned char* src, unsigned int width) {
+    const __m256i white = _mm256_set1_epi32(0x00FFFFFF);
+
+    unsigned int x = 0;
+    for(; x + 16 <= width; x += 16) {
+	const __m128i a = _mm_loadu_si128((const __m128i*)(src + x));
+
+	const __m256i lo = _mm256_cvtepu8_epi32(a);
+	const __m256i hi = _mm256_cvtepu8_epi32(_mm_srli_si128(a, 8));
+
+	_mm256_storeu_si256((__m256i*)(dst + 4*x + 0), _mm256_or_si256(_mm256_slli_epi32(lo, 24), white));
+	_mm256_storeu_si256((__m256i*)(dst + 4*x + 32), _mm256_or_si256(_mm256_slli_epi32(hi, 24), white));
+    }
+
+    grey_to_rgba_row(dst + 4*x, src + x, width - x);
+}
+
+/*
+  Spread 4 pixels of 3 bytes into 4 lanes of 32 bits with a shuffle, and put the
+  largest of the three subpixels into the empty fourth byte.
+*/
+__attribute__((target("ssse3")))
+static void lcd_to_rgba_row_ssse3(unsigned char* dst, const unsigned char* src, unsigned int width) {
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i low_byte = _mm_set1_epi32(0xFF);
+
+    unsigned int x = 0;
+
+    // every load reads 16 bytes, of which 12 are used, so it must not run past the end of the row.
+    for(; x + 6 <= width; x += 4) {
+	const __m128i rgb = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + 3*x)), spread);
+
+	__m128i a = _mm_max_epu8(rgb, _mm_srli_epi32(rgb, 8));
+	a = _mm_max_epu8(a, _mm_srli_epi32(rgb, 16));
+	a = _mm_slli_epi32(_mm_and_si128(a, low_byte), 24);
+
+	_mm_storeu_si128((__m128i*)(dst + 4*x), _mm_or_si128(rgb, a));
+    }
+
+    lcd_to_rgba_row(dst + 4*x, src + 3*x, width - x);
+}
+
+#endif
+
+typedef void (*RowFunction)(unsigned char* dst, const unsigned char* src, unsigned int width);
+
+/*
+  Pick the fastest row function that the CPU supports.
+*/
+static RowFunction select_row_function(BlitMode mode) {
+#ifdef BLIT_X86
+    __builtin_cpu_init();
+
+    if(mode == BLIT_GREY_TO_RGBA) {
+	if(__builtin_cpu_supports("avx2")) {
+	    return grey_to_rgba_row_avx2;
+	}
+	if(__builtin_cpu_supports("sse2")) {
+	    return grey_to_rgba_row_sse2;
+	}
+    } else if(mode == BLIT_LCD_TO_RGBA) {
+	if(__builtin_cpu_supports("ssse3")) {
+	    return lcd_to_rgba_row_ssse3;
+	}
+    }
+#endif
+
+    return mode == BLIT_LCD_TO_RGBA ? lcd_to_rgba_row : grey_to_rgba_row;
+}
+
+void blit_bitmap(unsigned char* dst, size_t dst_pitch,
+		 const unsigned char* src, size_t src_pitch,
+		 unsigned int width, unsigned int rows, BlitMode mode) {
+
+    if(mode == BLIT_GREY_TO_GREY || mode == BLIT_RGB_TO_RGB) {
+	const size_t row_size = mode == BLIT_RGB_TO_RGB ? 3 * (size_t)width : width;
+	for(unsigned int row = 0; row < rows; ++row) {
+	    memcpy(dst + row * dst_pitch, src + row * src_pitch, row_size);
+	}
+	return;
+    }
+
+    static const RowFunction grey_to_rgba = select_row_function(BLIT_GREY_TO_RGBA);
+    static const RowFunction lcd_to_rgba = select_row_function(BLIT_LCD_TO_RGBA);
+
+    const RowFunction row_function = mode == BLIT_LCD_TO_RGBA ? lcd_to_rgba : grey_to_rgba;
+
+    for(unsigned int row = 0; row < rows; ++row) {
+	row_function(dst + row * dst_pitch, src + row * src_pitch, width);
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef BLIT_H
+#define BLIT_H
+
+#include <stddef.h>
+
+/*
+  The ways a glyph bitmap can be copied into an atlas.
+*/
+enum BlitMode {
+    // 8-bit coverage into a single channel atlas.
+    BLIT_GREY_TO_GREY,
+
+    // 8-bit coverage into an RGBA atlas, as white with the coverage in alpha.
+    BLIT_GREY_TO_RGBA,
+
+    // LCD coverage, with 3 bytes per pixel for the red, green and blue subpixels, into an RGBA atlas.
+    // alpha is set to the largest of the three.
+    BLIT_LCD_TO_RGBA,
+
+    // 3 bytes per pixel into an RGB atlas.
+    BLIT_RGB_TO_RGB
+};
+
+/*
+  Copy a bitmap of width x rows pixels into an atlas, row by row. The pitches are the
+  distances in bytes between the starts of two rows, in the atlas and in the bitmap.
+
+  The widening from coverage to RGBA uses SSE2, SSSE3 or AVX2, when the CPU has them.
+*/
+void blit_bitmap(unsigned char* dst, size_t dst_pitch,
+		 const unsigned char* src, size_t src_pitch,
+		 unsigned int width, unsigned int rows, BlitMode mode);
+
+#endif
@@ -0,0 +1,219 @@
+#include "cache.h"
+
+#include "lodepng.h"
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#define make_directory(path) _mkdir(path)
+#define remove_directory(path) _rmdir(path)
+#define process_id() _getpid()
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define make_directory(path) mkdir(path, 0777)
+#define remove_directory(path) rmdir(path)
+#define process_id() getpid()
+#endif
+
+using std::string;
+
+// the file in an entry that holds the key. It is compared against, to rule out hash collisions.
+#define KEY_FILE "key"
+
+// the file in an entry that lists the suffixes of the stored files, one per line.
+#define FILES_FILE "files"
+
+unsigned long long hash_bytes(const unsigned char* data, size_t size, unsigned long long hash) {
+    for(size_t i = 0; i < size; ++i) {
+	hash ^= data[i];
+	hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static string to_hex(unsigned long long value) {
+    char str[17];
+    snprintf(str, sizeof(str), "%016llx", value);
+    return string(str);
+}
+
+/*
+  The version of the FreeType library that renders the glyphs, which can give other bitmaps for the same
+  font than another version. The library that is linked can be another version than the headers.
+*/
+static string freetype_version() {
+    FT_Int major = FREETYPE_MAJOR;
+    FT_Int minor = FREETYPE_MINOR;
+    FT_Int patch = FREETYPE_PATCH;
+    FT_Library library;
+
+    if(FT_Init_FreeType(&library) == 0) {
+	FT_Library_Version(library, &major, &minor, &patch);
+	FT_Done_FreeType(library);
+    }
+
+    return std::to_string(major) + "." + std::to_string(minor) + "." + std::to_string(patch);
+}
+
+string make_cache_key(const string& settings, unsigned long long font_hash, size_t font_size_in_bytes,
+		      const std::vector<unsigned int>& codepoints) {
+
+    string key = settings + "\nfreetype " + freetype_version() + "\nfont " + to_hex(font_hash) + " "
+	+ std::to_string(font_size_in_bytes) + "\nchars";
+
+    // the characters are sorted, so they can be written as runs.
+    for(size_t i = 0; i < codepoints.size(); ) {
+	size_t end = i + 1;
+	while(end < codepoints.size() && codepoints[end] == codepoints[end - 1] + 1) {
+	    ++end;
+	}
+
+	key += " " + std::to_string(codepoints[i]) + "-" + std::to_string(codepoints[end - 1]);
+	i = end;
+    }
+
+    return key + "\n";
+}
+
+static string entry_dir(const string& cache_dir, const string& key) {
+    return cache_dir + "/" + to_hex(hash_bytes((const unsigned char*)key.data(), key.size()));
+}
+
+static bool read_file(const string& filename, std::vector<unsigned char>& data) {
+    unsigned char* buffer;
+    size_t size;
+
+    if(lodepng_load_file(&buffer, &size, filename.c_str()) != 0) {
+	return false;
+    }
+
+    data.assign(buffer, buffer + size);
+    free(buffer);
+    return true;
+}
+
+static bool write_file(const string& filename, const std::vector<unsigned char>& data) {
+    return lodepng_save_file(data.empty() ? NULL : &data[0], data.size(), filename.c_str()) == 0;
+}
+
+/*
+  Copy a file, by first writing a temporary file next to the destination, and then renaming it.
+  So nobody reading the destination will ever see it half written.
+*/
+static bool copy_file(const string& from, const string& to, const string& temp_suffix) {
+    std::vector<unsigned char> data;
+    if(!read_file(from, data)) {
+	return false;
+    }
+
+    const string temp = to + temp_suffix;
+    if(!write_file(temp, data)) {
+	remove(temp.c_str());
+	return false;
+    }
+
+    if(rename(temp.c_str(), to.c_str()) != 0) {
+	remove(temp.c_str());
+	return false;
+    }
+
+    return true;
+}
+
+/*
+  A name that no other thread or process uses for its temporary files.
+*/
+static string unique_suffix() {
+    static std::atomic<unsigned int> counter(0);
+    return ".tmp-" + std::to_string((long long)process_id()) + "-" + std::to_string(counter.fetch_add(1));
+}
+
+bool cache_fetch(const string& cache_dir, const string& key, const string& output_file_prefix,
+		 std::vector<string>& file_suffixes) {
+
+    const string dir = entry_dir(cache_dir, key);
+
+    std::vector<unsigned char> stored_key;
+    if(!read_file(dir + "/" + KEY_FILE, stored_key) || string(stored_key.begin(), stored_key.end()) != key) {
+	return false;
+    }
+
+    std::vector<unsigned char> files;
+    if(!read_file(dir + "/" + FILES_FILE, files)) {
+	return false;
+    }
+
+    file_suffixes.clear();
+    string suffix;
+    for(size_t i = 0; i < files.size(); ++i) {
+	if(files[i] == '\n') {
+	    file_suffixes.push_back(suffix);
+	    suffix.clear();
+	} else {
+	    suffix += (char)files[i];
+	}
+    }
+
+    const string temp_suffix = unique_suffix();
+    for(size_t i = 0; i < file_suffixes.size(); ++i) {
+	if(!copy_file(dir + "/" + file_suffixes[i], output_file_prefix + file_suffixes[i], temp_suffix)) {
+	    return false;
+	}
+    }
+
+    return true;
+}
+
+void cache_store(const string& cache_dir, const string& key, const string& output_file_prefix,
+		 const std::vector<string>& file_suffixes) {
+
+    const string dir = entry_dir(cache_dir, key);
+    const string temp_dir = dir + unique_suffix();
+
+    // the cache directory itself may already exist.
+    make_directory(cache_dir.c_str());
+
+    if(make_directory(temp_dir.c_str()) != 0) {
+	return;
+    }
+
+    std::vector<string> written;
+    bool ok = true;
+
+    string files;
+    for(size_t i = 0; i < file_suffixes.size() && ok; ++i) {
+	ok = copy_file(output_file_prefix + file_suffixes[i], temp_dir + "/" + file_suffixes[i], "");
+	written.push_back(file_suffixes[i]);
+	files += file_suffixes[i] + "\n";
+    }
+
+    if(ok) {
+	ok = write_file(temp_dir + "/" + FILES_FILE, std::vector<unsigned char>(files.begin(), files.end()));
+	written.push_back(FILES_FILE);
+    }
+
+    if(ok) {
+	ok = write_file(temp_dir + "/" + KEY_FILE, std::vector<unsigned char>(key.begin(), key.end()));
+	written.push_back(KEY_FILE);
+    }
+
+    // if another process stored the same entry in the meantime, the rename fails, and we throw ours away.
+    if(ok && rename(temp_dir.c_str(), dir.c_str()) == 0) {
+	return;
+    }
+
+    for(size_t i = 0; i < written.size(); ++i) {
+	remove((temp_dir + "/" + written[i]).c_str());
+    }
+    remove_directory(temp_dir.c_str());
+}
@@ -0,0 +1,43 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <string>
+#include <vector>
+
+/*
+  The output cache stores the files that were created for an atlas under a hash of everything
+  that went into creating them: the font file, the font size, the characters, the packing
+  settings and the version of the program. If the same atlas is asked for again, the files
+  are copied from the cache, instead of being created again.
+
+  An entry is written to a temporary directory, and then renamed into place, so readers never
+  see half-written entries, and several processes can share a cache directory.
+*/
+
+/*
+  A 64-bit FNV-1a hash.
+*/
+unsigned long long hash_bytes(const unsigned char* data, size_t size, unsigned long long hash = 14695981039346656037ULL);
+
+/*
+  The complete description of an atlas, as used for looking it up in the cache.
+  Two atlases with the same key are identical.
+*/
+std::string make_cache_key(const std::string& settings, unsigned long long font_hash, size_t font_size_in_bytes,
+			   const std::vector<unsigned int>& codepoints);
+
+/*
+  If the cache has an entry for the key, copy its files to the output files, and return true.
+  file_suffixes is set to the suffixes of the files, that come after the output file prefix.
+*/
+bool cache_fetch(const std::string& cache_dir, const std::string& key, const std::string& output_file_prefix,
+		 std::vector<std::string>& file_suffixes);
+
+/*
+  Store the output files with the given suffixes in the cache under the key.
+  Failing to store an entry is not an error, since the output files already exist.
+*/
+void cache_store(const std::string& cache_dir, const std::string& key, const std::string& output_file_prefix,
+		 const std::vector<std::string>& file_suffixes);
+
+#endif
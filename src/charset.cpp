@@ -0,0 +1,196 @@
+#include "charset.h"
+
+#include "lodepng.h"
+
+#include <algorithm>
+#include <stdlib.h>
+
+// the largest code point in Unicode.
+#define MAX_CODEPOINT 0x10FFFF
+
+/*
+  Parse a single code point at str, and advance str past it.
+*/
+static bool parse_codepoint(const char*& str, unsigned int& codepoint) {
+
+    int base = 10;
+
+    if((str[0] == 'U' || str[0] == 'u') && str[1] == '+') {
+	str += 2;
+	base = 16;
+    } else if(str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+	str += 2;
+	base = 16;
+    }
+
+    char* end;
+    const unsigned long value = strtoul(str, &end, base);
+
+    if(end == str || value > MAX_CODEPOINT) {
+	return false;
+    }
+
+    str = end;
+    codepoint = (unsigned int)value;
+    return true;
+}
+
+bool parse_char_range(const char* str, std::vector<CharRange>& ranges) {
+
+    CharRange range;
+
+    if(!parse_codepoint(str, range.first)) {
+	return false;
+    }
+
+    range.last = range.first;
+
+    if(*str == '-') {
+	++str;
+	if(!parse_codepoint(str, range.last)) {
+	    return false;
+	}
+    }
+
+    if(*str != '\0' || range.last < range.first) {
+	return false;
+    }
+
+    ranges.push_back(range);
+    return true;
+}
+
+bool load_charset_file(const std::string& filename, std::vector<CharRange>& ranges) {
+
+    std::vector<unsigned char> text;
+    lodepng::load_file(text, filename);
+
+    if(text.empty()) {
+	return false;
+    }
+
+    size_t i = 0;
+
+    // skip the byte order mark, if there is one.
+    if(text.size() >= 3 && text[0] == 0xEF && text[1] == 0xBB && text[2] == 0xBF) {
+	i = 3;
+    }
+
+    while(i < text.size()) {
+
+	const unsigned char lead = text[i];
+	unsigned int codepoint;
+	size_t length;
+
+	if(lead < 0x80) {
+	    codepoint = lead;
+	    length = 1;
+	} else if((lead & 0xE0) == 0xC0) {
+	    codepoint = lead & 0x1F;
+	    length = 2;
+	} else if((lead & 0xF0) == 0xE0) {
+	    codepoint = lead & 0x0F;
+	    length = 3;
+	} else if((lead & 0xF8) == 0xF0) {
+	    codepoint = lead & 0x07;
+	    length = 4;
+	} else {
+	    return false;
+	}
+
+	if(i + length > text.size()) {
+	    return false;
+	}
+
+	for(size_t k = 1; k < length; ++k) {
+	    if((text[i + k] & 0xC0) != 0x80) {
+		return false;
+	    }
+	    codepoint = (codepoint << 6) | (text[i + k] & 0x3F);
+	}
+
+	// the smallest code point that needs each length, so that overlong encodings are rejected.
+	static const unsigned int min_codepoint[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+
+	if(codepoint < min_codepoint[length] || codepoint > MAX_CODEPOINT) {
+	    return false;
+	}
+
+	// UTF-16 surrogates are not characters.
+	if(codepoint >= 0xD800 && codepoint <= 0xDFFF) {
+	    return false;
+	}
+
+	i += length;
+
+	if(codepoint < 0x20 || codepoint == 0x7F) {
+	    continue;
+	}
+
+	// runs of consecutive characters, like "abc", become a single range.
+	if(!ranges.empty() && ranges.back().last + 1 == codepoint) {
+	    ranges.back().last = codepoint;
+	} else {
+	    CharRange range = { codepoint, codepoint };
+	    ranges.push_back(range);
+	}
+    }
+
+    return true;
+}
+
+static bool range_less(const CharRange& a, const CharRange& b) {
+    return a.first < b.first;
+}
+
+void build_charset(std::vector<CharRange> ranges, std::vector<unsigned int>& codepoints) {
+
+    codepoints.clear();
+
+    if(ranges.empty()) {
+	return;
+    }
+
+    // sort and merge the ranges, so that every code point is only produced once.
+    std::sort(ranges.begin(), ranges.end(), range_less);
+
+    size_t merged = 0;
+    size_t total = 0;
+
+    for(size_t i = 1; i < ranges.size(); ++i) {
+	if(ranges[i].first <= ranges[merged].last + 1) {
+	    ranges[merged].last = std::max(ranges[merged].last, ranges[i].last);
+	} else {
+	    total += ranges[merged].last - ranges[merged].first + 1;
+	    ranges[++merged] = ranges[i];
+	}
+    }
+    total += ranges[merged].last - ranges[merged].first + 1;
+    ranges.resize(merged + 1);
+
+    codepoints.reserve(total);
+
+    for(size_t i = 0; i < ranges.size(); ++i) {
+	for(unsigned int codepoint = ranges[i].first; codepoint <= ranges[i].last; ++codepoint) {
+	    codepoints.push_back(codepoint);
+	}
+    }
+}
+
+void append_utf8(std::string& str, unsigned int codepoint) {
+    if(codepoint < 0x80) {
+	str += (char)codepoint;
+    } else if(codepoint < 0x800) {
+	str += (char)(0xC0 | (codepoint >> 6));
+	str += (char)(0x80 | (codepoint & 0x3F));
+    } else if(codepoint < 0x10000) {
+	str += (char)(0xE0 | (codepoint >> 12));
+	str += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+	str += (char)(0x80 | (codepoint & 0x3F));
+    } else {
+	str += (char)(0xF0 | (codepoint >> 18));
+	str += (char)(0x80 | ((codepoint >> 12) & 0x3F));
+	str += (char)(0x80 | ((codepoint >> 6) & 0x3F));
+	str += (char)(0x80 | (codepoint & 0x3F));
+    }
+}
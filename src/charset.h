@@ -0,0 +1,43 @@
+#ifndef CHARSET_H
+#define CHARSET_H
+
+#include <string>
+#include <vector>
+
+/*
+  An inclusive range of Unicode code points.
+*/
+struct CharRange {
+    unsigned int first;
+    unsigned int last;
+};
+
+/*
+  Parse a range given on the command line, and add it to ranges. The range is either a
+  single code point, or two code points separated by '-'. A code point is written either
+  as U+XXXX, 0xXXXX or as a decimal number. So "U+0400-U+04FF" and "65" are both valid.
+
+  Returns false if the range could not be parsed.
+*/
+bool parse_char_range(const char* str, std::vector<CharRange>& ranges);
+
+/*
+  Add every character in a UTF-8 encoded text file to ranges. Control characters, such as
+  line breaks, are ignored, so the characters can be spread over any number of lines.
+
+  Returns false if the file could not be read, or is not valid UTF-8.
+*/
+bool load_charset_file(const std::string& filename, std::vector<CharRange>& ranges);
+
+/*
+  Turn a list of possibly overlapping ranges into the sorted list of all the code points in them,
+  without any duplicates.
+*/
+void build_charset(std::vector<CharRange> ranges, std::vector<unsigned int>& codepoints);
+
+/*
+  Append the UTF-8 encoding of a code point to str.
+*/
+void append_utf8(std::string& str, unsigned int codepoint);
+
+#endif
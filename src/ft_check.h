@@ -0,0 +1,23 @@
+#ifndef FT_CHECK_H
+#define FT_CHECK_H
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+/*
+  If no FT error, do nothing.
+  Else, print FT error message, and shut down.
+*/
+void check_ft_error(const FT_Error error, const char* filename, const int line);
+
+/*
+  FreeType-Check
+
+  Macro used for handling when FT functions return error codes.
+*/
+#define FT_C(stmt) do {					\
+	FT_Error error = stmt;				\
+	check_ft_error(error, __FILE__, __LINE__);	\
+    } while (0)
+
+#endif
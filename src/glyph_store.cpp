@@ -0,0 +1,361 @@
+#include "glyph_store.h"
+#include "ft_check.h"
+#include "sdf.h"
+#include "msdf.h"
+#include "cache.h"
+
+#include FT_LCD_FILTER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+
+/*
+  The number of consecutive glyphs that a worker claims at a time.
+*/
+#define RASTER_CHUNK_SIZE 16
+
+#define NO_GLYPH 0xFFFFFFFFu
+
+/*
+  A glyph of the font that at least one of the requested characters maps to.
+*/
+struct UsedGlyph {
+    FT_UInt glyph_index;
+
+    // the first character that maps to it.
+    unsigned int codepoint;
+};
+
+/*
+  A glyph rendered by one of the workers, before it is merged into the shared store.
+*/
+struct RenderedGlyph {
+    // index of the glyph in the used glyphs.
+    unsigned int index;
+
+    Glyph glyph;
+};
+
+/*
+  Everything a single worker produces. The offsets of the glyphs point into the
+  pixels of the worker, not into the pixels of the shared store.
+*/
+struct WorkerOutput {
+    std::vector<RenderedGlyph> glyphs;
+    std::vector<unsigned char> pixels;
+};
+
+/*
+  Append the bitmap currently in the glyph slot to the pixel arena, and return its metrics.
+*/
+static Glyph store_glyph(std::vector<unsigned char>& pixels, unsigned int ch, FT_GlyphSlot slot) {
+
+    const FT_Bitmap& bitmap = slot->bitmap;
+
+    Glyph glyph;
+    glyph.codepoint = ch;
+    glyph.width = bitmap.pixel_mode == FT_PIXEL_MODE_LCD ? bitmap.width / 3 : bitmap.width;
+    glyph.rows = bitmap.rows;
+    glyph.bitmap_left = slot->bitmap_left;
+    glyph.bitmap_top = slot->bitmap_top;
+    glyph.advance = slot->advance.x >> 6;
+    glyph.offset = pixels.size();
+    glyph.pitch = bitmap.width;
+
+    pixels.resize(pixels.size() + glyph.pitch * glyph.rows);
+
+    // copy row by row, since the pitch of a FreeType bitmap may be larger than its width.
+    unsigned char* dst = pixels.empty() ? NULL : &pixels[glyph.offset];
+    for(unsigned int row = 0; row < glyph.rows; ++row) {
+	memcpy(dst + row * glyph.pitch, bitmap.buffer + row * bitmap.pitch, glyph.pitch);
+    }
+
+    return glyph;
+}
+
+void open_font_faces(const std::vector<unsigned char>& font_data, unsigned int num_threads, FontFaces& faces) {
+
+    if(num_threads == 0) {
+	num_threads = 1;
+    }
+
+    for(unsigned int t = 0; t < num_threads; ++t) {
+
+	FT_Library library;
+	FT_Face face;
+
+	FT_C(FT_Init_FreeType( &library ));
+
+	// only used when rendering for LCD. Not every FreeType build supports it, in which case the default filtering is used.
+	FT_Library_SetLcdFilter(library, FT_LCD_FILTER_DEFAULT);
+
+	FT_C(FT_New_Memory_Face( library,
+				 &font_data[0],
+				 font_data.size(),
+				 0, // face index. We'll be assuming there is only one face in the file.
+				 &face ));
+
+	if(face->num_faces != 1) {
+	    printf("This file has %ld font face(s), but this program only supports one face\n", face->num_faces);
+	    exit(1);
+	}
+
+	faces.libraries.push_back(library);
+	faces.faces.push_back(face);
+    }
+}
+
+void close_font_faces(FontFaces& faces) {
+    for(size_t t = 0; t < faces.faces.size(); ++t) {
+	FT_C(FT_Done_Face( faces.faces[t] ));
+	FT_C(FT_Done_FreeType( faces.libraries[t] ));
+    }
+
+    faces.faces.clear();
+    faces.libraries.clear();
+}
+
+/*
+  Every worker renders with its own face, and claims chunks of glyphs until
+  all glyphs have been rendered.
+*/
+static void raster_worker(FT_Face face, FT_Int32 load_flags, const RasterSettings* settings,
+			  const std::vector<UsedGlyph>* used_glyphs,
+			  std::atomic<unsigned int>* next_index, WorkerOutput* output) {
+
+    const unsigned int num_glyphs = (unsigned int)used_glyphs->size();
+
+    SdfScratch sdf_scratch;
+    MsdfScratch msdf_scratch;
+
+    while(true) {
+
+	const unsigned int begin = next_index->fetch_add(RASTER_CHUNK_SIZE);
+	if(begin >= num_glyphs) {
+	    break;
+	}
+
+	unsigned int end = begin + RASTER_CHUNK_SIZE;
+	if(end > num_glyphs) {
+	    end = num_glyphs;
+	}
+
+	for(unsigned int i = begin; i < end; ++i) {
+
+	    const unsigned int ch = (*used_glyphs)[i].codepoint;
+
+	    FT_C(FT_Load_Glyph(face, (*used_glyphs)[i].glyph_index, load_flags));
+
+	    RenderedGlyph rendered;
+	    rendered.index = i;
+	    if(settings->image == IMAGE_SDF) {
+		rendered.glyph = store_sdf_glyph(output->pixels, ch, face->glyph, settings->sdf_spread, sdf_scratch);
+	    } else if(settings->image == IMAGE_MSDF) {
+		rendered.glyph = store_msdf_glyph(output->pixels, ch, face->glyph, settings->sdf_spread, msdf_scratch);
+	    } else {
+		rendered.glyph = store_glyph(output->pixels, ch, face->glyph);
+	    }
+	    output->glyphs.push_back(rendered);
+	}
+    }
+
+}
+
+void rasterize_glyphs(FontFaces& faces, FT_F26Dot6 font_size, const RasterSettings& settings,
+		      const std::vector<unsigned int>& codepoints, GlyphStore& store) {
+
+    // FT_LOAD_TARGET_NORMAL is zero, so the normal mode renders exactly as FT_LOAD_RENDER alone.
+    FT_Int32 load_flags = FT_LOAD_RENDER |
+	(settings.image == IMAGE_LCD ? FT_LOAD_TARGET_LCD : FT_LOAD_TARGET_NORMAL);
+
+    // distance fields are made from larger renderings. They are meant to be scaled, so they are not hinted.
+    FT_F26Dot6 oversampling = 1;
+    if(settings.image == IMAGE_SDF) {
+	oversampling = SDF_OVERSAMPLING;
+	load_flags |= FT_LOAD_NO_HINTING;
+    } else if(settings.image == IMAGE_MSDF) {
+	// only the outline is needed.
+	load_flags = FT_LOAD_NO_HINTING | FT_LOAD_NO_BITMAP;
+    }
+
+    const unsigned int num_chars = (unsigned int)codepoints.size();
+
+    /*
+      Find the glyph of every character. Characters that are not in the font are left out,
+      rather than rendered as the missing glyph. Characters that map to the same glyph,
+      such as lookalike Latin and Cyrillic letters, or several kinds of space, are only
+      rendered once.
+    */
+
+    std::vector<UsedGlyph> used_glyphs;
+    std::vector<unsigned int> used_index(num_chars, NO_GLYPH);
+    std::unordered_map<FT_UInt, unsigned int> used_by_glyph_index;
+
+    for(unsigned int i = 0; i < num_chars; ++i) {
+	const FT_UInt glyph_index = FT_Get_Char_Index(faces.faces[0], codepoints[i]);
+	if(glyph_index == 0) {
+	    continue;
+	}
+
+	std::unordered_map<FT_UInt, unsigned int>::const_iterator it = used_by_glyph_index.find(glyph_index);
+	if(it != used_by_glyph_index.end()) {
+	    used_index[i] = it->second;
+	    continue;
+	}
+
+	UsedGlyph used;
+	used.glyph_index = glyph_index;
+	used.codepoint = codepoints[i];
+
+	used_index[i] = (unsigned int)used_glyphs.size();
+	used_by_glyph_index[glyph_index] = used_index[i];
+	used_glyphs.push_back(used);
+    }
+
+    const unsigned int num_glyphs = (unsigned int)used_glyphs.size();
+
+    // there is no point in having more workers than chunks.
+    unsigned int num_threads = (unsigned int)faces.faces.size();
+    const unsigned int num_chunks = (num_glyphs + RASTER_CHUNK_SIZE - 1) / RASTER_CHUNK_SIZE;
+    if(num_threads > num_chunks) {
+	num_threads = num_chunks > 0 ? num_chunks : 1;
+    }
+
+    for(unsigned int t = 0; t < num_threads; ++t) {
+	// set the font size.
+	FT_C(FT_Set_Char_Size(
+		 faces.faces[t],    // handle to face object
+		 font_size * oversampling * 64,  /* char_width  */
+		 0,   //char_height. It is 0, so it is set to char_width
+		 RESOLUTION,     /* horizontal device resolution    */
+		 RESOLUTION ));   /* vertical device resolution      */
+    }
+
+    const FT_Size_Metrics& metrics = faces.faces[0]->size->metrics;
+    store.ascender = (metrics.ascender / oversampling) >> 6;
+    store.descender = (metrics.descender / oversampling) >> 6;
+    store.line_height = (metrics.height / oversampling) >> 6;
+    store.x_scale = metrics.x_scale / oversampling;
+
+    std::atomic<unsigned int> next_index(0);
+    std::vector<WorkerOutput> outputs(num_threads);
+
+    // the calling thread is the first worker.
+    std::vector<std::thread> threads;
+    for(unsigned int t = 1; t < num_threads; ++t) {
+	threads.push_back(std::thread(raster_worker, faces.faces[t], load_flags, &settings, &used_glyphs, &next_index, &outputs[t]));
+    }
+    raster_worker(faces.faces[0], load_flags, &settings, &used_glyphs, &next_index, &outputs[0]);
+
+    for(size_t t = 0; t < threads.size(); ++t) {
+	threads[t].join();
+    }
+
+    /*
+      Which worker rendered which glyph depends on scheduling. But we merge
+      the results in character order, so the store is always the same.
+    */
+
+    std::vector<const RenderedGlyph*> by_index(num_glyphs, (const RenderedGlyph*)NULL);
+    std::vector<unsigned int> owner(num_glyphs, 0);
+    size_t total_pixels = store.pixels.size();
+
+    for(unsigned int t = 0; t < num_threads; ++t) {
+	for(size_t i = 0; i < outputs[t].glyphs.size(); ++i) {
+	    const RenderedGlyph& rendered = outputs[t].glyphs[i];
+	    by_index[rendered.index] = &rendered;
+	    owner[rendered.index] = t;
+	}
+	total_pixels += outputs[t].pixels.size();
+    }
+
+    store.glyphs.reserve(store.glyphs.size() + num_chars);
+    store.pixels.reserve(total_pixels);
+
+    // the store index of the first character that uses every glyph.
+    std::vector<unsigned int> first_use(num_glyphs, NO_GLYPH);
+
+    // the glyphs that have a bitmap of their own, by a hash of it.
+    std::unordered_map<unsigned long long, std::vector<unsigned int> > by_hash;
+
+    for(unsigned int i = 0; i < num_chars; ++i) {
+
+	const unsigned int u = used_index[i];
+	if(u == NO_GLYPH) {
+	    ++store.num_missing;
+	    continue;
+	}
+
+	const unsigned int store_index = (unsigned int)store.glyphs.size();
+
+	Glyph glyph = by_index[u]->glyph;
+	glyph.codepoint = codepoints[i];
+	glyph.image = store_index;
+
+	if(first_use[u] != NO_GLYPH) {
+	    // a character that maps to a glyph we already have.
+	    const Glyph& first = store.glyphs[first_use[u]];
+	    glyph.offset = first.offset;
+	    glyph.image = first.image;
+	    if(first.pitch > 0 && first.rows > 0) {
+		++store.num_shared;
+	    }
+	} else {
+	    first_use[u] = store_index;
+
+	    /*
+	      Different glyphs can still have the same bitmap. The hash finds the candidates,
+	      and comparing the pixels makes sure.
+	    */
+	    const unsigned char* src = outputs[owner[u]].pixels.empty() ? NULL : &outputs[owner[u]].pixels[glyph.offset];
+	    const size_t size = (size_t)glyph.pitch * glyph.rows;
+
+	    if(size == 0) {
+		// empty bitmaps are all the same, but there is nothing to share.
+		glyph.offset = store.pixels.size();
+	    } else {
+		unsigned long long hash = hash_bytes(src, size);
+		hash = hash_bytes((const unsigned char*)&glyph.width, sizeof(glyph.width), hash);
+		hash = hash_bytes((const unsigned char*)&glyph.rows, sizeof(glyph.rows), hash);
+
+		std::vector<unsigned int>& candidates = by_hash[hash];
+		for(size_t c = 0; c < candidates.size(); ++c) {
+		    const Glyph& other = store.glyphs[candidates[c]];
+
+		    if(other.width == glyph.width && other.rows == glyph.rows && other.pitch == glyph.pitch &&
+		       memcmp(store.bitmap(other), src, size) == 0) {
+			glyph.offset = other.offset;
+			glyph.image = other.image;
+			++store.num_shared;
+			break;
+		    }
+		}
+
+		if(glyph.image == store_index) {
+		    glyph.offset = store.pixels.size();
+		    store.pixels.insert(store.pixels.end(), src, src + size);
+		    candidates.push_back(store_index);
+		}
+	    }
+	}
+
+	if(glyph.rows > store.max_height) {
+	    store.max_height = glyph.rows;
+	}
+
+	if(glyph.width > store.max_width) {
+	    store.max_width = glyph.width;
+	}
+
+	if(glyph.bitmap_top > store.max_bitmap_top) {
+	    store.max_bitmap_top = glyph.bitmap_top;
+	}
+
+	store.glyphs.push_back(glyph);
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef GLYPH_STORE_H
+#define GLYPH_STORE_H
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <vector>
+#include <stddef.h>
+
+/*
+  The metrics of a single rendered glyph. The bitmap itself lives in the
+  pixel arena of the GlyphStore that owns the glyph.
+*/
+struct Glyph {
+    unsigned int codepoint;
+
+    // bitmap size in pixels.
+    unsigned int width;
+    unsigned int rows;
+
+    int bitmap_left;
+    int bitmap_top;
+
+    // horizontal advance in whole pixels.
+    int advance;
+
+    // offset of the first bitmap byte in GlyphStore::pixels.
+    size_t offset;
+
+    // bytes per bitmap row. rows are stored tightly, so this is the width for
+    // normal bitmaps, and three times the width for LCD bitmaps and for
+    // multi-channel distance fields.
+    unsigned int pitch;
+
+    // the index in GlyphStore::glyphs of the first glyph with the same bitmap. This is the
+    // index of the glyph itself, unless its bitmap is shared with an earlier glyph. Glyphs
+    // that share a bitmap also share its pixels in the store, and its place in the atlas.
+    unsigned int image;
+};
+
+/*
+  Every glyph is rendered exactly once into the store. Both the atlas sizing
+  and the copy stage are then fed from the store, so FreeType never has to
+  rasterize a glyph twice. Characters that the font maps to the same glyph are
+  only rendered once, and identical bitmaps are only stored once.
+*/
+struct GlyphStore {
+    std::vector<Glyph> glyphs;
+
+    // 8-bit coverage of all the glyph bitmaps, one after another.
+    // LCD bitmaps have a coverage value for each of the three subpixels.
+    std::vector<unsigned char> pixels;
+
+    // the maximum bitmap sizes over all glyphs in the store.
+    unsigned int max_width;
+    unsigned int max_height;
+    int max_bitmap_top;
+
+    // the number of requested characters that are not in the font.
+    unsigned int num_missing;
+
+    // the number of glyphs that share the bitmap of an earlier glyph.
+    unsigned int num_shared;
+
+    // font-wide metrics at the rendered size, in pixels.
+    int ascender;
+    int descender;
+    int line_height;
+
+    // scales font units to 26.6 pixels at the font size.
+    FT_Fixed x_scale;
+
+    GlyphStore() : max_width(0), max_height(0), max_bitmap_top(0), num_missing(0), num_shared(0),
+		   ascender(0), descender(0), line_height(0), x_scale(0) {}
+
+    const unsigned char* bitmap(const Glyph& glyph) const {
+	return pixels.empty() ? NULL : &pixels[glyph.offset];
+    }
+};
+
+// horizontal and vertical resolution in DPI
+#define RESOLUTION 72
+
+/*
+  A FreeType library and its faces may only be used by one thread at a time. So every
+  rendering thread gets a library and a face of its own. They are all created from the
+  same font data, and are reused for every font size.
+*/
+struct FontFaces {
+    std::vector<FT_Library> libraries;
+    std::vector<FT_Face> faces;
+};
+
+/*
+  Create a library and a face for each of num_threads threads, from a font file that has
+  been read into memory. The font data must outlive the faces.
+*/
+void open_font_faces(const std::vector<unsigned char>& font_data, unsigned int num_threads, FontFaces& faces);
+
+void close_font_faces(FontFaces& faces);
+
+/*
+  What is made of every glyph.
+*/
+enum GlyphImage {
+    // the coverage of every pixel.
+    IMAGE_COVERAGE,
+
+    // the coverage of the red, green and blue subpixels of every pixel.
+    IMAGE_LCD,
+
+    // a signed distance field.
+    IMAGE_SDF,
+
+    // a signed distance field with three channels, made from the outline.
+    IMAGE_MSDF
+};
+
+struct RasterSettings {
+    GlyphImage image;
+
+    // how many pixels a distance field reaches out of and into the glyph.
+    unsigned int sdf_spread;
+};
+
+/*
+  Render all the characters that are in the font, at the given font size, and put them
+  into the store in the given order. The work is split over one thread per face.
+  The resulting store does not depend on the number of threads.
+*/
+void rasterize_glyphs(FontFaces& faces, FT_F26Dot6 font_size, const RasterSettings& settings,
+		      const std::vector<unsigned int>& codepoints, GlyphStore& store);
+
+#endif
@@ -0,0 +1,206 @@
+#include "kerning.h"
+#include "ft_check.h"
+
+#include FT_TRUETYPE_TABLES_H
+#include FT_TRUETYPE_TAGS_H
+
+#include <algorithm>
+
+/*
+  A character in the charset, and the glyph the font maps it to. Several characters may
+  share a glyph.
+*/
+struct CharGlyph {
+    FT_UInt glyph_index;
+    unsigned int codepoint;
+};
+
+static bool glyph_index_less(const CharGlyph& a, const CharGlyph& b) {
+    return a.glyph_index < b.glyph_index || (a.glyph_index == b.glyph_index && a.codepoint < b.codepoint);
+}
+
+static unsigned int get_u16(const FT_Byte* p) {
+    return (p[0] << 8) | p[1];
+}
+
+static int get_s16(const FT_Byte* p) {
+    return (int)(short)get_u16(p);
+}
+
+/*
+  Kerning values in font units, keyed by characters.
+*/
+struct RawPair {
+    unsigned int left;
+    unsigned int right;
+    FT_Pos value;
+
+    // the value replaces the values of earlier subtables, instead of being added to them.
+    bool replace;
+};
+
+static bool raw_pair_less(const RawPair& a, const RawPair& b) {
+    return a.left < b.left || (a.left == b.left && a.right < b.right);
+}
+
+/*
+  Add the pair of glyphs, with the given value, for every pair of characters that map to them.
+*/
+static void add_glyph_pair(const std::vector<CharGlyph>& chars, FT_UInt left, FT_UInt right, FT_Pos value,
+			   bool replace, std::vector<RawPair>& raw) {
+    CharGlyph key;
+    key.codepoint = 0;
+
+    key.glyph_index = left;
+    const std::vector<CharGlyph>::const_iterator left_begin = std::lower_bound(chars.begin(), chars.end(), key, glyph_index_less);
+
+    key.glyph_index = right;
+    const std::vector<CharGlyph>::const_iterator right_begin = std::lower_bound(chars.begin(), chars.end(), key, glyph_index_less);
+
+    for(std::vector<CharGlyph>::const_iterator l = left_begin; l != chars.end() && l->glyph_index == left; ++l) {
+	for(std::vector<CharGlyph>::const_iterator r = right_begin; r != chars.end() && r->glyph_index == right; ++r) {
+	    RawPair pair;
+	    pair.left = l->codepoint;
+	    pair.right = r->codepoint;
+	    pair.value = value;
+	    pair.replace = replace;
+	    raw.push_back(pair);
+	}
+    }
+}
+
+/*
+  Read the horizontal format 0 subtables of a version 0 'kern' table. Returns false if the
+  font has no such table.
+*/
+static bool read_kern_table(FT_Face face, const std::vector<CharGlyph>& chars, std::vector<RawPair>& raw) {
+
+    if(!FT_IS_SFNT(face)) {
+	return false;
+    }
+
+    FT_ULong length = 0;
+    if(FT_Load_Sfnt_Table(face, TTAG_kern, 0, NULL, &length) != 0 || length < 4) {
+	return false;
+    }
+
+    std::vector<FT_Byte> table(length);
+    FT_C(FT_Load_Sfnt_Table(face, TTAG_kern, 0, &table[0], &length));
+
+    const FT_Byte* const end = &table[0] + length;
+
+    // the Apple version 1 table has a 32-bit version, and is not supported.
+    if(get_u16(&table[0]) != 0) {
+	return false;
+    }
+
+    const unsigned int num_subtables = get_u16(&table[2]);
+    const FT_Byte* p = &table[4];
+
+    // bits of the coverage field.
+    const unsigned int horizontal = 0x1, minimum = 0x2, cross_stream = 0x4, override_values = 0x8;
+
+    for(unsigned int s = 0; s < num_subtables && end - p >= 6; ++s) {
+
+	const FT_Byte* const subtable = p;
+	const unsigned int coverage = get_u16(subtable + 4);
+	const unsigned int format = coverage >> 8;
+
+	// the 16-bit length overflows for large subtables, so a format 0 subtable is measured by its pairs instead.
+	size_t subtable_length = get_u16(subtable + 2);
+
+	if(format == 0 && end - subtable >= 14) {
+	    const unsigned int num_pairs = get_u16(subtable + 6);
+	    subtable_length = 14 + (size_t)num_pairs * 6;
+
+	    if(subtable_length > (size_t)(end - subtable)) {
+		break;
+	    }
+
+	    if((coverage & (horizontal | minimum | cross_stream)) == horizontal) {
+
+		const FT_Byte* pair = subtable + 14;
+		for(unsigned int i = 0; i < num_pairs; ++i, pair += 6) {
+		    add_glyph_pair(chars, get_u16(pair), get_u16(pair + 2), get_s16(pair + 4),
+				   (coverage & override_values) != 0, raw);
+		}
+	    }
+	}
+
+	if(subtable_length < 6 || subtable_length > (size_t)(end - subtable)) {
+	    break;
+	}
+	p = subtable + subtable_length;
+    }
+
+    return true;
+}
+
+bool extract_kerning(FT_Face face, FT_Fixed x_scale, const std::vector<unsigned int>& codepoints,
+		     std::vector<KerningPair>& pairs) {
+
+    pairs.clear();
+
+    if(!FT_HAS_KERNING(face)) {
+	return true;
+    }
+
+    /*
+      One pass over the charset finds the glyph of every character. Sorting them by glyph
+      turns the glyph pairs of the font into character pairs with a binary search.
+    */
+
+    std::vector<CharGlyph> chars;
+    chars.reserve(codepoints.size());
+
+    for(size_t i = 0; i < codepoints.size(); ++i) {
+	CharGlyph ch;
+	ch.glyph_index = FT_Get_Char_Index(face, codepoints[i]);
+	ch.codepoint = codepoints[i];
+
+	if(ch.glyph_index != 0) {
+	    chars.push_back(ch);
+	}
+    }
+
+    std::sort(chars.begin(), chars.end(), glyph_index_less);
+
+    std::vector<RawPair> raw;
+
+    if(!read_kern_table(face, chars, raw)) {
+	// FreeType could only be asked about every pair of characters, which is far too slow for large charsets.
+	return false;
+    }
+
+    /*
+      Sum the values of pairs that appear in several subtables, and scale them to pixels.
+      The sort is stable, so the subtables stay in order. The resulting pairs are sorted.
+    */
+
+    std::stable_sort(raw.begin(), raw.end(), raw_pair_less);
+
+    for(size_t i = 0; i < raw.size(); ) {
+
+	FT_Pos value = 0;
+	size_t j = i;
+	for(; j < raw.size() && raw[j].left == raw[i].left && raw[j].right == raw[i].right; ++j) {
+	    value = raw[j].replace ? raw[j].value : value + raw[j].value;
+	}
+
+	// font units to 26.6 pixels, rounded to whole pixels.
+	const FT_Pos scaled = FT_MulFix(value, x_scale);
+	const int pixels = (int)(scaled >= 0 ? (scaled + 32) >> 6 : -((-scaled + 32) >> 6));
+
+	if(pixels != 0) {
+	    KerningPair pair;
+	    pair.left = raw[i].left;
+	    pair.right = raw[i].right;
+	    pair.value = pixels;
+	    pairs.push_back(pair);
+	}
+
+	i = j;
+    }
+
+    return true;
+}
@@ -0,0 +1,34 @@
+#ifndef KERNING_H
+#define KERNING_H
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <vector>
+
+/*
+  The horizontal adjustment between two characters, in pixels. It is added to the advance
+  of the left character when it is followed by the right one.
+*/
+struct KerningPair {
+    unsigned int left;
+    unsigned int right;
+    int value;
+};
+
+/*
+  Find the kerning pairs between the given characters. x_scale scales font units to 26.6
+  pixels at the font size.
+  The pairs are read from the 'kern' table of the font in one pass. Pairs that round to zero
+  pixels are left out, and the rest are sorted by left and then by right character. Returns
+  false if FreeType knows kerning for the font, but not from a 'kern' table that can be read,
+  as for Type 1 fonts with an AFM file. No pairs are found then, since asking FreeType about
+  every pair of characters takes far too long for large charsets.
+
+  OpenType fonts may also kern through GPOS pair adjustments, but FreeType does not expose
+  those, so they are not found.
+*/
+bool extract_kerning(FT_Face face, FT_Fixed x_scale, const std::vector<unsigned int>& codepoints,
+		     std::vector<KerningPair>& pairs);
+
+#endif
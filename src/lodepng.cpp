@@ -37,6 +37,22 @@ Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for
 #include <fstream>
 #endif /*LODEPNG_COMPILE_CPP*/
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(LODEPNG_NO_COMPILE_SIMD)
+/*SSE2 and AVX2 versions of the hottest loops of the encoder, chosen at runtime for the CPU*/
+#define LODEPNG_COMPILE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#ifdef LODEPNG_COMPILE_THREADS
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+#endif /*LODEPNG_COMPILE_THREADS*/
+
 #if defined(_MSC_VER) && (_MSC_VER >= 1310) /*Visual Studio: A few warning types are not desired here.*/
 #pragma warning( disable : 4244 ) /*implicit conversions: not warned by gcc -Wall -Wextra and requires too much casts*/
 #pragma warning( disable : 4996 ) /*VS does not like fopen, but fopen_s is not standard C so unusable here*/
@@ -136,6 +152,291 @@ About uivector, ucvector and string:
 */
 
 #ifdef LODEPNG_COMPILE_ZLIB
+#ifdef LODEPNG_COMPILE_ENCODER
+/*
+The arena that the temporary buffers of the deflate code of this thread come from, or 0 for the heap.
+It is only set between arena_enter and arena_leave. Everything that is allocated with arena_malloc or
+arena_realloc must be given back with arena_free before that scope ends.
+*/
+#ifdef LODEPNG_COMPILE_THREADS
+static thread_local LodePNGArena* lodepng_current_arena = 0;
+#else /*LODEPNG_COMPILE_THREADS*/
+static LodePNGArena* lodepng_current_arena = 0;
+#endif /*LODEPNG_COMPILE_THREADS*/
+
+/*the alignment of all allocations in the region*/
+#define ARENA_ALIGNMENT 16
+
+static size_t arena_align(size_t size)
+{
+  return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+static unsigned arena_owns(const LodePNGArena* arena, const void* ptr)
+{
+  return arena && arena->data && (const unsigned char*)ptr >= arena->data
+      && (const unsigned char*)ptr < arena->data + arena->size;
+}
+
+static void arena_update_peak(LodePNGArena* arena)
+{
+  if(arena->used + arena->heapsize > arena->peak) arena->peak = arena->used + arena->heapsize;
+}
+
+static void* arena_malloc(size_t size)
+{
+  LodePNGArena* arena = lodepng_current_arena;
+  void* ptr;
+  if(!arena) return lodepng_malloc(size);
+
+  size = arena_align(size);
+  if(arena->size - arena->used >= size)
+  {
+    ptr = arena->data + arena->used;
+    arena->last = arena->used;
+    arena->used += size;
+  }
+  else
+  {
+    /*does not fit, the region grows at the next reset*/
+    ptr = lodepng_malloc(size);
+    if(ptr) arena->heapsize += size;
+  }
+  arena_update_peak(arena);
+  return ptr;
+}
+
+static void arena_free(void* ptr, size_t size)
+{
+  LodePNGArena* arena = lodepng_current_arena;
+  if(!ptr) return;
+  if(!arena_owns(arena, ptr))
+  {
+    lodepng_free(ptr);
+    if(arena) arena->heapsize -= arena_align(size);
+  }
+  else if(arena->last < arena->used && (unsigned char*)ptr == arena->data + arena->last)
+  {
+    /*the last allocation can be given back right away, the others when the scope ends*/
+    arena->used = arena->last;
+  }
+}
+
+static void* arena_realloc(void* ptr, size_t oldsize, size_t newsize)
+{
+  LodePNGArena* arena = lodepng_current_arena;
+  void* newptr;
+  if(!arena) return lodepng_realloc(ptr, newsize);
+
+  /*the last allocation grows in place, as a vector that is filled on its own does*/
+  if(arena_owns(arena, ptr) && arena->last < arena->used && (unsigned char*)ptr == arena->data + arena->last
+     && arena->size - arena->last >= arena_align(newsize))
+  {
+    arena->used = arena->last + arena_align(newsize);
+    arena_update_peak(arena);
+    return ptr;
+  }
+
+  newptr = arena_malloc(newsize);
+  if(newptr && ptr)
+  {
+    memcpy(newptr, ptr, oldsize < newsize ? oldsize : newsize);
+    arena_free(ptr, oldsize);
+  }
+  return newptr;
+}
+
+/*the state of the thread that arena_leave restores*/
+typedef struct ArenaScope
+{
+  LodePNGArena* previous;
+  size_t used;
+} ArenaScope;
+
+/*let the deflate code of this thread allocate from arena, which may be 0, until arena_leave*/
+static void arena_enter(ArenaScope* scope, LodePNGArena* arena)
+{
+  scope->previous = lodepng_current_arena;
+  scope->used = arena ? arena->used : 0;
+  lodepng_current_arena = arena;
+}
+
+/*give back everything that was allocated from the arena since arena_enter*/
+static void arena_leave(const ArenaScope* scope)
+{
+  LodePNGArena* arena = lodepng_current_arena;
+  if(arena)
+  {
+    arena->used = scope->used;
+    arena->last = arena->used;
+  }
+  lodepng_current_arena = scope->previous;
+}
+
+/*the arena of thread t of the threads of num_threads, which are created when they do not exist yet*/
+static LodePNGArena* arena_of_thread(LodePNGArena* arena, size_t t)
+{
+  for(; arena && t != 0; --t)
+  {
+    if(!arena->next)
+    {
+      arena->next = (LodePNGArena*)lodepng_malloc(sizeof(LodePNGArena));
+      if(arena->next) lodepng_arena_init(arena->next);
+    }
+    arena = arena->next;
+  }
+  return arena;
+}
+
+void lodepng_arena_init(LodePNGArena* arena)
+{
+  arena->data = 0;
+  arena->size = arena->used = arena->last = arena->heapsize = arena->peak = 0;
+  arena->next = 0;
+}
+
+void lodepng_arena_reset(LodePNGArena* arena)
+{
+  for(; arena; arena = arena->next)
+  {
+    if(arena->peak > arena->size)
+    {
+      lodepng_free(arena->data);
+      arena->data = (unsigned char*)lodepng_malloc(arena->peak);
+      arena->size = arena->data ? arena->peak : 0;
+    }
+    arena->used = arena->last = arena->heapsize = arena->peak = 0;
+  }
+}
+
+void lodepng_arena_cleanup(LodePNGArena* arena)
+{
+  LodePNGArena* next = arena->next;
+  lodepng_free(arena->data);
+  lodepng_arena_init(arena);
+  while(next)
+  {
+    LodePNGArena* after = next->next;
+    lodepng_free(next->data);
+    lodepng_free(next);
+    next = after;
+  }
+}
+#else /*LODEPNG_COMPILE_ENCODER*/
+/*without the encoder, there is no arena*/
+static void arena_free(void* ptr, size_t size)
+{
+  (void)size;
+  lodepng_free(ptr);
+}
+
+static void* arena_realloc(void* ptr, size_t oldsize, size_t newsize)
+{
+  (void)oldsize;
+  return lodepng_realloc(ptr, newsize);
+}
+#endif /*LODEPNG_COMPILE_ENCODER*/
+
+#ifdef LODEPNG_COMPILE_ENCODER
+/*threads that are started once and then run one task after another, see threadPoolCreate*/
+typedef struct ThreadPool ThreadPool;
+
+#ifdef LODEPNG_COMPILE_THREADS
+/*runs on every thread t of a pool, with t 0 on the thread that calls threadPoolRun*/
+typedef void (*ThreadPoolTask)(void* context, size_t t);
+
+struct ThreadPool
+{
+  std::vector<std::thread> threads;
+  std::mutex mutex;
+  std::condition_variable started, finished;
+  ThreadPoolTask task;
+  void* context;
+  size_t numtasks; /*the number of tasks given so far, the threads run the next one when it changes*/
+  size_t running; /*the threads that did not finish the current task yet*/
+  bool stop;
+};
+
+static void threadPoolLoop(ThreadPool* pool, size_t t)
+{
+  size_t done = 0;
+  for(;;)
+  {
+    ThreadPoolTask task;
+    void* context;
+    {
+      std::unique_lock<std::mutex> lock(pool->mutex);
+      while(!pool->stop && pool->numtasks == done) pool->started.wait(lock);
+      if(pool->stop) return;
+      done = pool->numtasks;
+      task = pool->task;
+      context = pool->context;
+    }
+    task(context, t);
+    {
+      std::lock_guard<std::mutex> lock(pool->mutex);
+      if(--pool->running == 0) pool->finished.notify_one();
+    }
+  }
+}
+
+/*
+A pool of num_threads threads, counting the thread that calls threadPoolRun, so an encoder that filters
+and deflates again for every push does not start and join its threads every time. Returns 0 if out of memory.
+*/
+static ThreadPool* threadPoolCreate(size_t num_threads)
+{
+  size_t t;
+  ThreadPool* pool = new (std::nothrow) ThreadPool;
+  if(!pool) return 0;
+  pool->task = 0;
+  pool->context = 0;
+  pool->numtasks = 0;
+  pool->running = 0;
+  pool->stop = false;
+  for(t = 1; t < num_threads; ++t) pool->threads.push_back(std::thread(threadPoolLoop, pool, t));
+  return pool;
+}
+
+static void threadPoolDestroy(ThreadPool* pool)
+{
+  size_t t;
+  if(!pool) return;
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->stop = true;
+  }
+  pool->started.notify_all();
+  for(t = 0; t != pool->threads.size(); ++t) pool->threads[t].join();
+  delete pool;
+}
+
+/*the number of threads of the pool, counting the thread that calls threadPoolRun*/
+static size_t threadPoolSize(const ThreadPool* pool)
+{
+  return pool->threads.size() + 1;
+}
+
+/*run task(context, t) on every thread t of the pool and wait until all of them are done*/
+static void threadPoolRun(ThreadPool* pool, ThreadPoolTask task, void* context)
+{
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->task = task;
+    pool->context = context;
+    pool->running = pool->threads.size();
+    ++pool->numtasks;
+  }
+  pool->started.notify_all();
+  task(context, 0);
+  {
+    std::unique_lock<std::mutex> lock(pool->mutex);
+    while(pool->running != 0) pool->finished.wait(lock);
+  }
+}
+#endif /*LODEPNG_COMPILE_THREADS*/
+#endif /*LODEPNG_COMPILE_ENCODER*/
+
 /*dynamic vector of unsigned ints*/
 typedef struct uivector
 {
@@ -144,10 +445,11 @@ typedef struct uivector
   size_t allocsize; /*allocated size in bytes*/
 } uivector;
 
+/*the data of a uivector comes from the arena of the thread, if it has one*/
 static void uivector_cleanup(void* p)
 {
+  arena_free(((uivector*)p)->data, ((uivector*)p)->allocsize);
   ((uivector*)p)->size = ((uivector*)p)->allocsize = 0;
-  lodepng_free(((uivector*)p)->data);
   ((uivector*)p)->data = NULL;
 }
 
@@ -157,7 +459,7 @@ static unsigned uivector_reserve(uivector* p, size_t allocsize)
   if(allocsize > p->allocsize)
   {
     size_t newsize = (allocsize > p->allocsize * 2) ? allocsize : (allocsize * 3 / 2);
-    void* data = lodepng_realloc(p->data, newsize);
+    void* data = arena_realloc(p->data, p->allocsize, newsize);
     if(data)
     {
       p->allocsize = newsize;
@@ -1291,6 +1593,9 @@ static unsigned inflate(unsigned char** out, size_t* outsize,
 /* ////////////////////////////////////////////////////////////////////////// */
 
 static const size_t MAX_SUPPORTED_DEFLATE_LENGTH = 258;
+/*most steps taken on the chain of equal runs, which has an entry for every earlier run that is long
+enough, of any byte. Walking all of them costs much time for a slightly smaller palette image.*/
+static const unsigned MAX_RUN_CHAIN_LENGTH = 1024;
 
 /*bitlen is the size in bits of the code*/
 static void addHuffmanSymbol(size_t* bp, ucvector* compressed, unsigned code, unsigned bitlen)
@@ -1338,8 +1643,9 @@ static void addLengthDistance(uivector* values, size_t length, size_t distance)
   uivector_push_back(values, extra_distance);
 }
 
-/*3 bytes of data get encoded into two bytes. The hash cannot use more than 3
-bytes as input because 3 is the minimum match length for deflate*/
+/*4 bytes of data get hashed into two bytes. Deflate allows matches of only 3
+bytes, but those are rarely worth their distance code, and hashing one more byte
+keeps the chains short: candidates that share only 3 bytes are never visited*/
 static const unsigned HASH_NUM_VALUES = 65536;
 static const unsigned HASH_BIT_MASK = 65535; /*HASH_NUM_VALUES - 1, but C90 does not like that as initializer*/
 
@@ -1350,25 +1656,28 @@ typedef struct Hash
   unsigned short* chain;
   int* val; /*circular pos to hash value*/
 
-  /*TODO: do this not only for zeros but for any repeated byte. However for PNG
-  it's always going to be the zeros that dominate, so not important for PNG*/
-  int* headz; /*similar to head, but for chainz*/
-  unsigned short* chainz; /*those with same amount of zeros*/
-  unsigned short* zeros; /*length of zeros streak, used as a second hash chain*/
+  /*Runs of one repeated byte: zeros dominate filtered PNG rows, and unfiltered palette images have
+  long runs of the index of the background and of the glyph interiors.*/
+  int* headrun; /*similar to head, but for chainrun*/
+  unsigned short* chainrun; /*those with the same length of run*/
+  unsigned short* run; /*length of the run of equal bytes, 0 if shorter than 3, used as a second hash chain*/
+
+  unsigned windowsize;
 } Hash;
 
 static unsigned hash_init(Hash* hash, unsigned windowsize)
 {
   unsigned i;
-  hash->head = (int*)lodepng_malloc(sizeof(int) * HASH_NUM_VALUES);
-  hash->val = (int*)lodepng_malloc(sizeof(int) * windowsize);
-  hash->chain = (unsigned short*)lodepng_malloc(sizeof(unsigned short) * windowsize);
+  hash->windowsize = windowsize;
+  hash->head = (int*)arena_malloc(sizeof(int) * HASH_NUM_VALUES);
+  hash->val = (int*)arena_malloc(sizeof(int) * windowsize);
+  hash->chain = (unsigned short*)arena_malloc(sizeof(unsigned short) * windowsize);
 
-  hash->zeros = (unsigned short*)lodepng_malloc(sizeof(unsigned short) * windowsize);
-  hash->headz = (int*)lodepng_malloc(sizeof(int) * (MAX_SUPPORTED_DEFLATE_LENGTH + 1));
-  hash->chainz = (unsigned short*)lodepng_malloc(sizeof(unsigned short) * windowsize);
+  hash->run = (unsigned short*)arena_malloc(sizeof(unsigned short) * windowsize);
+  hash->headrun = (int*)arena_malloc(sizeof(int) * (MAX_SUPPORTED_DEFLATE_LENGTH + 1));
+  hash->chainrun = (unsigned short*)arena_malloc(sizeof(unsigned short) * windowsize);
 
-  if(!hash->head || !hash->chain || !hash->val  || !hash->headz|| !hash->chainz || !hash->zeros)
+  if(!hash->head || !hash->chain || !hash->val  || !hash->headrun|| !hash->chainrun || !hash->run)
   {
     return 83; /*alloc fail*/
   }
@@ -1378,21 +1687,22 @@ static unsigned hash_init(Hash* hash, unsigned windowsize)
   for(i = 0; i != windowsize; ++i) hash->val[i] = -1;
   for(i = 0; i != windowsize; ++i) hash->chain[i] = i; /*same value as index indicates uninitialized*/
 
-  for(i = 0; i <= MAX_SUPPORTED_DEFLATE_LENGTH; ++i) hash->headz[i] = -1;
-  for(i = 0; i != windowsize; ++i) hash->chainz[i] = i; /*same value as index indicates uninitialized*/
+  for(i = 0; i <= MAX_SUPPORTED_DEFLATE_LENGTH; ++i) hash->headrun[i] = -1;
+  for(i = 0; i != windowsize; ++i) hash->chainrun[i] = i; /*same value as index indicates uninitialized*/
 
   return 0;
 }
 
 static void hash_cleanup(Hash* hash)
 {
-  lodepng_free(hash->head);
-  lodepng_free(hash->val);
-  lodepng_free(hash->chain);
+  /*the other way around, so the arena can give every one back right away*/
+  arena_free(hash->chainrun, sizeof(unsigned short) * hash->windowsize);
+  arena_free(hash->headrun, sizeof(int) * (MAX_SUPPORTED_DEFLATE_LENGTH + 1));
+  arena_free(hash->run, sizeof(unsigned short) * hash->windowsize);
 
-  lodepng_free(hash->zeros);
-  lodepng_free(hash->headz);
-  lodepng_free(hash->chainz);
+  arena_free(hash->chain, sizeof(unsigned short) * hash->windowsize);
+  arena_free(hash->val, sizeof(int) * hash->windowsize);
+  arena_free(hash->head, sizeof(int) * HASH_NUM_VALUES);
 }
 
 
@@ -1400,15 +1710,18 @@ static void hash_cleanup(Hash* hash)
 static unsigned getHash(const unsigned char* data, size_t size, size_t pos)
 {
   unsigned result = 0;
-  if(pos + 2 < size)
-  {
-    /*A simple shift and xor hash is used. Since the data of PNGs is dominated
-    by zeroes due to the filters, a better hash does not have a significant
-    effect on speed in traversing the chain, and causes more time spend on
-    calculating the hash.*/
-    result ^= (unsigned)(data[pos + 0] << 0u);
-    result ^= (unsigned)(data[pos + 1] << 4u);
-    result ^= (unsigned)(data[pos + 2] << 8u);
+  if(pos + 3 < size)
+  {
+    /*Multiplicative (Fibonacci) hash of 4 bytes: the multiplication spreads every
+    input bit over the high bits of the product, which are the ones kept. Unlike
+    a shift and xor hash, different 4-byte strings rarely end up in the same
+    chain, so fewer candidates need to be compared. Strings starting with 3
+    zeros all hash to 0, as they did before: filtered PNG rows are dominated by
+    them, and the zeros chain is what finds their matches.*/
+    unsigned word = (unsigned)data[pos + 0] | ((unsigned)data[pos + 1] << 8u)
+                  | ((unsigned)data[pos + 2] << 16u) | ((unsigned)data[pos + 3] << 24u);
+    if((word & 0xffffffu) == 0) return 0;
+    result = ((word * 2654435761u) & 0xffffffffu) >> 16u;
   } else {
     size_t amount, i;
     if(pos >= size) return 0;
@@ -1418,27 +1731,65 @@ static unsigned getHash(const unsigned char* data, size_t size, size_t pos)
   return result & HASH_BIT_MASK;
 }
 
-static unsigned countZeros(const unsigned char* data, size_t size, size_t pos)
+/*Returns how many bytes starting at fore and back are equal, not looking further
+than fore_end. Where unaligned loads and a count-trailing-zeros instruction are
+available, 8 bytes are compared at once: the lowest set bit of the xor of two
+little-endian words is the first differing byte.*/
+static size_t matchLength(const unsigned char* fore, const unsigned char* back, const unsigned char* fore_end)
+{
+  const unsigned char* start = fore;
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+  while(fore_end - fore >= 8)
+  {
+    unsigned long long a, b, diff;
+    memcpy(&a, fore, 8);
+    memcpy(&b, back, 8);
+    diff = a ^ b;
+    if(diff) return (size_t)(fore - start) + (size_t)(__builtin_ctzll(diff) >> 3);
+    fore += 8;
+    back += 8;
+  }
+#endif /*little endian GNUC*/
+  while(fore != fore_end && *fore == *back)
+  {
+    ++fore;
+    ++back;
+  }
+  return (size_t)(fore - start);
+}
+
+/*
+The length of the run of bytes equal to data[pos], at most MAX_SUPPORTED_DEFLATE_LENGTH, or 0 if it is
+shorter than 3. numrun is the run at pos - 1: inside a run, it only needs to be shortened by one, unless
+it was cut off at the maximum.
+*/
+static unsigned updateRun(const unsigned char* data, size_t size, size_t pos, unsigned numrun)
 {
   const unsigned char* start = data + pos;
   const unsigned char* end = start + MAX_SUPPORTED_DEFLATE_LENGTH;
+  if(numrun > 3)
+  {
+    if(pos + numrun > size || data[pos + numrun - 1] != data[pos]) --numrun;
+    return numrun;
+  }
+  if(pos + 3 > size || data[pos + 1] != data[pos] || data[pos + 2] != data[pos]) return 0;
   if(end > data + size) end = data + size;
-  data = start;
-  while(data != end && *data == 0) ++data;
+  data = start + 3;
+  while(data != end && *data == *start) ++data;
   /*subtracting two addresses returned as 32-bit number (max value is MAX_SUPPORTED_DEFLATE_LENGTH)*/
   return (unsigned)(data - start);
 }
 
 /*wpos = pos & (windowsize - 1)*/
-static void updateHashChain(Hash* hash, size_t wpos, unsigned hashval, unsigned short numzeros)
+static void updateHashChain(Hash* hash, size_t wpos, unsigned hashval, unsigned short numrun)
 {
   hash->val[wpos] = (int)hashval;
   if(hash->head[hashval] != -1) hash->chain[wpos] = hash->head[hashval];
   hash->head[hashval] = wpos;
 
-  hash->zeros[wpos] = numzeros;
-  if(hash->headz[numzeros] != -1) hash->chainz[wpos] = hash->headz[numzeros];
-  hash->headz[numzeros] = wpos;
+  hash->run[wpos] = numrun;
+  if(hash->headrun[numrun] != -1) hash->chainrun[wpos] = hash->headrun[numrun];
+  hash->headrun[numrun] = wpos;
 }
 
 /*
@@ -1460,8 +1811,7 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
   unsigned maxchainlength = windowsize >= 8192 ? windowsize : windowsize / 8;
   unsigned maxlazymatch = windowsize >= 8192 ? MAX_SUPPORTED_DEFLATE_LENGTH : 64;
 
-  unsigned usezeros = 1; /*not sure if setting it to false for windowsize < 8192 is better or worse*/
-  unsigned numzeros = 0;
+  unsigned numrun = 0;
 
   unsigned offset; /*the offset represents the distance in LZ77 terminology*/
   unsigned length;
@@ -1482,20 +1832,12 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
   {
     size_t wpos = pos & (windowsize - 1); /*position for in 'circular' hash buffers*/
     unsigned chainlength = 0;
+    unsigned onrun = 0; /*whether the search moved on to the chain of equal runs*/
 
     hashval = getHash(in, insize, pos);
 
-    if(usezeros && hashval == 0)
-    {
-      if(numzeros == 0) numzeros = countZeros(in, insize, pos);
-      else if(pos + numzeros > insize || in[pos + numzeros - 1] != 0) --numzeros;
-    }
-    else
-    {
-      numzeros = 0;
-    }
-
-    updateHashChain(hash, wpos, hashval, numzeros);
+    numrun = updateRun(in, insize, pos, numrun);
+    updateHashChain(hash, wpos, hashval, numrun);
 
     /*the length and offset found for the current position*/
     length = 0;
@@ -1520,21 +1862,27 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
         foreptr = &in[pos];
         backptr = &in[pos - current_offset];
 
-        /*common case in PNGs is lots of zeros. Quickly skip over them as a speedup*/
-        if(numzeros >= 3)
+        /*common case in PNGs is long runs of one byte. Quickly skip over them as a speedup, if the
+        candidate is a run of the same byte (the hash alone does not make sure of that)*/
+        if(numrun >= 3 && *backptr == *foreptr)
         {
-          unsigned skip = hash->zeros[hashpos];
-          if(skip > numzeros) skip = numzeros;
+          unsigned skip = hash->run[hashpos];
+          if(skip > numrun) skip = numrun;
           backptr += skip;
           foreptr += skip;
         }
 
-        while(foreptr != lastptr && *backptr == *foreptr) /*maximum supported length by deflate is max length*/
+        /*a candidate can only beat the current best if it also matches at the byte
+        where the best one stopped, checking that first avoids most full compares*/
+        if(length != 0 && (&in[pos + length] >= lastptr || in[pos + length] != in[pos + length - current_offset]))
+        {
+          current_length = 0;
+        }
+        else
         {
-          ++backptr;
-          ++foreptr;
+          /*maximum supported length by deflate is max length*/
+          current_length = (unsigned)(foreptr - &in[pos]) + (unsigned)matchLength(foreptr, backptr, lastptr);
         }
-        current_length = (unsigned)(foreptr - &in[pos]);
 
         if(current_length > length)
         {
@@ -1546,12 +1894,28 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
         }
       }
 
-      if(hashpos == hash->chain[hashpos]) break;
-
-      if(numzeros >= 3 && length > numzeros)
+      if(numrun >= 3 && length >= numrun)
+      {
+        /*Inside a run, every earlier position with a longer run of the same byte
+        matches exactly numrun bytes, and one of those (normally the previous byte)
+        has already been found. Only positions with runs exactly as long can give
+        a longer match, so continue on their chain instead of the (huge) chain of
+        the run's hash. That chain also has runs of other bytes, which the first
+        compare rejects, so at most MAX_RUN_CHAIN_LENGTH steps of it are taken.*/
+        if(!onrun)
+        {
+          onrun = 1;
+          hashpos = wpos;
+          prev_offset = 0;
+          if(chainlength + MAX_RUN_CHAIN_LENGTH < maxchainlength) chainlength = maxchainlength - MAX_RUN_CHAIN_LENGTH;
+        }
+        if(hashpos == hash->chainrun[hashpos]) break;
+        hashpos = hash->chainrun[hashpos];
+        if(hash->run[hashpos] != numrun) break;
+      }
+      else if(hashpos == hash->chain[hashpos])
       {
-        hashpos = hash->chainz[hashpos];
-        if(hash->zeros[hashpos] != numzeros) break;
+        break;
       }
       else
       {
@@ -1584,7 +1948,7 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
           length = lazylength;
           offset = lazyoffset;
           hash->head[hashval] = -1; /*the same hashchain update will be done, this ensures no wrong alteration*/
-          hash->headz[numzeros] = -1; /*idem*/
+          hash->headrun[numrun] = -1; /*idem*/
           --pos;
         }
       }
@@ -1610,16 +1974,8 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
         ++pos;
         wpos = pos & (windowsize - 1);
         hashval = getHash(in, insize, pos);
-        if(usezeros && hashval == 0)
-        {
-          if(numzeros == 0) numzeros = countZeros(in, insize, pos);
-          else if(pos + numzeros > insize || in[pos + numzeros - 1] != 0) --numzeros;
-        }
-        else
-        {
-          numzeros = 0;
-        }
-        updateHashChain(hash, wpos, hashval, numzeros);
+        numrun = updateRun(in, insize, pos, numrun);
+        updateHashChain(hash, wpos, hashval, numrun);
       }
     }
   } /*end of the loop through each character of input*/
@@ -2000,6 +2356,7 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   size_t i, blocksize, numdeflateblocks;
   size_t bp = 0; /*the bit pointer*/
   Hash hash;
+  ArenaScope scope;
 
   if(settings->btype > 2) return 61;
   else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
@@ -2015,8 +2372,8 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   numdeflateblocks = (insize + blocksize - 1) / blocksize;
   if(numdeflateblocks == 0) numdeflateblocks = 1;
 
+  arena_enter(&scope, settings->arena);
   error = hash_init(&hash, settings->windowsize);
-  if(error) return error;
 
   for(i = 0; i != numdeflateblocks && !error; ++i)
   {
@@ -2030,6 +2387,7 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   }
 
   hash_cleanup(&hash);
+  arena_leave(&scope);
 
   return error;
 }
@@ -2067,7 +2425,7 @@ static unsigned deflate(unsigned char** out, size_t* outsize,
 /* / Adler32                                                                  */
 /* ////////////////////////////////////////////////////////////////////////// */
 
-static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len)
+static unsigned update_adler32_scalar(unsigned adler, const unsigned char* data, unsigned len)
 {
    unsigned s1 = adler & 0xffff;
    unsigned s2 = (adler >> 16) & 0xffff;
@@ -2090,6 +2448,113 @@ static unsigned update_adler32(unsigned adler, const unsigned char* data, unsign
   return (s2 << 16) | s1;
 }
 
+#ifdef LODEPNG_COMPILE_X86_SIMD
+/*
+As in zlib-ng and Chromium: for a block of 32 bytes, s1 grows by the sum of the bytes (psadbw), and s2
+by 32 times s1 before the block plus the bytes weighted 32 down to 1 (pmaddubsw and pmaddwd). The
+32 * s1 terms are summed up in ps and added at the end. After 173 blocks (5536 bytes, within the 5552
+bytes after which s2 could overflow) the sums are reduced modulo 65521.
+*/
+__attribute__((target("ssse3")))
+static unsigned update_adler32_ssse3(unsigned adler, const unsigned char* data, unsigned len)
+{
+  const __m128i tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+  const __m128i tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m128i ones = _mm_set1_epi16(1);
+  const __m128i zero = _mm_setzero_si128();
+  unsigned s1 = adler & 0xffff;
+  unsigned s2 = (adler >> 16) & 0xffff;
+  unsigned blocks = len / 32;
+  len -= blocks * 32;
+
+  while(blocks > 0)
+  {
+    unsigned n = blocks > 173 ? 173 : blocks;
+    __m128i ps = _mm_cvtsi32_si128((int)(s1 * n));
+    __m128i v1 = zero;
+    __m128i v2 = _mm_cvtsi32_si128((int)s2);
+    blocks -= n;
+    while(n > 0)
+    {
+      const __m128i bytes1 = _mm_loadu_si128((const __m128i*)&data[0]);
+      const __m128i bytes2 = _mm_loadu_si128((const __m128i*)&data[16]);
+      ps = _mm_add_epi32(ps, v1);
+      v1 = _mm_add_epi32(v1, _mm_add_epi32(_mm_sad_epu8(bytes1, zero), _mm_sad_epu8(bytes2, zero)));
+      v2 = _mm_add_epi32(v2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+      v2 = _mm_add_epi32(v2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+      data += 32;
+      --n;
+    }
+    v2 = _mm_add_epi32(v2, _mm_slli_epi32(ps, 5));
+
+    v1 = _mm_add_epi32(v1, _mm_shuffle_epi32(v1, _MM_SHUFFLE(1, 0, 3, 2)));
+    v2 = _mm_add_epi32(v2, _mm_shuffle_epi32(v2, _MM_SHUFFLE(2, 3, 0, 1)));
+    v2 = _mm_add_epi32(v2, _mm_shuffle_epi32(v2, _MM_SHUFFLE(1, 0, 3, 2)));
+    s1 = (s1 + (unsigned)_mm_cvtsi128_si32(v1)) % 65521;
+    s2 = (unsigned)_mm_cvtsi128_si32(v2) % 65521;
+  }
+
+  return update_adler32_scalar((s2 << 16) | s1, data, len);
+}
+
+/*the same as the SSSE3 version, with one load of 32 bytes per block*/
+__attribute__((target("avx2")))
+static unsigned update_adler32_avx2(unsigned adler, const unsigned char* data, unsigned len)
+{
+  const __m256i tap = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+                                       16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+  const __m256i ones = _mm256_set1_epi16(1);
+  const __m256i zero = _mm256_setzero_si256();
+  unsigned s1 = adler & 0xffff;
+  unsigned s2 = (adler >> 16) & 0xffff;
+  unsigned blocks = len / 32;
+  len -= blocks * 32;
+
+  while(blocks > 0)
+  {
+    unsigned n = blocks > 173 ? 173 : blocks;
+    __m256i ps = _mm256_setr_epi32((int)(s1 * n), 0, 0, 0, 0, 0, 0, 0);
+    __m256i v1 = zero;
+    __m256i v2 = _mm256_setr_epi32((int)s2, 0, 0, 0, 0, 0, 0, 0);
+    __m128i h1, h2;
+    blocks -= n;
+    while(n > 0)
+    {
+      const __m256i bytes = _mm256_loadu_si256((const __m256i*)data);
+      ps = _mm256_add_epi32(ps, v1);
+      v1 = _mm256_add_epi32(v1, _mm256_sad_epu8(bytes, zero));
+      v2 = _mm256_add_epi32(v2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, tap), ones));
+      data += 32;
+      --n;
+    }
+    v2 = _mm256_add_epi32(v2, _mm256_slli_epi32(ps, 5));
+
+    h1 = _mm_add_epi32(_mm256_castsi256_si128(v1), _mm256_extracti128_si256(v1, 1));
+    h2 = _mm_add_epi32(_mm256_castsi256_si128(v2), _mm256_extracti128_si256(v2, 1));
+    h1 = _mm_add_epi32(h1, _mm_shuffle_epi32(h1, _MM_SHUFFLE(1, 0, 3, 2)));
+    h2 = _mm_add_epi32(h2, _mm_shuffle_epi32(h2, _MM_SHUFFLE(2, 3, 0, 1)));
+    h2 = _mm_add_epi32(h2, _mm_shuffle_epi32(h2, _MM_SHUFFLE(1, 0, 3, 2)));
+    s1 = (s1 + (unsigned)_mm_cvtsi128_si32(h1)) % 65521;
+    s2 = (unsigned)_mm_cvtsi128_si32(h2) % 65521;
+  }
+
+  return update_adler32_scalar((s2 << 16) | s1, data, len);
+}
+#endif /*LODEPNG_COMPILE_X86_SIMD*/
+
+static unsigned update_adler32(unsigned adler, const unsigned char* data, unsigned len)
+{
+#ifdef LODEPNG_COMPILE_X86_SIMD
+  if(len >= 64)
+  {
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) return update_adler32_avx2(adler, data, len);
+    if(__builtin_cpu_supports("ssse3")) return update_adler32_ssse3(adler, data, len);
+  }
+#endif /*LODEPNG_COMPILE_X86_SIMD*/
+  return update_adler32_scalar(adler, data, len);
+}
+
 /*Return the adler32 of the bytes data[0..len-1]*/
 static unsigned adler32(const unsigned char* data, unsigned len)
 {
@@ -2164,6 +2629,186 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, const unsi
 
 #ifdef LODEPNG_COMPILE_ENCODER
 
+/*the adler32 of the concatenation of two pieces of data, given the adler32 of both and the length of the second*/
+static unsigned adler32_combine(unsigned adler1, unsigned adler2, size_t len2)
+{
+  unsigned rem = (unsigned)(len2 % 65521);
+  unsigned s1 = adler1 & 0xffff;
+  unsigned s2 = (rem * s1) % 65521;
+  s1 += (adler2 & 0xffff) + 65521 - 1;
+  s2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + 65521 - rem;
+  if(s1 >= 65521) s1 -= 65521;
+  if(s1 >= 65521) s1 -= 65521;
+  if(s2 >= 65521 * 2) s2 -= 65521 * 2;
+  if(s2 >= 65521) s2 -= 65521;
+  return (s2 << 16) | s1;
+}
+
+/*the size of the pieces in which the data is deflated when settings->num_threads is not 0, the
+same as the largest deflate block of lodepng_deflatev*/
+static const size_t DEFLATE_CHUNK_SIZE = 262144;
+
+typedef struct DeflateChunk
+{
+  ucvector out; /*deflate blocks, ending on a byte boundary*/
+  unsigned adler; /*adler32 of the uncompressed bytes of this chunk alone*/
+  unsigned error;
+} DeflateChunk;
+
+/*
+Deflate in[start..end-1] as one block, which ends the stream if final is set. Otherwise it is followed
+by an empty stored block, as a zlib sync flush does, so the next chunk starts on a byte boundary. The
+window before start is inserted in the hash table first, so matches can still refer back into it.
+*/
+static void deflateChunk(DeflateChunk* chunk, const unsigned char* in, size_t start, size_t end,
+                         unsigned final, const LodePNGCompressSettings* settings, LodePNGArena* arena)
+{
+  size_t bp = 0;
+  Hash hash;
+  ArenaScope scope;
+
+  chunk->adler = update_adler32(1L, &in[start], (unsigned)(end - start));
+
+  arena_enter(&scope, arena);
+  chunk->error = hash_init(&hash, settings->windowsize);
+  if(!chunk->error)
+  {
+    size_t pos = start > settings->windowsize ? start - settings->windowsize : 0;
+    unsigned numrun = 0;
+    for(; pos < start; ++pos)
+    {
+      /*the same insertions the chunk before made while it passed these bytes: the window is shorter
+      than a chunk, so it lies in that chunk alone, whose hashes and runs were also cut off at start*/
+      unsigned hashval = getHash(in, start, pos);
+      numrun = updateRun(in, start, pos, numrun);
+      updateHashChain(&hash, pos & (settings->windowsize - 1), hashval, numrun);
+    }
+
+    if(settings->btype == 1) chunk->error = deflateFixed(&chunk->out, &bp, &hash, in, start, end, settings, final);
+    else chunk->error = deflateDynamic(&chunk->out, &bp, &hash, in, start, end, settings, final);
+  }
+  hash_cleanup(&hash);
+  arena_leave(&scope);
+
+  if(!chunk->error && !final)
+  {
+    /*empty stored block: BFINAL 0 and BTYPE 00, then the zero bits padding the last byte, LEN 0 and NLEN 65535*/
+    addBitsToStream(&bp, &chunk->out, 0, 3);
+    ucvector_push_back(&chunk->out, 0);
+    ucvector_push_back(&chunk->out, 0);
+    ucvector_push_back(&chunk->out, 255);
+    if(!ucvector_push_back(&chunk->out, 255)) chunk->error = 83; /*alloc fail*/
+  }
+}
+
+/*the chunks of a deflateChunkRange call, which the threads that deflate them share*/
+typedef struct DeflateChunkTask
+{
+  DeflateChunk* chunks;
+  size_t numchunks;
+#ifdef LODEPNG_COMPILE_THREADS
+  std::atomic<size_t> next_chunk;
+#else /*LODEPNG_COMPILE_THREADS*/
+  size_t next_chunk;
+#endif /*LODEPNG_COMPILE_THREADS*/
+  const unsigned char* in;
+  size_t begin, end;
+  unsigned final;
+  const LodePNGCompressSettings* settings;
+} DeflateChunkTask;
+
+/*every thread claims the next chunk that was not started yet, and uses arena t of settings->arena*/
+static void deflateChunkTask(void* context, size_t t)
+{
+  DeflateChunkTask* task = (DeflateChunkTask*)context;
+  LodePNGArena* arena = arena_of_thread(task->settings->arena, t);
+  for(;;)
+  {
+    size_t i = task->next_chunk++, start;
+    if(i >= task->numchunks) break;
+    start = task->begin + i * DEFLATE_CHUNK_SIZE;
+    deflateChunk(&task->chunks[i], task->in, start,
+                 task->end - start < DEFLATE_CHUNK_SIZE ? task->end : start + DEFLATE_CHUNK_SIZE,
+                 task->final && i == task->numchunks - 1, task->settings, arena);
+  }
+}
+
+/*
+Deflate in[begin..end-1] in chunks of DEFLATE_CHUNK_SIZE on the threads of pool, or if pool is 0 on
+settings->num_threads threads that are started for this call. Append the joined stream to out and combine
+the adler32 of the data into *adler. The bytes before begin are the window. Only the last chunk ends the
+stream, and only if final is set. Where the chunks are cut does not depend on the number of threads, so
+neither does the output.
+*/
+static unsigned deflateChunkRange(ucvector* out, unsigned* adler, const unsigned char* in, size_t begin,
+                                  size_t end, unsigned final, const LodePNGCompressSettings* settings,
+                                  ThreadPool* pool)
+{
+  unsigned error = 0;
+  size_t i, j;
+  size_t numchunks = (end - begin + DEFLATE_CHUNK_SIZE - 1) / DEFLATE_CHUNK_SIZE;
+  DeflateChunk* chunks;
+  DeflateChunkTask task;
+
+  if(numchunks == 0 && final) numchunks = 1; /*an empty final block still ends the stream*/
+  if(numchunks == 0) return 0;
+  if(settings->btype > 2) return 61;
+  if(settings->windowsize == 0 || settings->windowsize > 32768) return 60;
+  if((settings->windowsize & (settings->windowsize - 1)) != 0) return 90;
+
+  chunks = (DeflateChunk*)lodepng_malloc(sizeof(DeflateChunk) * numchunks);
+  if(!chunks) return 83; /*alloc fail*/
+  for(i = 0; i != numchunks; ++i) ucvector_init(&chunks[i].out);
+
+  task.chunks = chunks;
+  task.numchunks = numchunks;
+  task.next_chunk = 0;
+  task.in = in;
+  task.begin = begin;
+  task.end = end;
+  task.final = final;
+  task.settings = settings;
+
+#ifdef LODEPNG_COMPILE_THREADS
+  {
+    ThreadPool* own = 0;
+    if(!pool && settings->num_threads > 1 && numchunks > 1)
+    {
+      pool = own = threadPoolCreate(settings->num_threads < numchunks ? settings->num_threads : numchunks);
+    }
+    if(pool)
+    {
+      /*the arenas are made before any thread starts, every thread only touches its own*/
+      for(i = 1; i < threadPoolSize(pool); ++i) arena_of_thread(settings->arena, i);
+      threadPoolRun(pool, deflateChunkTask, &task);
+    }
+    else deflateChunkTask(&task, 0);
+    threadPoolDestroy(own);
+  }
+#else /*LODEPNG_COMPILE_THREADS*/
+  (void)pool;
+  deflateChunkTask(&task, 0);
+#endif /*LODEPNG_COMPILE_THREADS*/
+
+  for(i = 0; i != numchunks; ++i)
+  {
+    size_t start = begin + i * DEFLATE_CHUNK_SIZE;
+    size_t length = end - start < DEFLATE_CHUNK_SIZE ? end - start : DEFLATE_CHUNK_SIZE;
+    if(!error) error = chunks[i].error;
+    if(!error && !ucvector_reserve(out, out->size + chunks[i].out.size)) error = 83; /*alloc fail*/
+    if(!error)
+    {
+      for(j = 0; j != chunks[i].out.size; ++j) out->data[out->size + j] = chunks[i].out.data[j];
+      out->size += chunks[i].out.size;
+      *adler = adler32_combine(*adler, chunks[i].adler, length);
+    }
+    ucvector_cleanup(&chunks[i].out);
+  }
+  lodepng_free(chunks);
+
+  return error;
+}
+
 unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in,
                                size_t insize, const LodePNGCompressSettings* settings)
 {
@@ -2189,14 +2834,23 @@ unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsig
   ucvector_push_back(&outv, (unsigned char)(CMFFLG / 256));
   ucvector_push_back(&outv, (unsigned char)(CMFFLG % 256));
 
-  error = deflate(&deflatedata, &deflatesize, in, insize, settings);
-
-  if(!error)
+  if(settings->num_threads != 0 && !settings->custom_deflate && settings->btype != 0)
   {
-    unsigned ADLER32 = adler32(in, (unsigned)insize);
-    for(i = 0; i != deflatesize; ++i) ucvector_push_back(&outv, deflatedata[i]);
-    lodepng_free(deflatedata);
-    lodepng_add32bitInt(&outv, ADLER32);
+    unsigned ADLER32 = 1;
+    error = deflateChunkRange(&outv, &ADLER32, in, 0, insize, 1, settings, 0);
+    if(!error) lodepng_add32bitInt(&outv, ADLER32);
+  }
+  else
+  {
+    error = deflate(&deflatedata, &deflatesize, in, insize, settings);
+
+    if(!error)
+    {
+      unsigned ADLER32 = adler32(in, (unsigned)insize);
+      for(i = 0; i != deflatesize; ++i) ucvector_push_back(&outv, deflatedata[i]);
+      lodepng_free(deflatedata);
+      lodepng_add32bitInt(&outv, ADLER32);
+    }
   }
 
   *out = outv.data;
@@ -2258,13 +2912,15 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings)
   settings->minmatch = 3;
   settings->nicematch = 128;
   settings->lazymatching = 1;
+  settings->num_threads = 0;
+  settings->arena = 0;
 
   settings->custom_zlib = 0;
   settings->custom_deflate = 0;
   settings->custom_context = 0;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0, 0, 0};
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -2296,53 +2952,399 @@ const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0,
 /* / CRC32                                                                  / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
-/* CRC polynomial: 0xedb88320 */
-static unsigned lodepng_crc32_table[256] = {
-           0u, 1996959894u, 3993919788u, 2567524794u,  124634137u, 1886057615u, 3915621685u, 2657392035u,
-   249268274u, 2044508324u, 3772115230u, 2547177864u,  162941995u, 2125561021u, 3887607047u, 2428444049u,
-   498536548u, 1789927666u, 4089016648u, 2227061214u,  450548861u, 1843258603u, 4107580753u, 2211677639u,
-   325883990u, 1684777152u, 4251122042u, 2321926636u,  335633487u, 1661365465u, 4195302755u, 2366115317u,
-   997073096u, 1281953886u, 3579855332u, 2724688242u, 1006888145u, 1258607687u, 3524101629u, 2768942443u,
-   901097722u, 1119000684u, 3686517206u, 2898065728u,  853044451u, 1172266101u, 3705015759u, 2882616665u,
-   651767980u, 1373503546u, 3369554304u, 3218104598u,  565507253u, 1454621731u, 3485111705u, 3099436303u,
-   671266974u, 1594198024u, 3322730930u, 2970347812u,  795835527u, 1483230225u, 3244367275u, 3060149565u,
-  1994146192u,   31158534u, 2563907772u, 4023717930u, 1907459465u,  112637215u, 2680153253u, 3904427059u,
-  2013776290u,  251722036u, 2517215374u, 3775830040u, 2137656763u,  141376813u, 2439277719u, 3865271297u,
-  1802195444u,  476864866u, 2238001368u, 4066508878u, 1812370925u,  453092731u, 2181625025u, 4111451223u,
-  1706088902u,  314042704u, 2344532202u, 4240017532u, 1658658271u,  366619977u, 2362670323u, 4224994405u,
-  1303535960u,  984961486u, 2747007092u, 3569037538u, 1256170817u, 1037604311u, 2765210733u, 3554079995u,
-  1131014506u,  879679996u, 2909243462u, 3663771856u, 1141124467u,  855842277u, 2852801631u, 3708648649u,
-  1342533948u,  654459306u, 3188396048u, 3373015174u, 1466479909u,  544179635u, 3110523913u, 3462522015u,
-  1591671054u,  702138776u, 2966460450u, 3352799412u, 1504918807u,  783551873u, 3082640443u, 3233442989u,
-  3988292384u, 2596254646u,   62317068u, 1957810842u, 3939845945u, 2647816111u,   81470997u, 1943803523u,
-  3814918930u, 2489596804u,  225274430u, 2053790376u, 3826175755u, 2466906013u,  167816743u, 2097651377u,
-  4027552580u, 2265490386u,  503444072u, 1762050814u, 4150417245u, 2154129355u,  426522225u, 1852507879u,
-  4275313526u, 2312317920u,  282753626u, 1742555852u, 4189708143u, 2394877945u,  397917763u, 1622183637u,
-  3604390888u, 2714866558u,  953729732u, 1340076626u, 3518719985u, 2797360999u, 1068828381u, 1219638859u,
-  3624741850u, 2936675148u,  906185462u, 1090812512u, 3747672003u, 2825379669u,  829329135u, 1181335161u,
-  3412177804u, 3160834842u,  628085408u, 1382605366u, 3423369109u, 3138078467u,  570562233u, 1426400815u,
-  3317316542u, 2998733608u,  733239954u, 1555261956u, 3268935591u, 3050360625u,  752459403u, 1541320221u,
-  2607071920u, 3965973030u, 1969922972u,   40735498u, 2617837225u, 3943577151u, 1913087877u,   83908371u,
-  2512341634u, 3803740692u, 2075208622u,  213261112u, 2463272603u, 3855990285u, 2094854071u,  198958881u,
-  2262029012u, 4057260610u, 1759359992u,  534414190u, 2176718541u, 4139329115u, 1873836001u,  414664567u,
-  2282248934u, 4279200368u, 1711684554u,  285281116u, 2405801727u, 4167216745u, 1634467795u,  376229701u,
-  2685067896u, 3608007406u, 1308918612u,  956543938u, 2808555105u, 3495958263u, 1231636301u, 1047427035u,
-  2932959818u, 3654703836u, 1088359270u,  936918000u, 2847714899u, 3736837829u, 1202900863u,  817233897u,
-  3183342108u, 3401237130u, 1404277552u,  615818150u, 3134207493u, 3453421203u, 1423857449u,  601450431u,
-  3009837614u, 3294710456u, 1567103746u,  711928724u, 3020668471u, 3272380065u, 1510334235u,  755167117u
+/*
+CRC polynomial: 0xedb88320. lodepng_crc32_table[0] is the table of the bytewise algorithm. Entry n of
+table k is the CRC of byte n followed by k zero bytes, which lets the slicing-by-8 algorithm look up 8
+bytes at a time, each in its own table.
+*/
+static const unsigned lodepng_crc32_table[8][256] = {
+  {
+             0u, 1996959894u, 3993919788u, 2567524794u,  124634137u, 1886057615u, 3915621685u, 2657392035u,
+     249268274u, 2044508324u, 3772115230u, 2547177864u,  162941995u, 2125561021u, 3887607047u, 2428444049u,
+     498536548u, 1789927666u, 4089016648u, 2227061214u,  450548861u, 1843258603u, 4107580753u, 2211677639u,
+     325883990u, 1684777152u, 4251122042u, 2321926636u,  335633487u, 1661365465u, 4195302755u, 2366115317u,
+     997073096u, 1281953886u, 3579855332u, 2724688242u, 1006888145u, 1258607687u, 3524101629u, 2768942443u,
+     901097722u, 1119000684u, 3686517206u, 2898065728u,  853044451u, 1172266101u, 3705015759u, 2882616665u,
+     651767980u, 1373503546u, 3369554304u, 3218104598u,  565507253u, 1454621731u, 3485111705u, 3099436303u,
+     671266974u, 1594198024u, 3322730930u, 2970347812u,  795835527u, 1483230225u, 3244367275u, 3060149565u,
+    1994146192u,   31158534u, 2563907772u, 4023717930u, 1907459465u,  112637215u, 2680153253u, 3904427059u,
+    2013776290u,  251722036u, 2517215374u, 3775830040u, 2137656763u,  141376813u, 2439277719u, 3865271297u,
+    1802195444u,  476864866u, 2238001368u, 4066508878u, 1812370925u,  453092731u, 2181625025u, 4111451223u,
+    1706088902u,  314042704u, 2344532202u, 4240017532u, 1658658271u,  366619977u, 2362670323u, 4224994405u,
+    1303535960u,  984961486u, 2747007092u, 3569037538u, 1256170817u, 1037604311u, 2765210733u, 3554079995u,
+    1131014506u,  879679996u, 2909243462u, 3663771856u, 1141124467u,  855842277u, 2852801631u, 3708648649u,
+    1342533948u,  654459306u, 3188396048u, 3373015174u, 1466479909u,  544179635u, 3110523913u, 3462522015u,
+    1591671054u,  702138776u, 2966460450u, 3352799412u, 1504918807u,  783551873u, 3082640443u, 3233442989u,
+    3988292384u, 2596254646u,   62317068u, 1957810842u, 3939845945u, 2647816111u,   81470997u, 1943803523u,
+    3814918930u, 2489596804u,  225274430u, 2053790376u, 3826175755u, 2466906013u,  167816743u, 2097651377u,
+    4027552580u, 2265490386u,  503444072u, 1762050814u, 4150417245u, 2154129355u,  426522225u, 1852507879u,
+    4275313526u, 2312317920u,  282753626u, 1742555852u, 4189708143u, 2394877945u,  397917763u, 1622183637u,
+    3604390888u, 2714866558u,  953729732u, 1340076626u, 3518719985u, 2797360999u, 1068828381u, 1219638859u,
+    3624741850u, 2936675148u,  906185462u, 1090812512u, 3747672003u, 2825379669u,  829329135u, 1181335161u,
+    3412177804u, 3160834842u,  628085408u, 1382605366u, 3423369109u, 3138078467u,  570562233u, 1426400815u,
+    3317316542u, 2998733608u,  733239954u, 1555261956u, 3268935591u, 3050360625u,  752459403u, 1541320221u,
+    2607071920u, 3965973030u, 1969922972u,   40735498u, 2617837225u, 3943577151u, 1913087877u,   83908371u,
+    2512341634u, 3803740692u, 2075208622u,  213261112u, 2463272603u, 3855990285u, 2094854071u,  198958881u,
+    2262029012u, 4057260610u, 1759359992u,  534414190u, 2176718541u, 4139329115u, 1873836001u,  414664567u,
+    2282248934u, 4279200368u, 1711684554u,  285281116u, 2405801727u, 4167216745u, 1634467795u,  376229701u,
+    2685067896u, 3608007406u, 1308918612u,  956543938u, 2808555105u, 3495958263u, 1231636301u, 1047427035u,
+    2932959818u, 3654703836u, 1088359270u,  936918000u, 2847714899u, 3736837829u, 1202900863u,  817233897u,
+    3183342108u, 3401237130u, 1404277552u,  615818150u, 3134207493u, 3453421203u, 1423857449u,  601450431u,
+    3009837614u, 3294710456u, 1567103746u,  711928724u, 3020668471u, 3272380065u, 1510334235u,  755167117u
+  },
+  {
+             0u,  421212481u,  842424962u,  724390851u, 1684849924u, 2105013317u, 1448781702u, 1329698503u,
+    3369699848u, 3519200073u, 4210026634u, 3824474571u, 2897563404u, 3048111693u, 2659397006u, 2274893007u,
+    1254232657u, 1406739216u, 2029285587u, 1643069842u,  783210325u,  934667796u,  479770071u,   92505238u,
+    2182846553u, 2600511768u, 2955803355u, 2838940570u, 3866582365u, 4285295644u, 3561045983u, 3445231262u,
+    2508465314u, 2359236067u, 2813478432u, 3198777185u, 4058571174u, 3908292839u, 3286139684u, 3670389349u,
+    1566420650u, 1145479147u, 1869335592u, 1987116393u,  959540142u,  539646703u,  185010476u,  303839341u,
+    3745920755u, 3327985586u, 3983561841u, 4100678960u, 3140154359u, 2721170102u, 2300350837u, 2416418868u,
+     396344571u,  243568058u,  631889529u, 1018359608u, 1945336319u, 1793607870u, 1103436669u, 1490954812u,
+    4034481925u, 3915546180u, 3259968903u, 3679722694u, 2484439553u, 2366552896u, 2787371139u, 3208174018u,
+     950060301u,  565965900u,  177645455u,  328046286u, 1556873225u, 1171730760u, 1861902987u, 2011255754u,
+    3132841300u, 2745199637u, 2290958294u, 2442530455u, 3738671184u, 3352078609u, 3974232786u, 4126854035u,
+    1919080284u, 1803150877u, 1079293406u, 1498383519u,  370020952u,  253043481u,  607678682u, 1025720731u,
+    1711106983u, 2095471334u, 1472923941u, 1322268772u,   26324643u,  411738082u,  866634785u,  717028704u,
+    2904875439u, 3024081134u, 2668790573u, 2248782444u, 3376948395u, 3495106026u, 4219356713u, 3798300520u,
+     792689142u,  908347575u,  487136116u,   68299317u, 1263779058u, 1380486579u, 2036719216u, 1618931505u,
+    3890672638u, 4278043327u, 3587215740u, 3435896893u, 2206873338u, 2593195963u, 2981909624u, 2829542713u,
+     998479947u,  580430090u,  162921161u,  279890824u, 1609522511u, 1190423566u, 1842954189u, 1958874764u,
+    4082766403u, 3930137346u, 3245109441u, 3631694208u, 2536953671u, 2385372678u, 2768287173u, 3155920004u,
+    1900120602u, 1750776667u, 1131931800u, 1517083097u,  355290910u,  204897887u,  656092572u, 1040194781u,
+    3113746450u, 2692952403u, 2343461520u, 2461357009u, 3723805974u, 3304059991u, 4022511508u, 4141455061u,
+    2919742697u, 3072101800u, 2620513899u, 2234183466u, 3396041197u, 3547351212u, 4166851439u, 3779471918u,
+    1725839073u, 2143618976u, 1424512099u, 1307796770u,   45282277u,  464110244u,  813994343u,  698327078u,
+    3838160568u, 4259225593u, 3606301754u, 3488152955u, 2158586812u, 2578602749u, 2996767038u, 2877569151u,
+     740041904u,  889656817u,  506086962u,  120682355u, 1215357364u, 1366020341u, 2051441462u, 1667084919u,
+    3422213966u, 3538019855u, 4190942668u, 3772220557u, 2945847882u, 3062702859u, 2644537544u, 2226864521u,
+      52649286u,  439905287u,  823476164u,  672009861u, 1733269570u, 2119477507u, 1434057408u, 1281543041u,
+    2167981343u, 2552493150u, 3004082077u, 2853541596u, 3847487515u, 4233048410u, 3613549209u, 3464057816u,
+    1239502615u, 1358593622u, 2077699477u, 1657543892u,  764250643u,  882293586u,  532408465u,  111204816u,
+    1585378284u, 1197851309u, 1816695150u, 1968414767u,  974272232u,  587794345u,  136598634u,  289367339u,
+    2527558116u, 2411481253u, 2760973158u, 3179948583u, 4073438432u, 3956313505u, 3237863010u, 3655790371u,
+     347922877u,  229101820u,  646611775u, 1066513022u, 1892689081u, 1774917112u, 1122387515u, 1543337850u,
+    3697634229u, 3313392372u, 3998419255u, 4148705398u, 3087642289u, 2702352368u, 2319436851u, 2468674930u
+  },
+  {
+             0u,   29518391u,   59036782u,   38190681u,  118073564u,  114017003u,   76381362u,   89069189u,
+     236147128u,  265370511u,  228034006u,  206958561u,  152762724u,  148411219u,  178138378u,  190596925u,
+     472294256u,  501532999u,  530741022u,  509615401u,  456068012u,  451764635u,  413917122u,  426358261u,
+     305525448u,  334993663u,  296822438u,  275991697u,  356276756u,  352202787u,  381193850u,  393929805u,
+     944588512u,  965684439u, 1003065998u,  973863097u, 1061482044u, 1049003019u, 1019230802u, 1023561829u,
+     912136024u,  933002607u,  903529270u,  874031361u,  827834244u,  815125939u,  852716522u,  856752605u,
+     611050896u,  631869351u,  669987326u,  640506825u,  593644876u,  580921211u,  551983394u,  556069653u,
+     712553512u,  733666847u,  704405574u,  675154545u,  762387700u,  749958851u,  787859610u,  792175277u,
+    1889177024u, 1901651959u, 1931368878u, 1927033753u, 2006131996u, 1985040171u, 1947726194u, 1976933189u,
+    2122964088u, 2135668303u, 2098006038u, 2093965857u, 2038461604u, 2017599123u, 2047123658u, 2076625661u,
+    1824272048u, 1836991623u, 1866005214u, 1861914857u, 1807058540u, 1786244187u, 1748062722u, 1777547317u,
+    1655668488u, 1668093247u, 1630251878u, 1625932113u, 1705433044u, 1684323811u, 1713505210u, 1742760333u,
+    1222101792u, 1226154263u, 1263738702u, 1251046777u, 1339974652u, 1310460363u, 1281013650u, 1301863845u,
+    1187289752u, 1191637167u, 1161842422u, 1149379777u, 1103966788u, 1074747507u, 1112139306u, 1133218845u,
+    1425107024u, 1429406311u, 1467333694u, 1454888457u, 1408811148u, 1379576507u, 1350309090u, 1371438805u,
+    1524775400u, 1528845279u, 1499917702u, 1487177649u, 1575719220u, 1546255107u, 1584350554u, 1605185389u,
+    3778354048u, 3774312887u, 3803303918u, 3816007129u, 3862737756u, 3892238699u, 3854067506u, 3833203973u,
+    4012263992u, 4007927823u, 3970080342u, 3982554209u, 3895452388u, 3924658387u, 3953866378u, 3932773565u,
+    4245928176u, 4241609415u, 4271336606u, 4283762345u, 4196012076u, 4225268251u, 4187931714u, 4166823541u,
+    4076923208u, 4072833919u, 4035198246u, 4047918865u, 4094247316u, 4123732899u, 4153251322u, 4132437965u,
+    3648544096u, 3636082519u, 3673983246u, 3678331705u, 3732010428u, 3753090955u, 3723829714u, 3694611429u,
+    3614117080u, 3601426159u, 3572488374u, 3576541825u, 3496125444u, 3516976691u, 3555094634u, 3525581405u,
+    3311336976u, 3298595879u, 3336186494u, 3340255305u, 3260503756u, 3281337595u, 3251864226u, 3222399125u,
+    3410866088u, 3398419871u, 3368647622u, 3372945905u, 3427010420u, 3448139075u, 3485520666u, 3456284973u,
+    2444203584u, 2423127159u, 2452308526u, 2481530905u, 2527477404u, 2539934891u, 2502093554u, 2497740997u,
+    2679949304u, 2659102159u, 2620920726u, 2650438049u, 2562027300u, 2574714131u, 2603727690u, 2599670141u,
+    2374579504u, 2353749767u, 2383274334u, 2412743529u, 2323684844u, 2336421851u, 2298759554u, 2294686645u,
+    2207933576u, 2186809023u, 2149495014u, 2178734801u, 2224278612u, 2236720739u, 2266437690u, 2262135309u,
+    2850214048u, 2820717207u, 2858812622u, 2879680249u, 2934667388u, 2938704459u, 2909776914u, 2897069605u,
+    2817622296u, 2788420399u, 2759153014u, 2780249921u, 2700618180u, 2704950259u, 2742877610u, 2730399645u,
+    3049550800u, 3020298727u, 3057690558u, 3078802825u, 2999835404u, 3004150075u, 2974355298u, 2961925461u,
+    3151438440u, 3121956959u, 3092510214u, 3113327665u, 3168701108u, 3172786307u, 3210370778u, 3197646061u
+  },
+  {
+             0u, 3099354981u, 2852767883u,  313896942u, 2405603159u,  937357362u,  627793884u, 2648127673u,
+    3316918511u, 2097696650u, 1874714724u, 3607201537u, 1255587768u, 4067088605u, 3772741427u, 1482887254u,
+    1343838111u, 3903140090u, 4195393300u, 1118632049u, 3749429448u, 1741137837u, 1970407491u, 3452858150u,
+    2511175536u,  756094997u, 1067759611u, 2266550430u,  449832999u, 2725482306u, 2965774508u,  142231497u,
+    2687676222u,  412010587u,  171665333u, 2995192016u,  793786473u, 2548850444u, 2237264098u, 1038456711u,
+    1703315409u, 3711623348u, 3482275674u, 1999841343u, 3940814982u, 1381529571u, 1089329165u, 4166106984u,
+    4029413537u, 1217896388u, 1512189994u, 3802027855u, 2135519222u, 3354724499u, 3577784189u, 1845280792u,
+     899665998u, 2367928107u, 2677414085u,  657096608u, 3137160985u,   37822588u,  284462994u, 2823350519u,
+    2601801789u,  598228824u,  824021174u, 2309093331u,  343330666u, 2898962447u, 3195996129u,  113467524u,
+    1587572946u, 3860600759u, 4104763481u, 1276501820u, 3519211397u, 1769898208u, 2076913422u, 3279374443u,
+    3406630818u, 1941006535u, 1627703081u, 3652755532u, 1148164341u, 4241751952u, 3999682686u, 1457141531u,
+     247015245u, 3053797416u, 2763059142u,  470583459u, 2178658330u,  963106687u,  735213713u, 2473467892u,
+     992409347u, 2207944806u, 2435792776u,  697522413u, 3024379988u,  217581361u,  508405983u, 2800865210u,
+    4271038444u, 1177467017u, 1419450215u, 3962007554u, 1911572667u, 3377213406u, 3690561584u, 1665525589u,
+    1799331996u, 3548628985u, 3241568279u, 2039091058u, 3831314379u, 1558270126u, 1314193216u, 4142438437u,
+    2928380019u,  372764438u,   75645176u, 3158189981u,  568925988u, 2572515393u, 2346768303u,  861712586u,
+    3982079547u, 1441124702u, 1196457648u, 4293663189u, 1648042348u, 3666298377u, 3358779879u, 1888390786u,
+     686661332u, 2421291441u, 2196002399u,  978858298u, 2811169155u,  523464422u,  226935048u, 3040519789u,
+    3175145892u,  100435649u,  390670639u, 2952089162u,  841119475u, 2325614998u, 2553003640u,  546822429u,
+    2029308235u, 3225988654u, 3539796416u, 1782671013u, 4153826844u, 1328167289u, 1570739863u, 3844338162u,
+    1298864389u, 4124540512u, 3882013070u, 1608431339u, 3255406162u, 2058742071u, 1744848601u, 3501990332u,
+    2296328682u,  811816591u,  584513889u, 2590678532u,  129869501u, 3204563416u, 2914283062u,  352848211u,
+     494030490u, 2781751807u, 3078325777u,  264757620u, 2450577869u,  715964072u,  941166918u, 2158327331u,
+    3636881013u, 1618608400u, 1926213374u, 3396585883u, 1470427426u, 4011365959u, 4255988137u, 1158766284u,
+    1984818694u, 3471935843u, 3695453837u, 1693991400u, 4180638033u, 1100160564u, 1395044826u, 3952793279u,
+    3019491049u,  189112716u,  435162722u, 2706139399u, 1016811966u, 2217162459u, 2526189877u,  774831696u,
+     643086745u, 2666061564u, 2354934034u,  887166583u, 2838900430u,  294275499u,   54519365u, 3145957664u,
+    3823145334u, 1532818963u, 1240029693u, 4048895640u, 1820460577u, 3560857924u, 3331051178u, 2117577167u,
+    3598663992u, 1858283101u, 2088143283u, 3301633750u, 1495127663u, 3785470218u, 4078182116u, 1269332353u,
+     332098007u, 2876706482u, 3116540252u,   25085497u, 2628386432u,  605395429u,  916469259u, 2384220526u,
+    2254837415u, 1054503362u,  745528876u, 2496903497u,  151290352u, 2981684885u, 2735556987u,  464596510u,
+    1137851976u, 4218313005u, 3923506883u, 1365741990u, 3434129695u, 1946996346u, 1723425172u, 3724871409u
+  },
+  {
+             0u, 1029712304u, 2059424608u, 1201699536u, 4118849216u, 3370159984u, 2403399072u, 2988497936u,
+     812665793u,  219177585u, 1253054625u, 2010132753u, 3320900865u, 4170237105u, 3207642721u, 2186319825u,
+    1625331586u, 1568718386u,  438355170u,  658566482u, 2506109250u, 2818578674u, 4020265506u, 3535817618u,
+    1351670851u, 1844508147u,  709922595u,  389064339u, 2769320579u, 2557498163u, 3754961379u, 3803185235u,
+    3250663172u, 4238411444u, 3137436772u, 2254525908u,  876710340u,  153198708u, 1317132964u, 1944187668u,
+    4054934725u, 3436268917u, 2339452837u, 3054575125u,   70369797u,  961670069u, 2129760613u, 1133623509u,
+    2703341702u, 2621542710u, 3689016294u, 3867263574u, 1419845190u, 1774270454u,  778128678u,  318858390u,
+    2438067015u, 2888948471u, 3952189479u, 3606153623u, 1691440519u, 1504803895u,  504432359u,  594620247u,
+    1492342857u, 1704161785u,  573770537u,  525542041u, 2910060169u, 2417219385u, 3618876905u, 3939730521u,
+    1753420680u, 1440954936u,  306397416u,  790849880u, 2634265928u, 2690882808u, 3888375336u, 3668168600u,
+     940822475u,   91481723u, 1121164459u, 2142483739u, 3448989963u, 4042473659u, 3075684971u, 2318603227u,
+     140739594u,  889433530u, 1923340138u, 1338244826u, 4259521226u, 3229813626u, 2267247018u, 3124975642u,
+    2570221389u, 2756861693u, 3824297005u, 3734113693u, 1823658381u, 1372780605u,  376603373u,  722643805u,
+    2839690380u, 2485261628u, 3548540908u, 4007806556u, 1556257356u, 1638052860u,  637716780u,  459464860u,
+    4191346895u, 3300051327u, 2199040943u, 3195181599u,  206718479u,  825388991u, 1989285231u, 1274166495u,
+    3382881038u, 4106388158u, 3009607790u, 2382549470u, 1008864718u,   21111934u, 1189240494u, 2072147742u,
+    2984685714u, 2357631266u, 3408323570u, 4131834434u, 1147541074u, 2030452706u, 1051084082u,   63335554u,
+    2174155603u, 3170292451u, 4216760371u, 3325460867u, 1947622803u, 1232499747u,  248909555u,  867575619u,
+    3506841360u, 3966111392u, 2881909872u, 2527485376u,  612794832u,  434546784u, 1581699760u, 1663499008u,
+    3782634705u, 3692447073u, 2612412337u, 2799048193u,  351717905u,  697754529u, 1849071985u, 1398190273u,
+    1881644950u, 1296545318u,  182963446u,  931652934u, 2242328918u, 3100053734u, 4284967478u, 3255255942u,
+    1079497815u, 2100821479u,  983009079u,  133672583u, 3050795671u, 2293717799u, 3474399735u, 4067887175u,
+     281479188u,  765927844u, 1778867060u, 1466397380u, 3846680276u, 3626469220u, 2676489652u, 2733102084u,
+     548881365u,  500656741u, 1517752501u, 1729575173u, 3577210133u, 3898068133u, 2952246901u, 2459410373u,
+    3910527195u, 3564487019u, 2480257979u, 2931134987u,  479546907u,  569730987u, 1716854139u, 1530213579u,
+    3647316762u, 3825568426u, 2745561210u, 2663766474u,  753206746u,  293940330u, 1445287610u, 1799716618u,
+    2314567513u, 3029685993u, 4080348217u, 3461678473u, 2088098201u, 1091956777u,  112560889u, 1003856713u,
+    3112514712u, 2229607720u, 3276105720u, 4263857736u, 1275433560u, 1902492648u,  918929720u,  195422344u,
+     685033439u,  364179055u, 1377080511u, 1869921551u, 3713294623u, 3761522863u, 2811507327u, 2599689167u,
+     413436958u,  633644462u, 1650777982u, 1594160846u, 3978570462u, 3494118254u, 2548332990u, 2860797966u,
+    1211387997u, 1968470509u,  854852413u,  261368461u, 3182753437u, 2161434413u, 3346310653u, 4195650637u,
+    2017729436u, 1160000044u,   42223868u, 1071931724u, 2378480988u, 2963576044u, 4144295484u, 3395602316u
+  },
+  {
+             0u, 3411858341u, 1304994059u, 2257875630u, 2609988118u, 1355649459u, 3596215069u,  486879416u,
+    3964895853u,  655315400u, 2711298918u, 1791488195u, 2009251963u, 3164476382u,  973758832u, 4048990933u,
+      64357019u, 3364540734u, 1310630800u, 2235723829u, 2554806413u, 1394316072u, 3582976390u,  517157411u,
+    4018503926u,  618222419u, 2722963965u, 1762783832u, 1947517664u, 3209171269u,  970744811u, 4068520014u,
+     128714038u, 3438335635u, 1248109629u, 2167961496u, 2621261600u, 1466012805u, 3522553387u,  447296910u,
+    3959392091u,  547575038u, 2788632144u, 1835791861u, 1886307661u, 3140622056u, 1034314822u, 4143626211u,
+      75106221u, 3475428360u, 1236444838u, 2196665603u, 2682996155u, 1421317662u, 3525567664u,  427767573u,
+    3895035328u,  594892389u, 2782995659u, 1857943406u, 1941489622u, 3101955187u, 1047553757u, 4113347960u,
+     257428076u, 3288652233u, 1116777319u, 2311878850u, 2496219258u, 1603640287u, 3640781169u,  308099796u,
+    3809183745u,  676813732u, 2932025610u, 1704983215u, 2023410199u, 3016104370u,  894593820u, 4262377657u,
+     210634999u, 3352484690u, 1095150076u, 2316991065u, 2535410401u, 1547934020u, 3671583722u,  294336591u,
+    3772615322u,  729897279u, 2903845777u, 1716123700u, 2068629644u, 2953845545u,  914647431u, 4258839074u,
+     150212442u, 3282623743u, 1161604689u, 2388688372u, 2472889676u, 1480171241u, 3735940167u,  368132066u,
+    3836185911u,  805002898u, 2842635324u, 1647574937u, 2134298401u, 3026852996u,  855535146u, 4188192143u,
+     186781121u, 3229539940u, 1189784778u, 2377547631u, 2427670487u, 1542429810u, 3715886812u,  371670393u,
+    3882979244u,  741170185u, 2864262823u, 1642462466u, 2095107514u, 3082559007u,  824732849u, 4201955092u,
+     514856152u, 3589064573u, 1400419795u, 2552522358u, 2233554638u, 1316849003u, 3370776517u,   62202976u,
+    4075001525u,  968836368u, 3207280574u, 1954014235u, 1769133219u, 2720925446u,  616199592u, 4024870413u,
+     493229635u, 3594175974u, 1353627464u, 2616354029u, 2264355925u, 1303087088u, 3409966430u,    6498043u,
+    4046820398u,  979978123u, 3170710821u, 2007099008u, 1789187640u, 2717386141u,  661419827u, 3962610838u,
+     421269998u, 3527459403u, 1423225061u, 2676515648u, 2190300152u, 1238466653u, 3477467891u,   68755798u,
+    4115633027u, 1041448998u, 3095868040u, 1943789869u, 1860096405u, 2776760880u,  588673182u, 3897205563u,
+     449450869u, 3516317904u, 1459794558u, 2623431131u, 2170245475u, 1242006214u, 3432247400u,  131015629u,
+    4137259288u, 1036337853u, 3142660115u, 1879958454u, 1829294862u, 2790523051u,  549483013u, 3952910752u,
+     300424884u, 3669282065u, 1545650111u, 2541513754u, 2323209378u, 1092980487u, 3350330793u,  216870412u,
+    4256931033u,  921128828u, 2960342482u, 2066738807u, 1714085583u, 2910195050u,  736264132u, 3770592353u,
+     306060335u, 3647131530u, 1610005796u, 2494197377u, 2309971513u, 1123257756u, 3295149874u,  255536279u,
+    4268596802u,  892423655u, 3013951305u, 2029645036u, 1711070292u, 2929725425u,  674528607u, 3815288570u,
+     373562242u, 3709388839u, 1535949449u, 2429577516u, 2379569556u, 1183418929u, 3223189663u,  188820282u,
+    4195850735u,  827017802u, 3084859620u, 2089020225u, 1636228089u, 2866415708u,  743340786u, 3876759895u,
+     361896217u, 3738094268u, 1482340370u, 2466671543u, 2382584591u, 1163888810u, 3284924932u,  144124321u,
+    4190215028u,  849168593u, 3020503679u, 2136336858u, 1649465698u, 2836138695u,  798521449u, 3838094284u
+  },
+  {
+             0u, 2792819636u, 2543784233u,  837294749u, 4098827283u, 1379413927u, 1674589498u, 3316072078u,
+     871321191u, 2509784531u, 2758827854u,   34034938u, 3349178996u, 1641505216u, 1346337629u, 4131942633u,
+    1742642382u, 3249117050u, 4030828007u, 1446413907u, 2475800797u,  904311657u,   68069876u, 2725880384u,
+    1412551337u, 4064729373u, 3283010432u, 1708771380u, 2692675258u,  101317902u,  937551763u, 2442587175u,
+    3485284764u, 1774858792u, 1478633653u, 4266992385u, 1005723023u, 2642744891u, 2892827814u,  169477906u,
+    4233263099u, 1512406095u, 1808623314u, 3451546982u,  136139752u, 2926205020u, 2676114113u,  972376437u,
+    2825102674u,  236236518u, 1073525883u, 2576072655u, 1546420545u, 4200303349u, 3417542760u, 1841601500u,
+    2609703733u, 1039917185u,  202635804u, 2858742184u, 1875103526u, 3384067218u, 4166835727u, 1579931067u,
+    1141601657u, 3799809741u, 3549717584u, 1977839588u, 2957267306u,  372464350u,  668680259u, 2175552503u,
+    2011446046u, 3516084394u, 3766168119u, 1175200131u, 2209029901u,  635180217u,  338955812u, 2990736784u,
+     601221559u, 2242044419u, 3024812190u,  306049834u, 3617246628u, 1911408144u, 1074125965u, 3866285881u,
+     272279504u, 3058543716u, 2275784441u,  567459149u, 3832906691u, 1107462263u, 1944752874u, 3583875422u,
+    2343980261u,  767641425u,  472473036u, 3126744696u, 2147051766u, 3649987394u, 3899029983u, 1309766251u,
+    3092841090u,  506333494u,  801510315u, 2310084639u, 1276520081u, 3932237093u, 3683203000u, 2113813516u,
+    3966292011u, 1243601823u, 2079834370u, 3716205238u,  405271608u, 3192979340u, 2411259153u,  701492901u,
+    3750207052u, 2045810168u, 1209569125u, 4000285905u,  734575199u, 2378150379u, 3159862134u,  438345922u,
+    2283203314u,  778166598u,  529136603u, 3120492655u, 2086260449u, 3660498261u, 3955679176u, 1303499900u,
+    3153699989u,  495890209u,  744928700u, 2316418568u, 1337360518u, 3921775410u, 3626602927u, 2120129051u,
+    4022892092u, 1237286280u, 2018993941u, 3726666913u,  461853231u, 3186645403u, 2350400262u,  711936178u,
+    3693557851u, 2052076527u, 1270360434u, 3989775046u,  677911624u, 2384402428u, 3220639073u,  427820757u,
+    1202443118u, 3789347034u, 3493118535u, 1984154099u, 3018127229u,  362020041u,  612099668u, 2181885408u,
+    1950653705u, 3526596285u, 3822816288u, 1168934804u, 2148251930u,  645706414u,  395618355u, 2984485767u,
+     544559008u, 2248295444u, 3085590153u,  295523645u, 3560598451u, 1917673479u, 1134918298u, 3855773998u,
+     328860103u, 3052210803u, 2214924526u,  577903450u, 3889505748u, 1101147744u, 1883911421u, 3594338121u,
+    3424493451u, 1785369663u, 1535282850u, 4260726038u,  944946072u, 2653270060u, 2949491377u,  163225861u,
+    4294103532u, 1501944408u, 1752023237u, 3457862513u,  196998655u, 2915761739u, 2619532502u,  978710370u,
+    2881684293u,  229902577u, 1012666988u, 2586515928u, 1603020630u, 4193987810u, 3356702335u, 1852063179u,
+    2553040162u, 1046169238u,  263412747u, 2848217023u, 1818454321u, 3390333573u, 4227627032u, 1569420204u,
+      60859927u, 2782375331u, 2487203646u,  843627658u, 4159668740u, 1368951216u, 1617990445u, 3322386585u,
+     810543216u, 2520310724u, 2815490393u,   27783917u, 3288386659u, 1652017111u, 1402985802u, 4125677310u,
+    1685994201u, 3255382381u, 4091620336u, 1435902020u, 2419138250u,  910562686u,  128847843u, 2715354199u,
+    1469150398u, 4058414858u, 3222168983u, 1719234083u, 2749255853u,   94984985u,  876691844u, 2453031472u
+  },
+  {
+             0u, 3433693342u, 1109723005u, 2391738339u, 2219446010u, 1222643300u, 3329165703u,  180685081u,
+    3555007413u,  525277995u, 2445286600u, 1567235158u, 1471092047u, 2600801745u,  361370162u, 3642757804u,
+    2092642603u, 2953916853u, 1050555990u, 4063508168u, 4176560081u,  878395215u, 3134470316u, 1987983410u,
+    2942184094u, 1676945920u, 3984272867u,  567356797u,  722740324u, 3887998202u, 1764827929u, 2778407815u,
+    4185285206u,  903635656u, 3142804779u, 2012833205u, 2101111980u, 2979425330u, 1058630609u, 4088621903u,
+     714308067u, 3862526333u, 1756790430u, 2753330688u, 2933487385u, 1651734407u, 3975966820u,  542535930u,
+    2244825981u, 1231508451u, 3353891840u,  188896414u,   25648519u, 3442302233u, 1134713594u, 2399689316u,
+    1445480648u, 2592229462u,  336416693u, 3634843435u, 3529655858u,  516441772u, 2420588879u, 1559052753u,
+     698204909u, 3845636723u, 1807271312u, 2803025166u, 2916600855u, 1635634313u, 4025666410u,  593021940u,
+    4202223960u,  919787974u, 3093159461u, 1962401467u, 2117261218u, 2996361020u, 1008193759u, 4038971457u,
+    1428616134u, 2576151384u,  386135227u, 3685348389u, 3513580860u,  499580322u, 2471098945u, 1608776415u,
+    2260985971u, 1248454893u, 3303468814u,  139259792u,   42591881u, 3458459159u, 1085071860u, 2349261162u,
+    3505103035u,  474062885u, 2463016902u, 1583654744u, 1419882049u, 2550902495u,  377792828u, 3660491170u,
+      51297038u, 3483679632u, 1093385331u, 2374089965u, 2269427188u, 1273935210u, 3311514249u,  164344343u,
+    2890961296u, 1627033870u, 4000683757u,  585078387u,  672833386u, 3836780532u, 1782552599u, 2794821769u,
+    2142603813u, 3005188795u, 1032883544u, 4047146438u, 4227826911u,  928351297u, 3118105506u, 1970307900u,
+    1396409818u, 2677114180u,  287212199u, 3719594553u, 3614542624u,  467372990u, 2505346141u, 1509854403u,
+    2162073199u, 1282711281u, 3271268626u,  240228748u,   76845205u, 3359543307u, 1186043880u, 2317064054u,
+     796964081u, 3811226735u, 1839575948u, 2702160658u, 2882189835u, 1734392469u, 3924802934u,  625327592u,
+    4234522436u,  818917338u, 3191908409u, 1927981223u, 2016387518u, 3028656416u,  973776579u, 4137723485u,
+    2857232268u, 1726474002u, 3899187441u,  616751215u,  772270454u, 3803048424u, 1814228491u, 2693328533u,
+    2041117753u, 3036871847u,  999160644u, 4146592730u, 4259508931u,  826864221u, 3217552830u, 1936586016u,
+    3606501031u,  442291769u, 2496909786u, 1484378436u, 1388107869u, 2652297411u,  278519584u, 3694387134u,
+      85183762u, 3384397196u, 1194773103u, 2342308593u, 2170143720u, 1307820918u, 3279733909u,  265733131u,
+    2057717559u, 3054258089u,  948125770u, 4096344276u, 4276898253u,  843467091u, 3167309488u, 1885556270u,
+    2839764098u, 1709792284u, 3949353983u,  667704161u,  755585656u, 3785577190u, 1865176325u, 2743489947u,
+     102594076u, 3401021058u, 1144549729u, 2291298815u, 2186770662u, 1325234296u, 3228729243u,  215514885u,
+    3589828009u,  424832311u, 2547870420u, 1534552650u, 1370645331u, 2635621325u,  328688686u, 3745342640u,
+    2211456353u, 1333405183u, 3254067740u,  224338562u,  127544219u, 3408931589u, 1170156774u, 2299866232u,
+    1345666772u, 2627681866u,  303053225u, 3736746295u, 3565105198u,  416624816u, 2522494803u, 1525692365u,
+    4285207626u,  868291796u, 3176010551u, 1910772649u, 2065767088u, 3079346734u,  956571085u, 4121828691u,
+     747507711u, 3760459617u, 1856702594u, 2717976604u, 2831417605u, 1684930971u, 3940615800u,  642451174u
+  }
 };
 
+/*The reference algorithm, one byte at a time. c is the CRC register, without the inversions before and after.*/
+static unsigned crc32_bytewise(unsigned c, const unsigned char* buf, size_t len)
+{
+  size_t n;
+  for(n = 0; n < len; ++n)
+  {
+    c = lodepng_crc32_table[0][(c ^ buf[n]) & 0xff] ^ (c >> 8);
+  }
+  return c;
+}
+
+/*Slicing-by-8: the lookups of 8 bytes do not depend on each other, so they can all run at the same time.*/
+static unsigned crc32_slice8(unsigned c, const unsigned char* buf, size_t len)
+{
+  while(len >= 8)
+  {
+    c ^= (unsigned)buf[0] | ((unsigned)buf[1] << 8u) | ((unsigned)buf[2] << 16u) | ((unsigned)buf[3] << 24u);
+    c = lodepng_crc32_table[7][c & 0xff] ^ lodepng_crc32_table[6][(c >> 8u) & 0xff]
+      ^ lodepng_crc32_table[5][(c >> 16u) & 0xff] ^ lodepng_crc32_table[4][(c >> 24u) & 0xff]
+      ^ lodepng_crc32_table[3][buf[4]] ^ lodepng_crc32_table[2][buf[5]]
+      ^ lodepng_crc32_table[1][buf[6]] ^ lodepng_crc32_table[0][buf[7]];
+    buf += 8;
+    len -= 8;
+  }
+  return crc32_bytewise(c, buf, len);
+}
+
+#ifdef LODEPNG_COMPILE_X86_SIMD
+/*
+Carry-less multiplication, after "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+Instruction" by Intel: 4 blocks of 16 bytes are folded forward 64 bytes at a time, then into one block,
+which is reduced to 32 bits with Barrett reduction. The constants are powers of x modulo the (bit
+reflected) polynomial. len must be at least 64 and a multiple of 16.
+*/
+__attribute__((target("pclmul,sse4.1")))
+static unsigned crc32_pclmul(unsigned c, const unsigned char* buf, size_t len)
+{
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+  const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124LL);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+  __m128i x1 = _mm_loadu_si128((const __m128i*)&buf[0]);
+  __m128i x2 = _mm_loadu_si128((const __m128i*)&buf[16]);
+  __m128i x3 = _mm_loadu_si128((const __m128i*)&buf[32]);
+  __m128i x4 = _mm_loadu_si128((const __m128i*)&buf[48]);
+  __m128i x5;
+
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)c));
+  buf += 64;
+  len -= 64;
+
+  while(len >= 64)
+  {
+    x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k1k2, 0x11), x5), _mm_loadu_si128((const __m128i*)&buf[0]));
+    x5 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+    x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, k1k2, 0x11), x5), _mm_loadu_si128((const __m128i*)&buf[16]));
+    x5 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+    x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, k1k2, 0x11), x5), _mm_loadu_si128((const __m128i*)&buf[32]));
+    x5 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+    x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, k1k2, 0x11), x5), _mm_loadu_si128((const __m128i*)&buf[48]));
+    buf += 64;
+    len -= 64;
+  }
+
+  /*fold the 4 blocks into one, then the remaining blocks of 16 bytes into it*/
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x2), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x3), x5);
+  x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+  x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x4), x5);
+  while(len >= 16)
+  {
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), _mm_loadu_si128((const __m128i*)buf)), x5);
+    buf += 16;
+    len -= 16;
+  }
+
+  /*fold 128 bits to 64, then reduce to 32*/
+  x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask32), k5k0, 0x00), x2);
+
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask32), poly, 0x10);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask32), poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return (unsigned)_mm_extract_epi32(x1, 1);
+}
+#endif /*LODEPNG_COMPILE_X86_SIMD*/
+
 /*Return the CRC of the bytes buf[0..len-1].*/
 unsigned lodepng_crc32(const unsigned char* buf, size_t len)
 {
   unsigned c = 0xffffffffL;
-  size_t n;
-
-  for(n = 0; n < len; ++n)
+#ifdef LODEPNG_COMPILE_X86_SIMD
+  /*most chunks other than IDAT are too small to be worth it*/
+  if(len >= 64)
   {
-    c = lodepng_crc32_table[(c ^ buf[n]) & 0xff] ^ (c >> 8);
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+    {
+      size_t blocks = len & ~(size_t)15;
+      c = crc32_pclmul(c, buf, blocks);
+      buf += blocks;
+      len -= blocks;
+    }
   }
-  return c ^ 0xffffffffL;
+#endif /*LODEPNG_COMPILE_X86_SIMD*/
+  return crc32_slice8(c, buf, len) ^ 0xffffffffL;
 }
 
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -3512,7 +4514,8 @@ static unsigned getValueRequiredBits(unsigned char value)
 }
 
 /*profile must already have been inited with mode.
-It's ok to set some parameters of profile to done already.*/
+It's ok to set some parameters of profile to done already. When the profile already has pixels,
+the new ones are added to it, so the profile of an image can be taken a part at a time.*/
 unsigned lodepng_get_color_profile(LodePNGColorProfile* profile,
                                    const unsigned char* in, unsigned w, unsigned h,
                                    const LodePNGColorMode* mode)
@@ -3532,6 +4535,13 @@ unsigned lodepng_get_color_profile(LodePNGColorProfile* profile,
   if(bpp <= 8) maxnumcolors = bpp == 1 ? 2 : (bpp == 2 ? 4 : (bpp == 4 ? 16 : 256));
 
   color_tree_init(&tree);
+  /*the colors of the earlier parts*/
+  for(i = 0; i < profile->numcolors && i != 256; ++i)
+  {
+    const unsigned char* p = &profile->palette[i * 4];
+    color_tree_add(&tree, p[0], p[1], p[2], p[3], (unsigned)i);
+  }
+  numcolors_done = profile->numcolors >= maxnumcolors;
 
   /*Check if the 16-bit input is truly 16-bit*/
   if(mode->bitdepth == 16)
@@ -3594,6 +4604,11 @@ unsigned lodepng_get_color_profile(LodePNGColorProfile* profile,
   }
   else /* < 16-bit */
   {
+    /*the key of the earlier parts, back to 8-bit*/
+    profile->key_r &= 255;
+    profile->key_g &= 255;
+    profile->key_b &= 255;
+
     for(i = 0; i != numpixels; ++i)
     {
       unsigned char r = 0, g = 0, b = 0, a = 0;
@@ -3682,14 +4697,23 @@ unsigned lodepng_auto_choose_color(LodePNGColorMode* mode_out,
 {
   LodePNGColorProfile prof;
   unsigned error = 0;
-  unsigned i, n, palettebits, grey_ok, palette_ok;
 
   lodepng_color_profile_init(&prof);
   error = lodepng_get_color_profile(&prof, image, w, h, mode_in);
   if(error) return error;
+  return lodepng_auto_choose_color_profile(mode_out, &prof, w * h, mode_in);
+}
+
+unsigned lodepng_auto_choose_color_profile(LodePNGColorMode* mode_out, const LodePNGColorProfile* profile,
+                                           size_t numpixels, const LodePNGColorMode* mode_in)
+{
+  LodePNGColorProfile prof = *profile;
+  unsigned error = 0;
+  unsigned i, n, palettebits, grey_ok, palette_ok;
+
   mode_out->key_defined = 0;
 
-  if(prof.key && w * h <= 16)
+  if(prof.key && numpixels <= 16)
   {
     prof.alpha = 1; /*too few pixels to justify tRNS chunk overhead*/
     if(prof.bits < 8) prof.bits = 8; /*PNG has no alphachannel modes with less than 8-bit per channel*/
@@ -3697,8 +4721,8 @@ unsigned lodepng_auto_choose_color(LodePNGColorMode* mode_out,
   grey_ok = !prof.colored && !prof.alpha; /*grey without alpha, with potentially low bits*/
   n = prof.numcolors;
   palettebits = n <= 2 ? 1 : (n <= 4 ? 2 : (n <= 16 ? 4 : 8));
-  palette_ok = n <= 256 && (n * 2 < w * h) && prof.bits <= 8;
-  if(w * h < n * 2) palette_ok = 0; /*don't add palette overhead if image has only a few pixels*/
+  palette_ok = n <= 256 && (n * 2 < numpixels) && prof.bits <= 8;
+  if(numpixels < n * 2) palette_ok = 0; /*don't add palette overhead if image has only a few pixels*/
   if(grey_ok && prof.bits <= palettebits) palette_ok = 0; /*grey is less overhead*/
 
   if(palette_ok)
@@ -5106,6 +6130,213 @@ static void filterScanline(unsigned char* out, const unsigned char* scanline, co
   }
 }
 
+/*the MINSUM score of a filtered scanline*/
+static size_t filterSum(const unsigned char* filtered, size_t length, unsigned char filterType)
+{
+  size_t x, sum = 0;
+  if(filterType == 0)
+  {
+    for(x = 0; x != length; ++x) sum += (unsigned char)(filtered[x]);
+  }
+  else
+  {
+    for(x = 0; x != length; ++x)
+    {
+      /*For differences, each byte should be treated as signed, values above 127 are negative
+      (converted to signed char). Filtertype 0 isn't a difference though, so use unsigned there.
+      This means filtertype 0 is almost never chosen, but that is justified.*/
+      unsigned char s = filtered[x];
+      sum += s < 128 ? s : (255U - s);
+    }
+  }
+  return sum;
+}
+
+/*filter a scanline and return its MINSUM score*/
+typedef size_t (*FilterFunction)(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+                                 size_t length, size_t bytewidth, unsigned char filterType);
+
+static size_t filterScanlineSum(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+                                size_t length, size_t bytewidth, unsigned char filterType)
+{
+  filterScanline(out, scanline, prevline, length, bytewidth, filterType);
+  return filterSum(out, length, filterType);
+}
+
+#ifdef LODEPNG_COMPILE_X86_SIMD
+
+/*
+One filtered byte, given the byte x, the byte a to the left of it, b above it and c above a, all 0
+where they are outside of the image. The SIMD versions use it for the first pixel and the end of the row.
+*/
+static unsigned char filterByte(unsigned char filterType, unsigned char x, unsigned char a, unsigned char b, unsigned char c)
+{
+  switch(filterType)
+  {
+    case 1: return (unsigned char)(x - a);
+    case 2: return (unsigned char)(x - b);
+    case 3: return (unsigned char)(x - (a + b) / 2);
+    case 4: return (unsigned char)(x - paethPredictor(a, b, c));
+    default: return x;
+  }
+}
+
+static size_t filterBytesSum(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+                             size_t begin, size_t end, size_t bytewidth, unsigned char filterType)
+{
+  size_t i;
+  for(i = begin; i < end; ++i)
+  {
+    unsigned char a = i >= bytewidth ? scanline[i - bytewidth] : 0;
+    unsigned char b = prevline ? prevline[i] : 0;
+    unsigned char c = prevline && i >= bytewidth ? prevline[i - bytewidth] : 0;
+    out[i] = filterByte(filterType, scanline[i], a, b, c);
+  }
+  return filterSum(&out[begin], end - begin, filterType);
+}
+
+/*
+16 bytes at a time. Average rounds down, where pavgb rounds up, so 1 is subtracted where a + b is odd.
+The Paeth predictor needs 16 bits for a + b - 2c, so it is done in two halves of 8 lanes. The score is
+the sum of the bytes, where the bytes of differences are first turned into their absolute value (minus
+one for negative ones, as in filterSum), and psadbw adds up the bytes of each half.
+*/
+__attribute__((target("sse2")))
+static size_t filterScanlineSum_sse2(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+                                     size_t length, size_t bytewidth, unsigned char filterType)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i sums = zero;
+  long long lanes[2];
+  size_t i = bytewidth < length ? bytewidth : length;
+  size_t sum = filterBytesSum(out, scanline, prevline, 0, i, bytewidth, filterType);
+
+  for(; i + 16 <= length; i += 16)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i*)&scanline[i]);
+    __m128i a = _mm_loadu_si128((const __m128i*)&scanline[i - bytewidth]);
+    __m128i b = prevline ? _mm_loadu_si128((const __m128i*)&prevline[i]) : zero;
+    __m128i c = prevline ? _mm_loadu_si128((const __m128i*)&prevline[i - bytewidth]) : zero;
+    __m128i result;
+    switch(filterType)
+    {
+      case 1: result = _mm_sub_epi8(x, a); break;
+      case 2: result = _mm_sub_epi8(x, b); break;
+      case 3:
+      {
+        __m128i odd = _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1));
+        result = _mm_sub_epi8(x, _mm_sub_epi8(_mm_avg_epu8(a, b), odd));
+        break;
+      }
+      case 4:
+      {
+        __m128i predictor[2];
+        int half;
+        for(half = 0; half != 2; ++half)
+        {
+          __m128i a16 = half ? _mm_unpackhi_epi8(a, zero) : _mm_unpacklo_epi8(a, zero);
+          __m128i b16 = half ? _mm_unpackhi_epi8(b, zero) : _mm_unpacklo_epi8(b, zero);
+          __m128i c16 = half ? _mm_unpackhi_epi8(c, zero) : _mm_unpacklo_epi8(c, zero);
+          __m128i bc = _mm_sub_epi16(b16, c16);
+          __m128i ac = _mm_sub_epi16(a16, c16);
+          __m128i abc = _mm_add_epi16(bc, ac);
+          __m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+          __m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+          __m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));
+          __m128i use_c = _mm_and_si128(_mm_cmpgt_epi16(pa, pc), _mm_cmpgt_epi16(pb, pc));
+          __m128i use_b = _mm_cmpgt_epi16(pa, pb);
+          __m128i ab = _mm_or_si128(_mm_and_si128(use_b, b16), _mm_andnot_si128(use_b, a16));
+          predictor[half] = _mm_or_si128(_mm_and_si128(use_c, c16), _mm_andnot_si128(use_c, ab));
+        }
+        result = _mm_sub_epi8(x, _mm_packus_epi16(predictor[0], predictor[1]));
+        break;
+      }
+      default: result = x; break;
+    }
+    _mm_storeu_si128((__m128i*)&out[i], result);
+    if(filterType != 0) result = _mm_xor_si128(result, _mm_cmpgt_epi8(zero, result));
+    sums = _mm_add_epi64(sums, _mm_sad_epu8(result, zero));
+  }
+
+  _mm_storeu_si128((__m128i*)lanes, sums);
+  sum += (size_t)(lanes[0] + lanes[1]);
+  return sum + filterBytesSum(out, scanline, prevline, i, length, bytewidth, filterType);
+}
+
+/*the same as the SSE2 version, 32 bytes at a time. The unpacks and the pack work within 128-bit lanes, so together they keep the order*/
+__attribute__((target("avx2")))
+static size_t filterScanlineSum_avx2(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+                                     size_t length, size_t bytewidth, unsigned char filterType)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i sums = zero;
+  long long lanes[4];
+  size_t i = bytewidth < length ? bytewidth : length;
+  size_t sum = filterBytesSum(out, scanline, prevline, 0, i, bytewidth, filterType);
+
+  for(; i + 32 <= length; i += 32)
+  {
+    __m256i x = _mm256_loadu_si256((const __m256i*)&scanline[i]);
+    __m256i a = _mm256_loadu_si256((const __m256i*)&scanline[i - bytewidth]);
+    __m256i b = prevline ? _mm256_loadu_si256((const __m256i*)&prevline[i]) : zero;
+    __m256i c = prevline ? _mm256_loadu_si256((const __m256i*)&prevline[i - bytewidth]) : zero;
+    __m256i result;
+    switch(filterType)
+    {
+      case 1: result = _mm256_sub_epi8(x, a); break;
+      case 2: result = _mm256_sub_epi8(x, b); break;
+      case 3:
+      {
+        __m256i odd = _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi8(1));
+        result = _mm256_sub_epi8(x, _mm256_sub_epi8(_mm256_avg_epu8(a, b), odd));
+        break;
+      }
+      case 4:
+      {
+        __m256i predictor[2];
+        int half;
+        for(half = 0; half != 2; ++half)
+        {
+          __m256i a16 = half ? _mm256_unpackhi_epi8(a, zero) : _mm256_unpacklo_epi8(a, zero);
+          __m256i b16 = half ? _mm256_unpackhi_epi8(b, zero) : _mm256_unpacklo_epi8(b, zero);
+          __m256i c16 = half ? _mm256_unpackhi_epi8(c, zero) : _mm256_unpacklo_epi8(c, zero);
+          __m256i bc = _mm256_sub_epi16(b16, c16);
+          __m256i ac = _mm256_sub_epi16(a16, c16);
+          __m256i pa = _mm256_abs_epi16(bc);
+          __m256i pb = _mm256_abs_epi16(ac);
+          __m256i pc = _mm256_abs_epi16(_mm256_add_epi16(bc, ac));
+          __m256i use_c = _mm256_and_si256(_mm256_cmpgt_epi16(pa, pc), _mm256_cmpgt_epi16(pb, pc));
+          __m256i ab = _mm256_blendv_epi8(a16, b16, _mm256_cmpgt_epi16(pa, pb));
+          predictor[half] = _mm256_blendv_epi8(ab, c16, use_c);
+        }
+        result = _mm256_sub_epi8(x, _mm256_packus_epi16(predictor[0], predictor[1]));
+        break;
+      }
+      default: result = x; break;
+    }
+    _mm256_storeu_si256((__m256i*)&out[i], result);
+    if(filterType != 0) result = _mm256_xor_si256(result, _mm256_cmpgt_epi8(zero, result));
+    sums = _mm256_add_epi64(sums, _mm256_sad_epu8(result, zero));
+  }
+
+  _mm256_storeu_si256((__m256i*)lanes, sums);
+  sum += (size_t)(lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+  return sum + filterBytesSum(out, scanline, prevline, i, length, bytewidth, filterType);
+}
+
+#endif /*LODEPNG_COMPILE_X86_SIMD*/
+
+/*the fastest version of filterScanlineSum that the CPU supports*/
+static FilterFunction selectFilterFunction(void)
+{
+#ifdef LODEPNG_COMPILE_X86_SIMD
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")) return filterScanlineSum_avx2;
+  if(__builtin_cpu_supports("sse2")) return filterScanlineSum_sse2;
+#endif /*LODEPNG_COMPILE_X86_SIMD*/
+  return filterScanlineSum;
+}
+
 /* log2 approximation. A slight bit faster than std::log. */
 static float flog2(float f)
 {
@@ -5115,46 +6346,24 @@ static float flog2(float f)
   return result + 1.442695f * (f * f * f / 3 - 3 * f * f / 2 + 3 * f - 1.83333f);
 }
 
-static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
-                       const LodePNGColorMode* info, const LodePNGEncoderSettings* settings)
+/*
+Filter the scanlines y0 up to y1 with one of the strategies that choose the filter of every scanline on
+its own. A scanline only depends on the unfiltered scanline above it, so bands of scanlines can be
+filtered at the same time. prevline is the scanline above scanline 0 of in, or 0 if there is none.
+*/
+static unsigned filterRows(unsigned char* out, const unsigned char* in, const unsigned char* prevline,
+                           unsigned y0, unsigned y1, size_t linebytes, size_t bytewidth,
+                           LodePNGFilterStrategy strategy, const LodePNGEncoderSettings* settings,
+                           FilterFunction filterFunction)
 {
-  /*
-  For PNG filter method 0
-  out must be a buffer with as size: h + (w * h * bpp + 7) / 8, because there are
-  the scanlines with 1 extra byte per scanline
-  */
-
-  unsigned bpp = lodepng_get_bpp(info);
-  /*the width of a scanline in bytes, not including the filter type*/
-  size_t linebytes = (w * bpp + 7) / 8;
-  /*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise*/
-  size_t bytewidth = (bpp + 7) / 8;
-  const unsigned char* prevline = 0;
-  unsigned x, y;
-  unsigned error = 0;
-  LodePNGFilterStrategy strategy = settings->filter_strategy;
-
-  /*
-  There is a heuristic called the minimum sum of absolute differences heuristic, suggested by the PNG standard:
-   *  If the image type is Palette, or the bit depth is smaller than 8, then do not filter the image (i.e.
-      use fixed filtering, with the filter None).
-   * (The other case) If the image type is Grayscale or RGB (with or without Alpha), and the bit depth is
-     not smaller than 8, then use adaptive filtering heuristic as follows: independently for each row, apply
-     all five filters and select the filter that produces the smallest sum of absolute values per row.
-  This heuristic is used if filter strategy is LFS_MINSUM and filter_palette_zero is true.
-
-  If filter_palette_zero is true and filter_strategy is not LFS_MINSUM, the above heuristic is followed,
-  but for "the other case", whatever strategy filter_strategy is set to instead of the minimum sum
-  heuristic is used.
-  */
-  if(settings->filter_palette_zero &&
-     (info->colortype == LCT_PALETTE || info->bitdepth < 8)) strategy = LFS_ZERO;
+  unsigned y;
+  size_t x;
 
-  if(bpp == 0) return 31; /*error: invalid color type*/
+  if(y0 != 0) prevline = &in[(y0 - 1) * linebytes];
 
   if(strategy == LFS_ZERO)
   {
-    for(y = 0; y != h; ++y)
+    for(y = y0; y != y1; ++y)
     {
       size_t outindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
       size_t inindex = linebytes * y;
@@ -5177,47 +6386,26 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
       if(!ucvector_resize(&attempt[type], linebytes)) return 83; /*alloc fail*/
     }
 
-    if(!error)
+    for(y = y0; y != y1; ++y)
     {
-      for(y = 0; y != h; ++y)
+      /*try the 5 filter types*/
+      for(type = 0; type != 5; ++type)
       {
-        /*try the 5 filter types*/
-        for(type = 0; type != 5; ++type)
-        {
-          filterScanline(attempt[type].data, &in[y * linebytes], prevline, linebytes, bytewidth, type);
+        sum[type] = filterFunction(attempt[type].data, &in[y * linebytes], prevline, linebytes, bytewidth, type);
 
-          /*calculate the sum of the result*/
-          sum[type] = 0;
-          if(type == 0)
-          {
-            for(x = 0; x != linebytes; ++x) sum[type] += (unsigned char)(attempt[type].data[x]);
-          }
-          else
-          {
-            for(x = 0; x != linebytes; ++x)
-            {
-              /*For differences, each byte should be treated as signed, values above 127 are negative
-              (converted to signed char). Filtertype 0 isn't a difference though, so use unsigned there.
-              This means filtertype 0 is almost never chosen, but that is justified.*/
-              unsigned char s = attempt[type].data[x];
-              sum[type] += s < 128 ? s : (255U - s);
-            }
-          }
-
-          /*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
-          if(type == 0 || sum[type] < smallest)
-          {
-            bestType = type;
-            smallest = sum[type];
-          }
+        /*check if this is smallest sum (or if type == 0 it's the first case so always store the values)*/
+        if(type == 0 || sum[type] < smallest)
+        {
+          bestType = type;
+          smallest = sum[type];
         }
+      }
 
-        prevline = &in[y * linebytes];
+      prevline = &in[y * linebytes];
 
-        /*now fill the out values*/
-        out[y * (linebytes + 1)] = bestType; /*the first byte of a scanline will be the filter type*/
-        for(x = 0; x != linebytes; ++x) out[y * (linebytes + 1) + 1 + x] = attempt[bestType].data[x];
-      }
+      /*now fill the out values*/
+      out[y * (linebytes + 1)] = bestType; /*the first byte of a scanline will be the filter type*/
+      for(x = 0; x != linebytes; ++x) out[y * (linebytes + 1) + 1 + x] = attempt[bestType].data[x];
     }
 
     for(type = 0; type != 5; ++type) ucvector_cleanup(&attempt[type]);
@@ -5236,12 +6424,12 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
       if(!ucvector_resize(&attempt[type], linebytes)) return 83; /*alloc fail*/
     }
 
-    for(y = 0; y != h; ++y)
+    for(y = y0; y != y1; ++y)
     {
       /*try the 5 filter types*/
       for(type = 0; type != 5; ++type)
       {
-        filterScanline(attempt[type].data, &in[y * linebytes], prevline, linebytes, bytewidth, type);
+        filterFunction(attempt[type].data, &in[y * linebytes], prevline, linebytes, bytewidth, type);
         for(x = 0; x != 256; ++x) count[x] = 0;
         for(x = 0; x != linebytes; ++x) ++count[attempt[type].data[x]];
         ++count[type]; /*the filter type itself is part of the scanline*/
@@ -5270,17 +6458,130 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
   }
   else if(strategy == LFS_PREDEFINED)
   {
-    for(y = 0; y != h; ++y)
+    for(y = y0; y != y1; ++y)
     {
       size_t outindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
       size_t inindex = linebytes * y;
       unsigned char type = settings->predefined_filters[y];
       out[outindex] = type; /*filter type byte*/
-      filterScanline(&out[outindex + 1], &in[inindex], prevline, linebytes, bytewidth, type);
+      filterFunction(&out[outindex + 1], &in[inindex], prevline, linebytes, bytewidth, type);
       prevline = &in[inindex];
     }
   }
-  else if(strategy == LFS_BRUTE_FORCE)
+  else return 88; /* unknown filter strategy */
+
+  return 0;
+}
+
+#ifdef LODEPNG_COMPILE_THREADS
+/*the scanlines of a filterRowsParallel call, in one band per thread*/
+typedef struct FilterRowsTask
+{
+  unsigned* errors;
+  size_t numbands;
+  unsigned char* out;
+  const unsigned char* in;
+  const unsigned char* prevline;
+  unsigned h;
+  size_t linebytes, bytewidth;
+  LodePNGFilterStrategy strategy;
+  const LodePNGEncoderSettings* settings;
+  FilterFunction filterFunction;
+} FilterRowsTask;
+
+static void filterRowsTask(void* context, size_t t)
+{
+  FilterRowsTask* task = (FilterRowsTask*)context;
+  if(t >= task->numbands) return;
+  task->errors[t] = filterRows(task->out, task->in, task->prevline, (unsigned)(task->h * t / task->numbands),
+                               (unsigned)(task->h * (t + 1) / task->numbands), task->linebytes, task->bytewidth,
+                               task->strategy, task->settings, task->filterFunction);
+}
+#endif /*LODEPNG_COMPILE_THREADS*/
+
+/*
+filterRows on all h scanlines, in one band of scanlines per thread of pool, or if pool is 0 of
+settings->zlibsettings.num_threads threads that are started for this call
+*/
+static unsigned filterRowsParallel(unsigned char* out, const unsigned char* in, const unsigned char* prevline,
+                                   unsigned h, size_t linebytes, size_t bytewidth,
+                                   LodePNGFilterStrategy strategy, const LodePNGEncoderSettings* settings,
+                                   ThreadPool* pool)
+{
+  FilterFunction filterFunction = selectFilterFunction();
+#ifdef LODEPNG_COMPILE_THREADS
+  size_t numbands = pool ? threadPoolSize(pool) : settings->zlibsettings.num_threads;
+  if(numbands > h) numbands = h;
+  if(numbands > 1)
+  {
+    std::vector<unsigned> errors(numbands, 0);
+    FilterRowsTask task;
+    ThreadPool* own = pool ? 0 : threadPoolCreate(numbands);
+    unsigned error = 0;
+    size_t t;
+    task.errors = &errors[0];
+    task.numbands = numbands;
+    task.out = out;
+    task.in = in;
+    task.prevline = prevline;
+    task.h = h;
+    task.linebytes = linebytes;
+    task.bytewidth = bytewidth;
+    task.strategy = strategy;
+    task.settings = settings;
+    task.filterFunction = filterFunction;
+    if(pool || own)
+    {
+      threadPoolRun(pool ? pool : own, filterRowsTask, &task);
+      threadPoolDestroy(own);
+      for(t = 0; t != numbands && !error; ++t) error = errors[t];
+      return error;
+    }
+  }
+#else /*LODEPNG_COMPILE_THREADS*/
+  (void)pool;
+#endif /*LODEPNG_COMPILE_THREADS*/
+  return filterRows(out, in, prevline, 0, h, linebytes, bytewidth, strategy, settings, filterFunction);
+}
+
+static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
+                       const LodePNGColorMode* info, const LodePNGEncoderSettings* settings)
+{
+  /*
+  For PNG filter method 0
+  out must be a buffer with as size: h + (w * h * bpp + 7) / 8, because there are
+  the scanlines with 1 extra byte per scanline
+  */
+
+  unsigned bpp = lodepng_get_bpp(info);
+  /*the width of a scanline in bytes, not including the filter type*/
+  size_t linebytes = (w * bpp + 7) / 8;
+  /*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise*/
+  size_t bytewidth = (bpp + 7) / 8;
+  const unsigned char* prevline = 0;
+  unsigned x, y;
+  unsigned error = 0;
+  LodePNGFilterStrategy strategy = settings->filter_strategy;
+
+  /*
+  There is a heuristic called the minimum sum of absolute differences heuristic, suggested by the PNG standard:
+   *  If the image type is Palette, or the bit depth is smaller than 8, then do not filter the image (i.e.
+      use fixed filtering, with the filter None).
+   * (The other case) If the image type is Grayscale or RGB (with or without Alpha), and the bit depth is
+     not smaller than 8, then use adaptive filtering heuristic as follows: independently for each row, apply
+     all five filters and select the filter that produces the smallest sum of absolute values per row.
+  This heuristic is used if filter strategy is LFS_MINSUM and filter_palette_zero is true.
+
+  If filter_palette_zero is true and filter_strategy is not LFS_MINSUM, the above heuristic is followed,
+  but for "the other case", whatever strategy filter_strategy is set to instead of the minimum sum
+  heuristic is used.
+  */
+  if(settings->filter_palette_zero &&
+     (info->colortype == LCT_PALETTE || info->bitdepth < 8)) strategy = LFS_ZERO;
+
+  if(bpp == 0) return 31; /*error: invalid color type*/
+
+  if(strategy == LFS_BRUTE_FORCE)
   {
     /*brute force filter chooser.
     deflate the scanline after every filter attempt to see which one deflates best.
@@ -5330,7 +6631,10 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
     }
     for(type = 0; type != 5; ++type) ucvector_cleanup(&attempt[type]);
   }
-  else return 88; /* unknown filter strategy */
+  else
+  {
+    error = filterRowsParallel(out, in, 0, h, linebytes, bytewidth, strategy, settings, 0);
+  }
 
   return error;
 }
@@ -5788,6 +7092,383 @@ unsigned lodepng_encode24_file(const char* filename, const unsigned char* image,
 }
 #endif /*LODEPNG_COMPILE_DISK*/
 
+#if defined(LODEPNG_COMPILE_DISK) && defined(LODEPNG_COMPILE_ZLIB)
+/*the size of the data of the IDAT chunks that the stream encoder writes, except the last one*/
+static const size_t STREAM_IDAT_SIZE = 65536;
+
+/*the thread that writes the file of a stream encoder, see streamWriterLoop*/
+typedef struct StreamWriter StreamWriter;
+
+struct LodePNGStreamEncoder
+{
+  FILE* file;
+  LodePNGColorMode color; /*the color mode of the PNG*/
+  LodePNGColorMode info_raw; /*the color mode of the pushed scanlines*/
+  LodePNGEncoderSettings settings;
+  LodePNGFilterStrategy strategy;
+  unsigned w, h, y; /*y is the number of scanlines pushed so far*/
+  size_t linebytes, bytewidth;
+  ucvector prevline; /*the last pushed scanline, unfiltered, in the color mode of the PNG*/
+  ucvector converted; /*the pushed scanlines converted to the color mode of the PNG*/
+  ucvector padded; /*the same with padding bits, if bpp < 8 and the scanlines do not end on a byte*/
+  ucvector filtered; /*the window, which was deflated already, followed by the filtered data that was not*/
+  size_t windowend; /*the size of the window at the start of filtered*/
+  ucvector zlibdata; /*the compressed data that is not in an IDAT chunk yet*/
+  unsigned adler;
+  size_t filesize;
+  unsigned error;
+  ThreadPool* pool; /*the threads that filter and deflate the pushed scanlines, 0 without threads*/
+  StreamWriter* writer; /*0 if the chunks are written right away*/
+};
+
+#ifdef LODEPNG_COMPILE_THREADS
+/*the most bytes that may wait for the writer thread, unless a single buffer is larger*/
+static const size_t STREAM_WRITE_QUEUE_SIZE = 16 * STREAM_IDAT_SIZE;
+
+struct StreamWriter
+{
+  std::thread thread;
+  std::mutex mutex;
+  std::condition_variable changed;
+  std::deque<ucvector> queue; /*the buffers to write, in order*/
+  size_t queued; /*the bytes in the queue*/
+  FILE* file;
+  unsigned error;
+  bool stop;
+};
+
+/*
+Write the buffers of the queue to the file while the encoder filters and deflates the next scanlines, until
+the queue is empty and stop is set.
+*/
+static void streamWriterLoop(StreamWriter* writer)
+{
+  std::unique_lock<std::mutex> lock(writer->mutex);
+  for(;;)
+  {
+    ucvector buffer;
+    unsigned failed;
+    while(writer->queue.empty() && !writer->stop) writer->changed.wait(lock);
+    if(writer->queue.empty()) return;
+    buffer = writer->queue.front();
+    writer->queue.pop_front();
+    lock.unlock();
+    failed = fwrite(buffer.data, 1, buffer.size, writer->file) != buffer.size;
+    lock.lock();
+    if(failed && !writer->error) writer->error = 96;
+    writer->queued -= buffer.size;
+    ucvector_cleanup(&buffer);
+    writer->changed.notify_all();
+  }
+}
+
+/*let the writer write what is in its queue and end, and keep its error*/
+static void streamEncoderStopWriter(LodePNGStreamEncoder* encoder)
+{
+  StreamWriter* writer = encoder->writer;
+  if(!writer) return;
+  {
+    std::lock_guard<std::mutex> lock(writer->mutex);
+    writer->stop = true;
+  }
+  writer->changed.notify_all();
+  writer->thread.join();
+  if(!encoder->error) encoder->error = writer->error;
+  delete writer;
+  encoder->writer = 0;
+}
+#endif /*LODEPNG_COMPILE_THREADS*/
+
+/*write the bytes of buffer after the ones before, and free it*/
+static void streamEncoderWrite(LodePNGStreamEncoder* encoder, ucvector* buffer)
+{
+#ifdef LODEPNG_COMPILE_THREADS
+  StreamWriter* writer = encoder->writer;
+  if(writer && !encoder->error)
+  {
+    /*wait while the queue is full, the file cannot be written faster than that anyway*/
+    std::unique_lock<std::mutex> lock(writer->mutex);
+    while(!writer->queue.empty() && writer->queued + buffer->size > STREAM_WRITE_QUEUE_SIZE)
+    {
+      writer->changed.wait(lock);
+    }
+    encoder->error = writer->error;
+    if(!encoder->error)
+    {
+      writer->queue.push_back(*buffer);
+      writer->queued += buffer->size;
+      encoder->filesize += buffer->size;
+      ucvector_init(buffer); /*the writer frees it*/
+      writer->changed.notify_all();
+    }
+  }
+#endif /*LODEPNG_COMPILE_THREADS*/
+  if(!encoder->writer && !encoder->error)
+  {
+    if(fwrite(buffer->data, 1, buffer->size, encoder->file) != buffer->size) encoder->error = 96;
+    encoder->filesize += buffer->size;
+  }
+  ucvector_cleanup(buffer);
+}
+
+static void streamEncoderWriteChunk(LodePNGStreamEncoder* encoder, const char* type,
+                                    const unsigned char* data, size_t size)
+{
+  ucvector chunk;
+  ucvector_init(&chunk);
+  if(!encoder->error) encoder->error = addChunk(&chunk, type, data, size);
+  streamEncoderWrite(encoder, &chunk);
+}
+
+/*write the compressed data in IDAT chunks of STREAM_IDAT_SIZE, and also the rest if all is set*/
+static void streamEncoderWriteIDAT(LodePNGStreamEncoder* encoder, unsigned all)
+{
+  size_t pos = 0, i;
+  ucvector chunks;
+  ucvector_init(&chunks);
+  while(!encoder->error && encoder->zlibdata.size - pos >= STREAM_IDAT_SIZE)
+  {
+    encoder->error = addChunk(&chunks, "IDAT", &encoder->zlibdata.data[pos], STREAM_IDAT_SIZE);
+    pos += STREAM_IDAT_SIZE;
+  }
+  if(!encoder->error && all && pos != encoder->zlibdata.size)
+  {
+    encoder->error = addChunk(&chunks, "IDAT", &encoder->zlibdata.data[pos], encoder->zlibdata.size - pos);
+    pos = encoder->zlibdata.size;
+  }
+  /*all IDAT chunks of one push go to the writer at once*/
+  if(chunks.size != 0) streamEncoderWrite(encoder, &chunks);
+  else ucvector_cleanup(&chunks);
+  for(i = pos; i != encoder->zlibdata.size; ++i) encoder->zlibdata.data[i - pos] = encoder->zlibdata.data[i];
+  encoder->zlibdata.size -= pos;
+}
+
+/*
+Deflate the whole chunks of filtered data once there is one for every thread, or everything if final is set.
+What deflateChunkRange gets is the same as in lodepng_zlib_compress, because the window that is kept is
+windowsize bytes, and the chunks are a multiple of that, so the positions in the hash table are the same.
+*/
+static void streamEncoderDeflate(LodePNGStreamEncoder* encoder, unsigned final)
+{
+  const LodePNGCompressSettings* zlibsettings = &encoder->settings.zlibsettings;
+  size_t numchunks = (encoder->filtered.size - encoder->windowend) / DEFLATE_CHUNK_SIZE;
+  size_t end = encoder->windowend + numchunks * DEFLATE_CHUNK_SIZE, i;
+
+  if(encoder->error) return;
+  if(final) end = encoder->filtered.size;
+  else if(numchunks == 0 || numchunks < zlibsettings->num_threads) return;
+
+  encoder->error = deflateChunkRange(&encoder->zlibdata, &encoder->adler, encoder->filtered.data,
+                                     encoder->windowend, end, final, zlibsettings, encoder->pool);
+  if(encoder->error || final) return;
+
+  /*keep the last windowsize bytes that were deflated as the window of the next chunk*/
+  for(i = end - zlibsettings->windowsize; i != encoder->filtered.size; ++i)
+  {
+    encoder->filtered.data[i - (end - zlibsettings->windowsize)] = encoder->filtered.data[i];
+  }
+  encoder->filtered.size -= end - zlibsettings->windowsize;
+  encoder->windowend = zlibsettings->windowsize;
+}
+
+static void streamEncoderFree(LodePNGStreamEncoder* encoder)
+{
+#ifdef LODEPNG_COMPILE_THREADS
+  streamEncoderStopWriter(encoder);
+  threadPoolDestroy(encoder->pool);
+#endif /*LODEPNG_COMPILE_THREADS*/
+  if(encoder->file) fclose(encoder->file);
+  lodepng_color_mode_cleanup(&encoder->color);
+  lodepng_color_mode_cleanup(&encoder->info_raw);
+  ucvector_cleanup(&encoder->prevline);
+  ucvector_cleanup(&encoder->converted);
+  ucvector_cleanup(&encoder->padded);
+  ucvector_cleanup(&encoder->filtered);
+  ucvector_cleanup(&encoder->zlibdata);
+  lodepng_free(encoder);
+}
+
+unsigned lodepng_stream_encoder_open(LodePNGStreamEncoder** encoder, const char* filename,
+                                     unsigned w, unsigned h, const LodePNGState* state)
+{
+  LodePNGStreamEncoder* e;
+  const LodePNGColorMode* color = &state->info_png.color;
+  unsigned error = 0;
+  unsigned bpp;
+  ucvector header;
+
+  *encoder = 0;
+  if((color->colortype == LCT_PALETTE || state->encoder.force_palette)
+      && (color->palettesize == 0 || color->palettesize > 256)) return 68; /*invalid palette size*/
+  if(state->encoder.zlibsettings.btype == 0) return 97;
+  if(state->encoder.zlibsettings.btype > 2) return 61; /*error: unexisting btype*/
+  if(state->encoder.zlibsettings.windowsize == 0 || state->encoder.zlibsettings.windowsize > 32768) return 60;
+  if((state->encoder.zlibsettings.windowsize & (state->encoder.zlibsettings.windowsize - 1)) != 0) return 90;
+  if(state->info_png.interlace_method != 0) return 94;
+  if(w == 0 || h == 0) return 93;
+  CERROR_TRY_RETURN(checkColorValidity(color->colortype, color->bitdepth));
+  CERROR_TRY_RETURN(checkColorValidity(state->info_raw.colortype, state->info_raw.bitdepth));
+
+  e = (LodePNGStreamEncoder*)lodepng_malloc(sizeof(LodePNGStreamEncoder));
+  if(!e) return 83; /*alloc fail*/
+  lodepng_color_mode_init(&e->color);
+  lodepng_color_mode_init(&e->info_raw);
+  ucvector_init(&e->prevline);
+  ucvector_init(&e->converted);
+  ucvector_init(&e->padded);
+  ucvector_init(&e->filtered);
+  ucvector_init(&e->zlibdata);
+  e->settings = state->encoder;
+  e->w = w;
+  e->h = h;
+  e->y = 0;
+  e->windowend = 0;
+  e->adler = 1;
+  e->filesize = 0;
+  e->error = 0;
+  e->pool = 0;
+  e->writer = 0;
+
+  error = lodepng_color_mode_copy(&e->color, color);
+  if(!error) error = lodepng_color_mode_copy(&e->info_raw, &state->info_raw);
+
+  bpp = lodepng_get_bpp(&e->color);
+  e->linebytes = ((size_t)w * bpp + 7) / 8;
+  e->bytewidth = (bpp + 7) / 8;
+  /*the strategies filter() uses, except that brute force needs the whole image*/
+  e->strategy = e->settings.filter_strategy == LFS_BRUTE_FORCE ? LFS_MINSUM : e->settings.filter_strategy;
+  if(e->settings.filter_palette_zero && (e->color.colortype == LCT_PALETTE || e->color.bitdepth < 8))
+  {
+    e->strategy = LFS_ZERO;
+  }
+  if(!error && !ucvector_resizev(&e->prevline, e->linebytes, 0)) error = 83; /*alloc fail*/
+
+  e->file = error ? 0 : fopen(filename, "wb");
+  if(!error && !e->file) error = 79;
+#ifdef LODEPNG_COMPILE_THREADS
+  /*the threads are started once, and the file is written on a thread of its own*/
+  if(!error && e->settings.zlibsettings.num_threads != 0)
+  {
+    e->pool = threadPoolCreate(e->settings.zlibsettings.num_threads);
+    e->writer = new (std::nothrow) StreamWriter;
+    if(!e->pool || !e->writer)
+    {
+      delete e->writer;
+      e->writer = 0;
+      error = 83; /*alloc fail*/
+    }
+    else
+    {
+      e->writer->queued = 0;
+      e->writer->file = e->file;
+      e->writer->error = 0;
+      e->writer->stop = false;
+      e->writer->thread = std::thread(streamWriterLoop, e->writer);
+    }
+  }
+#endif /*LODEPNG_COMPILE_THREADS*/
+  if(error)
+  {
+    streamEncoderFree(e);
+    return error;
+  }
+
+  /*the same chunks before IDAT as lodepng_encode*/
+  ucvector_init(&header);
+  writeSignature(&header);
+  addChunk_IHDR(&header, w, h, e->color.colortype, e->color.bitdepth, 0);
+  if(e->color.colortype == LCT_PALETTE) addChunk_PLTE(&header, &e->color);
+  if(e->settings.force_palette && (e->color.colortype == LCT_RGB || e->color.colortype == LCT_RGBA))
+  {
+    addChunk_PLTE(&header, &e->color);
+  }
+  if(e->color.colortype == LCT_PALETTE && getPaletteTranslucency(e->color.palette, e->color.palettesize) != 0)
+  {
+    addChunk_tRNS(&header, &e->color);
+  }
+  if((e->color.colortype == LCT_GREY || e->color.colortype == LCT_RGB) && e->color.key_defined)
+  {
+    addChunk_tRNS(&header, &e->color);
+  }
+  streamEncoderWrite(e, &header);
+
+  /*the zlib header, as in lodepng_zlib_compress: CM 8, CINFO 7 and FCHECK*/
+  ucvector_push_back(&e->zlibdata, 120);
+  if(!ucvector_push_back(&e->zlibdata, 1)) e->error = 83; /*alloc fail*/
+
+  error = e->error;
+  if(error) streamEncoderFree(e);
+  else *encoder = e;
+  return error;
+}
+
+unsigned lodepng_stream_encoder_push(LodePNGStreamEncoder* encoder, const unsigned char* rows, unsigned numrows)
+{
+  LodePNGEncoderSettings settings = encoder->settings;
+  const unsigned char* in = rows;
+  unsigned bpp = lodepng_get_bpp(&encoder->color);
+  size_t linebytes = encoder->linebytes, start = encoder->filtered.size, x;
+
+  if(encoder->error || numrows == 0) return encoder->error;
+  if(numrows > encoder->h - encoder->y) return encoder->error = 95;
+
+  if(!lodepng_color_mode_equal(&encoder->info_raw, &encoder->color))
+  {
+    if(!ucvector_resize(&encoder->converted, ((size_t)encoder->w * numrows * bpp + 7) / 8))
+    {
+      return encoder->error = 83; /*alloc fail*/
+    }
+    encoder->error = lodepng_convert(encoder->converted.data, in, &encoder->color, &encoder->info_raw,
+                                     encoder->w, numrows);
+    if(encoder->error) return encoder->error;
+    in = encoder->converted.data;
+  }
+  if(bpp < 8 && encoder->w * bpp != linebytes * 8)
+  {
+    if(!ucvector_resize(&encoder->padded, linebytes * numrows)) return encoder->error = 83; /*alloc fail*/
+    addPaddingBits(encoder->padded.data, in, linebytes * 8, (size_t)encoder->w * bpp, numrows);
+    in = encoder->padded.data;
+  }
+
+  if(!ucvector_resize(&encoder->filtered, start + (linebytes + 1) * numrows))
+  {
+    return encoder->error = 83; /*alloc fail*/
+  }
+  if(settings.predefined_filters) settings.predefined_filters += encoder->y;
+  encoder->error = filterRowsParallel(&encoder->filtered.data[start], in,
+                                      encoder->y != 0 ? encoder->prevline.data : 0, numrows,
+                                      linebytes, encoder->bytewidth, encoder->strategy, &settings, encoder->pool);
+  if(encoder->error) return encoder->error;
+  for(x = 0; x != linebytes; ++x) encoder->prevline.data[x] = in[(numrows - 1) * linebytes + x];
+  encoder->y += numrows;
+
+  streamEncoderDeflate(encoder, 0);
+  streamEncoderWriteIDAT(encoder, 0);
+  return encoder->error;
+}
+
+unsigned lodepng_stream_encoder_finish(LodePNGStreamEncoder* encoder, size_t* filesize)
+{
+  unsigned error;
+
+  if(!encoder->error && encoder->y != encoder->h) encoder->error = 95;
+  streamEncoderDeflate(encoder, 1);
+  if(!encoder->error) lodepng_add32bitInt(&encoder->zlibdata, encoder->adler);
+  streamEncoderWriteIDAT(encoder, 1);
+  streamEncoderWriteChunk(encoder, "IEND", 0, 0);
+#ifdef LODEPNG_COMPILE_THREADS
+  streamEncoderStopWriter(encoder);
+#endif /*LODEPNG_COMPILE_THREADS*/
+
+  if(fclose(encoder->file) != 0 && !encoder->error) encoder->error = 96;
+  encoder->file = 0;
+  if(filesize) *filesize = encoder->filesize;
+  error = encoder->error;
+  streamEncoderFree(encoder);
+  return error;
+}
+#endif /*defined(LODEPNG_COMPILE_DISK) && defined(LODEPNG_COMPILE_ZLIB)*/
+
 void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings)
 {
   lodepng_compress_settings_init(&settings->zlibsettings);
@@ -5907,6 +7588,10 @@ const char* lodepng_error_text(unsigned code)
     case 91: return "invalid decompressed idat size";
     case 92: return "too many pixels, not supported";
     case 93: return "zero width or height is invalid";
+    case 94: return "the stream encoder does not support interlacing";
+    case 95: return "the stream encoder was not given exactly h scanlines";
+    case 96: return "failed to write to file";
+    case 97: return "the stream encoder does not support BTYPE 0";
   }
   return "unknown error code";
 }
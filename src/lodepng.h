@@ -83,6 +83,13 @@ source files with custom allocators.*/
 #define LODEPNG_COMPILE_CPP
 #endif
 #endif
+/*deflate independent chunks on several threads, see num_threads of LodePNGCompressSettings
+(needs std::thread, so only with the C++ version. Without it, the chunks are deflated one by one)*/
+#ifdef LODEPNG_COMPILE_CPP
+#ifndef LODEPNG_NO_COMPILE_THREADS
+#define LODEPNG_COMPILE_THREADS
+#endif
+#endif
 
 #ifdef LODEPNG_COMPILE_PNG
 /*The PNG color types (also used for raw).*/
@@ -274,6 +281,31 @@ void lodepng_decompress_settings_init(LodePNGDecompressSettings* settings);
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
+/*
+Bump allocator for the temporary buffers of the deflate code: the LZ77 symbols, the code lengths and
+frequencies of every block, and the hash tables. They come from one region, and are all given back at
+once when a deflate call ends, so encoding many images does not allocate and free them over and over.
+Buffers that are returned to the caller never come from it. When the region is too small, the heap is
+used, and the next lodepng_arena_reset grows the region to what the largest encode since needed.
+Every thread of num_threads uses an arena of its own, that is kept in next.
+*/
+typedef struct LodePNGArena
+{
+  unsigned char* data; /*the region*/
+  size_t size; /*the size of the region*/
+  size_t used; /*the bytes at the start of the region that are in use*/
+  size_t last; /*where the last allocation starts, which can still grow in place if it is below used*/
+  size_t heapsize; /*the bytes in use that did not fit in the region*/
+  size_t peak; /*the most bytes in use at once since the last reset*/
+  struct LodePNGArena* next; /*the arena of the next thread*/
+} LodePNGArena;
+
+void lodepng_arena_init(LodePNGArena* arena);
+/*Make the whole region free again, and grow it to the peak use if that did not fit. Not while an
+encoder uses the arena.*/
+void lodepng_arena_reset(LodePNGArena* arena);
+void lodepng_arena_cleanup(LodePNGArena* arena);
+
 /*
 Settings for zlib compression. Tweaking these settings tweaks the balance
 between speed and compression ratio.
@@ -289,6 +321,18 @@ struct LodePNGCompressSettings /*deflate = compress*/
   unsigned nicematch; /*stop searching if >= this length found. Set to 258 for best compression. Default: 128*/
   unsigned lazymatching; /*use lazy matching: better compression but a bit slower. Default: true*/
 
+  /*If not 0, the zlib data is deflated in independent chunks of 256 KiB that are deflated on this
+  many threads at once, as pigz does. Every chunk may still refer to the window before it, and
+  ends on a byte boundary with an empty stored block, so the chunks join into one stream. The
+  output only depends on whether this is 0, not on the number of threads. Only used by the built in
+  zlib function, when there is no custom_deflate. The PNG encoder also filters bands of scanlines on
+  this many threads, which does not change its output. Default: 0*/
+  unsigned num_threads;
+
+  /*If not 0, the temporary buffers of the deflate code come from this arena, see LodePNGArena. It may
+  only be used by one encoder at a time. Default: 0*/
+  LodePNGArena* arena;
+
   /*use custom zlib encoder instead of built in one (default: null)*/
   unsigned (*custom_zlib)(unsigned char**, size_t*,
                           const unsigned char*, size_t,
@@ -569,7 +613,8 @@ typedef struct LodePNGColorProfile
 
 void lodepng_color_profile_init(LodePNGColorProfile* profile);
 
-/*Get a LodePNGColorProfile of the image.*/
+/*Get a LodePNGColorProfile of the image. If the profile already has pixels, the pixels of
+this image are added to them, so the profile of a large image can be taken in bands of rows.*/
 unsigned lodepng_get_color_profile(LodePNGColorProfile* profile,
                                    const unsigned char* image, unsigned w, unsigned h,
                                    const LodePNGColorMode* mode_in);
@@ -578,6 +623,9 @@ Chooses an optimal color model, e.g. grey if only grey pixels, palette if < 256
 unsigned lodepng_auto_choose_color(LodePNGColorMode* mode_out,
                                    const unsigned char* image, unsigned w, unsigned h,
                                    const LodePNGColorMode* mode_in);
+/*The same, for an image of numpixels pixels of which the profile was taken already.*/
+unsigned lodepng_auto_choose_color_profile(LodePNGColorMode* mode_out, const LodePNGColorProfile* profile,
+                                           size_t numpixels, const LodePNGColorMode* mode_in);
 
 /*Settings for the encoder.*/
 typedef struct LodePNGEncoderSettings
@@ -665,6 +713,46 @@ unsigned lodepng_inspect(unsigned* w, unsigned* h,
 unsigned lodepng_encode(unsigned char** out, size_t* outsize,
                         const unsigned char* image, unsigned w, unsigned h,
                         LodePNGState* state);
+
+#if defined(LODEPNG_COMPILE_DISK) && defined(LODEPNG_COMPILE_ZLIB)
+/*
+Encoder that writes a PNG file while the scanlines are pushed into it, so the image never has to be
+in memory at once. The pushed scanlines are filtered and deflated as they come in, and the compressed
+data is written in IDAT chunks of 64 KiB. Memory use is bounded by the scanlines of one push, plus
+256 KiB of filtered data per thread of zlibsettings.num_threads, plus 1 MiB of IDAT chunks.
+
+The threads of zlibsettings.num_threads are started when the encoder is opened, and used for every push.
+The IDAT chunks are written to the file by another thread, while the next scanlines are filtered and
+deflated. With num_threads 0, everything is done on the thread that pushes.
+
+The state is used as by lodepng_encode, with these differences:
+*) auto_convert is not done, since that needs all pixels. Call lodepng_auto_choose_color on the whole
+   image first, or set info_png.color yourself.
+*) interlace_method must be 0, zlibsettings.btype must be 1 or 2, and custom_zlib and custom_deflate
+   are not used. The zlib data is always deflated in chunks, as when zlibsettings.num_threads is not 0.
+*) LFS_BRUTE_FORCE is done as LFS_MINSUM. The ancillary chunks of info_png are not written.
+*/
+typedef struct LodePNGStreamEncoder LodePNGStreamEncoder;
+
+/*
+Create the file and write the chunks before the image data. On error, no encoder is returned.
+NOTE: This overwrites existing files without warning!
+*/
+unsigned lodepng_stream_encoder_open(LodePNGStreamEncoder** encoder, const char* filename,
+                                     unsigned w, unsigned h, const LodePNGState* state);
+
+/*
+Push the next numrows scanlines. They are in the color mode state->info_raw, packed like an image of
+w * numrows pixels. Returns the first error of the encoder, after which pushing does nothing.
+*/
+unsigned lodepng_stream_encoder_push(LodePNGStreamEncoder* encoder, const unsigned char* rows, unsigned numrows);
+
+/*
+Write the rest of the file once all h scanlines are pushed, close it and free the encoder, also if there
+was an error, in which case the file is incomplete. filesize may be 0, or receives the size of the file.
+*/
+unsigned lodepng_stream_encoder_finish(LodePNGStreamEncoder* encoder, size_t* filesize);
+#endif /*defined(LODEPNG_COMPILE_DISK) && defined(LODEPNG_COMPILE_ZLIB)*/
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
 /*
@@ -58,6 +58,17 @@ const struct
  */
 #include "lodepng.h"
 
+#include "ft_check.h"
+#include "amfb_writer.h"
+#include "kerning.h"
+#include "blit.h"
+#include "cache.h"
+#include "charset.h"
+#include "glyph_store.h"
+#include "options.h"
+#include "packer.h"
+#include "png_encode.h"
+
 /*
   Include standard library headers.
  */
@@ -65,6 +76,9 @@ const struct
 #include <stdio.h>
 #include <string>
 #include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
 
 using std::string;
 
@@ -74,252 +88,510 @@ using std::string;
 */
 
 /*
-  If no FT error, do nothing.
-  Else, print FT error message, and shut down.
+  Copy the rows of the glyph bitmap that fall into a band of atlas rows into the band buffer. The band
+  holds the rows band_y up to band_y + band_rows, and the glyph starts at the pixel coordinates (start_x,start_y).
+ */
+void copy_font_bitmap(unsigned char band_buffer[], unsigned int atlas_width, unsigned int band_y, unsigned int band_rows,
+		      AtlasFormat format, const GlyphStore& store, const Glyph& glyph,
+		      unsigned int start_x, unsigned int start_y);
+
+/*
+  The glyphs of an atlas page, bucketed by the bands of PNG_BAND_ROWS rows that their bitmaps overlap,
+  so that the page can be composed a band at a time.
 */
-void check_ft_error(const FT_Error error, const char* filename, const int line);
+struct AtlasBands {
+    AtlasFormat format;
+    unsigned int width;
+    const GlyphStore* store;
+    const std::vector<PackRect>* rects;
+
+    // for every band, the indices of the glyphs that have rows in it.
+    std::vector<std::vector<unsigned int>> glyphs;
+};
 
 /*
-  Copy the font bitmap into the atlas buffer, starting at the pixel coordinates (start_x,start_y)
- */
-void copy_font_bitmap(unsigned char atlas_buffer[], FT_Bitmap bitmap,
-		      unsigned int start_x, unsigned int start_y);
+  Compose a band of an atlas page, for encode_png_bands. context is the AtlasBands of the page.
+*/
+void compose_atlas_band(unsigned char* band, unsigned int y, unsigned int rows, void* context);
+
+/*
+  How the glyph bitmaps of an atlas format are copied into the atlas.
+*/
+BlitMode atlas_blit_mode(AtlasFormat format);
+
+/*
+  Choose the color mode of the image file of an atlas page, as lodepng would for the whole image, from
+  the glyph bitmaps on the page and the background around them. The atlas is composed only once, while
+  it is encoded. Returns the lodepng error code.
+*/
+unsigned choose_atlas_color_mode(AtlasFormat format, const GlyphStore& store, const PackPage& page,
+				 bool has_background, LodePNGColorMode& mode);
 
 // Strip the file extension from a file name.
 // If for instance str = "file.txt", then "file" will be returned.
 string strip_file_extension(const string& str);
 
 /*
-Given the maximum width and height of all characters bitmaps, find an atlas size
-that will fit all characters, yet is, approximately, as small as possible.
- */
-unsigned int find_atlas_size(unsigned int max_width, unsigned int max_height);
+  The end of the name of the image file of an atlas page, that follows the output file prefix.
+  If there is only one page, the page number is left out.
+*/
+string page_file_suffix(size_t page, size_t num_pages);
 
-void print_help();
+/*
+  Create the atlas images and the .amf-file for one font size. The names of all the created
+  files start with output_file_prefix, and the rest of their names are put in file_suffixes.
+*/
+void generate_atlas(const AtlasOptions& options, FontFaces& faces, FT_F26Dot6 font_size,
+		    const std::vector<unsigned int>& codepoints, const string& output_file_prefix,
+		    std::vector<string>& file_suffixes);
 
 /*
-  FreeType-Check
+  The header and the glyph records of the binary metrics of an atlas.
+*/
+AmfbHeader amfb_header(const AtlasOptions& options, FT_F26Dot6 font_size, const GlyphStore& store, size_t num_pages);
+std::vector<AmfbGlyph> amfb_glyphs(const GlyphStore& store, const std::vector<PackRect>& rects);
+std::vector<AmfbKerningPair> amfb_kerning_pairs(const std::vector<KerningPair>& pairs);
 
-  Macro used for handling when FT functions return error codes.
+/*
+  Create the atlases for all the font sizes in the options. The font file is only read and
+  parsed once. Returns the name of the first image that was created.
 */
-#define FT_C(stmt) do {					\
-	FT_Error error = stmt;				\
-	check_ft_error(error, __FILE__, __LINE__);	\
-    } while (0)
+string run_job(const AtlasOptions& options, unsigned int num_threads);
 
+/*
+  Run all the jobs in the batch file, several at a time.
+*/
+void run_batch(const AtlasOptions& options);
 
-// horizontal and vertical resolution in DPI
-#define RESOLUTION 72
 
+int main(int argc, char *argv[] ) {
 
-#define START_CHAR 32
-#define END_CHAR 126 // 90
+    /*
+      Parse command line arguments:
+     */
 
+    if(argc < 2) { // not enough arguments.
+	print_help();
+	exit(1);
+    }
 
-/*
-#define START_CHAR 100
-#define END_CHAR 120 // 90
-*/
+    AtlasOptions options;
 
-#define FONT_SIZE_DEFALT 64
+    if(!parse_options(std::vector<string>(argv + 1, argv + argc), options)) {
+	exit(1);
+    }
 
+    if(!options.amf_to_convert.empty()) {
+	const string amfb_file = strip_file_extension(options.amf_to_convert) + ".amfb";
+	return convert_amf_to_amfb(options.amf_to_convert, amfb_file) ? 0 : 1;
+    }
 
-/*
-  Global variables.
- */
-unsigned int atlas_width;
-unsigned int atlas_height;
+    if(!options.batch_file.empty()) {
+	run_batch(options);
+	return 0;
+    }
 
-int main(int argc, char *argv[] ) {
+    if(options.input_file.empty()) {
+	printf("ERROR: no input file has been provided\n");
+	exit(1);
+    }
+
+    const string image_file = run_job(options, options.num_threads);
 
-    // the font size to use for the atlas.
-    FT_F26Dot6 font_size = FONT_SIZE_DEFALT;
+     system(("open " + image_file).c_str() );
+}
+
+string run_job(const AtlasOptions& options, unsigned int num_threads) {
 
+    const string& input_file = options.input_file;
 
     /*
-      Parse command line arguments:
+      Load the font file.
      */
 
-    if(argc < 2) { // not enough arguments.
-	print_help();
+    // the file is only read once. Every rendering thread creates its own face from this data.
+    std::vector<unsigned char> font_data;
+    lodepng::load_file(font_data, input_file);
+
+    if(font_data.empty()) {
+	printf("ERROR: could not read the font file %s\n", input_file.c_str());
 	exit(1);
     }
 
-    for (int i = 1; i < argc; i++) {
+    std::vector<unsigned int> codepoints;
+    build_charset(options.char_ranges, codepoints);
 
-	if(strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0  ) {
-	    print_help();
-	    exit(0);
-	} else if(strcmp(argv[i], "-fs") == 0 || strcmp(argv[i], "--font-size") == 0  ) {
-	    if( (i+1) == argc ) {
-		printf("ERROR: no font size has been provided\n");
-		exit(1);
-	    }
+    const bool use_cache = !options.cache_dir.empty();
+    const unsigned long long font_hash = use_cache ? hash_bytes(&font_data[0], font_data.size()) : 0;
 
-	    font_size = strtol(argv[i+1], NULL, 10);
+    // the faces are only opened once an atlas is not found in the cache.
+    FontFaces faces;
 
-	    if(font_size == 0) {
-		printf("ERROR: invalid font size specified.\n");
-		exit(1);
-	    }
+    string image_file;
 
-	    // skip the number.
-	    ++i;
-	}
-    }
+    // the faces are reused for every size. Only the size of the faces changes.
+    for(size_t i = 0; i < options.font_sizes.size(); ++i) {
+	const FT_F26Dot6 font_size = options.font_sizes[i];
 
-    // last arguent is input file
-    const string input_file = string(argv[argc-1]);
+	// all files outputted by this program will start with this string.
+	const string output_file_prefix = strip_file_extension(input_file) + string("-") + std::to_string(font_size);
 
+	std::vector<string> file_suffixes;
+	string key;
 
-    FT_Library  library;
-    FT_Face     face;
+	if(use_cache) {
+	    key = make_cache_key(options_settings(options) + "font-size " + std::to_string(font_size),
+				 font_hash, font_data.size(), codepoints);
+	}
 
-    // Init FT
-    FT_C(FT_Init_FreeType( &library ));
+	if(use_cache && cache_fetch(options.cache_dir, key, output_file_prefix, file_suffixes)) {
+	    printf("%s: reused from the cache.\n", output_file_prefix.c_str());
+	} else {
+	    if(faces.faces.empty()) {
+		open_font_faces(font_data, num_threads, faces);
+	    }
 
+	    generate_atlas(options, faces, font_size, codepoints, output_file_prefix, file_suffixes);
 
+	    if(use_cache) {
+		cache_store(options.cache_dir, key, output_file_prefix, file_suffixes);
+	    }
+	}
+
+	// the first image of the first size.
+	for(size_t k = 0; k < file_suffixes.size() && image_file.empty(); ++k) {
+	    if(file_suffixes[k].find(".png") != string::npos) {
+		image_file = output_file_prefix + file_suffixes[k];
+	    }
+	}
+    }
 
     /*
-      Load the font file.
+      Clean up
      */
+    close_font_faces(faces);
 
+    return image_file;
+}
 
-    // all files outputted by this program will start with this string.
-    const string output_file_prefix = strip_file_extension(input_file) + string("-") + std::to_string(font_size);
-
+/*
+  Split a line of a batch file into arguments, separated by whitespace.
+*/
+static std::vector<string> split_arguments(const string& line) {
+    std::vector<string> args;
+    string arg;
+
+    for(size_t i = 0; i <= line.size(); ++i) {
+	if(i == line.size() || line[i] == ' ' || line[i] == '\t' || line[i] == '\r') {
+	    if(!arg.empty()) {
+		args.push_back(arg);
+		arg.clear();
+	    }
+	} else {
+	    arg += line[i];
+	}
+    }
 
-    FT_C(FT_New_Face( library,
-		      input_file.c_str(),
-		      0, // face index. We'll be assuming there is only one face in the file.
-		      &face ));
+    return args;
+}
 
+/*
+  Every thread running batch jobs claims the next job that has not yet been started. A job
+  that gives its own number of threads uses that many, the others use threads_per_job.
+*/
+static void batch_worker(const std::vector<AtlasOptions>* jobs, unsigned int threads_per_job,
+			 std::atomic<unsigned int>* next_job) {
+    while(true) {
+	const unsigned int job = next_job->fetch_add(1);
+	if(job >= jobs->size()) {
+	    break;
+	}
 
-    if(face->num_faces != 1) {
-	printf("This file has %ld font face(s), but this program only supports one face/n", face->num_faces);
-	exit(1);
+	const AtlasOptions& options = (*jobs)[job];
+	run_job(options, options.num_threads > 0 ? options.num_threads : threads_per_job);
     }
+}
+
+void run_batch(const AtlasOptions& options) {
 
-    // set the font size.
-    FT_C(FT_Set_Char_Size(
-	     face,    // handle to face object
-	     font_size * 64,  /* char_width  */
-	     0,   //char_height. It is 0, so it is set to char_width
-	     RESOLUTION,     /* horizontal device resolution    */
-	     RESOLUTION ));   /* vertical device resolution      */
+    std::vector<unsigned char> text;
+    lodepng::load_file(text, options.batch_file);
 
+    if(text.empty()) {
+	printf("ERROR: could not read the batch file %s\n", options.batch_file.c_str());
+	exit(1);
+    }
 
     /*
-      Next, we determine the size of the atlas, so that it will fit all the characters.
-     */
+      Every line of the batch file is a job, with the same syntax as the command line.
+      Empty lines, and lines starting with '#', are skipped.
+    */
 
-    unsigned int max_width = 0;
-    unsigned int max_height = 0;
-    signed int max_bitmap_top = 0;
+    std::vector<AtlasOptions> jobs;
 
-    for(unsigned int ch = START_CHAR; ch <= END_CHAR; ++ch) {
+    string line;
+    unsigned int line_number = 0;
 
-	FT_C(FT_Load_Char(face, (char)ch, FT_LOAD_RENDER));
+    for(size_t i = 0; i <= text.size(); ++i) {
+	if(i < text.size() && text[i] != '\n') {
+	    line += (char)text[i];
+	    continue;
+	}
+
+	++line_number;
 
-	FT_GlyphSlot glyph = face->glyph;
-	FT_Bitmap bitmap = glyph->bitmap;
+	const std::vector<string> args = split_arguments(line);
+	line.clear();
 
-	if(bitmap.rows > max_height) {
-	    max_height = bitmap.rows;
+	if(args.empty() || args[0][0] == '#') {
+	    continue;
 	}
 
-	if(bitmap.width > max_width) {
-	    max_width = bitmap.width;
+	// each job starts out with the options from the command line.
+	AtlasOptions job = options;
+	job.input_file.clear();
+
+	// -j can not be 0, so 0 means that the line did not give it.
+	job.num_threads = 0;
+
+	if(!parse_options(args, job)) {
+	    printf("ERROR: in line %u of the batch file %s\n", line_number, options.batch_file.c_str());
+	    exit(1);
 	}
 
-	if(glyph->bitmap_top > max_bitmap_top) {
-	    max_bitmap_top = glyph->bitmap_top;
+	if(job.input_file.empty() || job.batch_file != options.batch_file) {
+	    printf("ERROR: line %u of the batch file %s must give an input file, and no batch file\n",
+		   line_number, options.batch_file.c_str());
+	    exit(1);
 	}
-    }
 
-    atlas_width = find_atlas_size(
-	max_width, // maximum character width
-	max_height+ abs(max_bitmap_top) // maximum character height
-	);
-    atlas_height = atlas_width;
+	jobs.push_back(job);
+    }
 
+    if(jobs.empty()) {
+	return;
+    }
 
     /*
-      Allocate the atlas pixel buffer.
+      Run as many jobs at a time as there are threads. If there are fewer jobs than
+      threads, the remaining threads help with rendering the glyphs of every job.
     */
 
-    unsigned int atlas_num_pixels = atlas_width * atlas_height;
+    unsigned int num_workers = options.num_threads;
+    if(num_workers > jobs.size()) {
+	num_workers = (unsigned int)jobs.size();
+    }
+    const unsigned int threads_per_job = options.num_threads / num_workers;
 
-    //contains RGBA values, with a byte for each channel.
-    unsigned char* atlas_buffer = new unsigned char[atlas_num_pixels * 4];
+    std::atomic<unsigned int> next_job(0);
 
-    // initially, set all atlas pixels to fully transparent white: (1,1,1,0).
-    for(int i = 0; i < atlas_num_pixels; ++i) {
-	atlas_buffer[4*i + 0] = 255;
-	atlas_buffer[4*i + 1] = 255;
-	atlas_buffer[4*i + 2] = 255;
-	atlas_buffer[4*i + 3] = 0;
+    std::vector<std::thread> threads;
+    for(unsigned int t = 1; t < num_workers; ++t) {
+	threads.push_back(std::thread(batch_worker, &jobs, threads_per_job, &next_job));
     }
+    batch_worker(&jobs, threads_per_job, &next_job);
 
-    // The .amf-file will contain the exact positions of every character in the atlas.
-    FILE* fp = fopen((output_file_prefix+string(".amf")).c_str(), "w");
+    for(size_t t = 0; t < threads.size(); ++t) {
+	threads[t].join();
+    }
+}
 
-    unsigned int atlas_x = 0;
-    unsigned int atlas_y = 0;
+void generate_atlas(const AtlasOptions& options, FontFaces& faces, FT_F26Dot6 font_size,
+		    const std::vector<unsigned int>& codepoints, const string& output_file_prefix,
+		    std::vector<string>& file_suffixes) {
 
-    for(unsigned int ch = START_CHAR; ch <= END_CHAR; ++ch) {
+    /*
+      Render every character once. The glyph store also keeps track of the maximum
+      bitmap sizes.
+     */
 
-	FT_C(FT_Load_Char(face, (char)ch, FT_LOAD_RENDER));
+    RasterSettings settings;
+    settings.image = IMAGE_COVERAGE;
+    if(options.format == ATLAS_LCD) {
+	settings.image = IMAGE_LCD;
+    } else if(options.format == ATLAS_SDF) {
+	settings.image = IMAGE_SDF;
+    } else if(options.format == ATLAS_MSDF) {
+	settings.image = IMAGE_MSDF;
+    }
+    settings.sdf_spread = options.sdf_spread;
 
-	FT_GlyphSlot glyph = face->glyph;
-	FT_Bitmap bitmap = glyph->bitmap;
+    GlyphStore store;
+    rasterize_glyphs(faces, font_size, settings, codepoints, store);
 
-	const unsigned int bitmap_width = bitmap.width;
-	const unsigned int bitmap_height = bitmap.rows;
+    if(store.num_missing > 0) {
+	printf("%s: skipped %u characters that are not in the font.\n", output_file_prefix.c_str(), store.num_missing);
+    }
 
-	// start a new row, if the current one is already filled.
-	if(max_width + atlas_x > atlas_width) {
-	    atlas_x = 0;
+    if(store.num_shared > 0) {
+	printf("%s: %u characters share the bitmap of another character.\n", output_file_prefix.c_str(), store.num_shared);
+    }
 
-	    // if we do this, we are guaranteed that the rows are spaced apart enough.
-	    atlas_y += max_height+ abs(max_bitmap_top);
-	}
+    std::vector<KerningPair> kerning;
+    if(!extract_kerning(faces.faces[0], store.x_scale, codepoints, kerning)) {
+	printf("%s: skipped the kerning, the font has no 'kern' table that can be read.\n", output_file_prefix.c_str());
+    }
 
-	// when copying the font, we make sure to align the baselines of all the characters.
-	copy_font_bitmap(atlas_buffer, bitmap, atlas_x, atlas_y + (max_bitmap_top - glyph->bitmap_top ));
 
-	string line =
-	    string(1,(char)ch) + "," +
-	    std::to_string(atlas_x) + "," +
-	    std::to_string(atlas_y) + "," +
-	    std::to_string( (glyph->advance.x >> 6) - glyph->bitmap_left ) + "," +
-	    std::to_string( max_height) + "," +
-	    std::to_string( glyph->bitmap_left) +
-	    "\n";
+    /*
+      Pack the tight bounds of every glyph bitmap into the atlas. The padding keeps
+      neighbouring glyphs from bleeding into each other when the atlas is sampled.
+      Glyphs that share a bitmap are packed once.
+     */
 
-	fputs(line.c_str(), fp);
+    std::vector<PackRect> rects(store.glyphs.size());
+
+    for(size_t i = 0; i < store.glyphs.size(); ++i) {
+	const Glyph& glyph = store.glyphs[i];
 
-	// move to the next letter.
-	atlas_x += max_width;
+	const bool empty = glyph.width == 0 || glyph.rows == 0 || glyph.image != i;
+	rects[i].width = empty ? 0 : glyph.width + options.padding;
+	rects[i].height = empty ? 0 : glyph.rows + options.padding;
     }
 
-    unsigned int error = lodepng_encode32_file((output_file_prefix+string(".png")).c_str(), atlas_buffer, atlas_width, atlas_height);
+    /*
+      If the glyphs do not fit into a single page, they are spread over several pages.
+    */
+
+    // a new page should preferably start where the characters stop being consecutive, or at the start of a new block of 128.
+    std::vector<bool> preferred_break(store.glyphs.size(), false);
+    for(size_t i = 1; i < store.glyphs.size(); ++i) {
+	const unsigned int ch = store.glyphs[i].codepoint;
+	const unsigned int prev_ch = store.glyphs[i-1].codepoint;
 
+	preferred_break[i] = ch != prev_ch + 1 || (ch >> 7) != (prev_ch >> 7);
+    }
+
+    std::vector<PackPage> pages;
 
-    /*if there's an error, display it*/
-    if(error) {
-	printf("error %u: %s\n", error, lodepng_error_text(error));
+    if(!pack_pages(rects, preferred_break, options.heuristic, options.size_constraint, options.max_page_size, pages)) {
+	printf("ERROR: the glyphs do not fit into pages of size %ux%u\n", options.max_page_size, options.max_page_size);
 	exit(1);
     }
 
-    /*
-      Clean up
-     */
+    for(size_t i = 0; i < store.glyphs.size(); ++i) {
+	if(store.glyphs[i].image != i) {
+	    rects[i] = rects[store.glyphs[i].image];
+	}
+    }
+
+    // The .amf-file will contain the exact positions of every character in the atlas.
+    FILE* fp = fopen((output_file_prefix+string(".amf")).c_str(), "w");
+
+    if(fp == NULL) {
+	printf("ERROR: could not write %s.amf\n", output_file_prefix.c_str());
+	exit(1);
+    }
+
+    for(size_t i = 0; i < store.glyphs.size(); ++i) {
+
+	const Glyph& glyph = store.glyphs[i];
+
+	string line;
+	append_utf8(line, glyph.codepoint);
+	line +=
+	    string(",") +
+	    std::to_string(rects[i].x) + "," +
+	    std::to_string(rects[i].y) + "," +
+	    std::to_string( glyph.width ) + "," +
+	    std::to_string( glyph.rows ) + "," +
+	    std::to_string( glyph.bitmap_left) + "," +
+	    std::to_string( glyph.bitmap_top) + "," +
+	    std::to_string( glyph.advance) + "," +
+	    std::to_string( rects[i].page) +
+	    "\n";
+
+	fputs(line.c_str(), fp);
+    }
+
     fclose(fp);
-    delete[] atlas_buffer;
-    FT_C(FT_Done_FreeType( library ));
+    file_suffixes.push_back(".amf");
+
+    // the same metrics in the binary format, that can be used without parsing.
+    if(!write_amfb_file(output_file_prefix + ".amfb", amfb_header(options, font_size, store, pages.size()),
+			amfb_glyphs(store, rects), amfb_kerning_pairs(kerning))) {
+	printf("ERROR: could not write %s.amfb\n", output_file_prefix.c_str());
+	exit(1);
+    }
+    file_suffixes.push_back(".amfb");
+
+    for(size_t p = 0; p < pages.size(); ++p) {
+
+	const PackPage& page = pages[p];
+
+	const unsigned int atlas_width = page.width;
+	const unsigned int atlas_height = page.height;
+
+	/*
+	  The atlas is never in memory as a whole: it is composed band by band while it is encoded,
+	  from the glyphs that overlap each band.
+	*/
+
+	AtlasBands bands;
+	bands.format = options.format;
+	bands.width = atlas_width;
+	bands.store = &store;
+	bands.rects = &rects;
+	bands.glyphs.resize((atlas_height + PNG_BAND_ROWS - 1) / PNG_BAND_ROWS);
+
+	const unsigned int channels = atlas_format_channels(options.format);
+
+	// the number of atlas pixels that are covered by glyph bitmaps.
+	unsigned long long glyph_area = 0;
+	unsigned int num_packed = 0;
+
+	for(size_t i = 0; i < page.rects.size(); ++i) {
+	    const unsigned int glyph_index = page.rects[i];
+	    const Glyph& glyph = store.glyphs[glyph_index];
+
+	    // a shared bitmap is copied once, for the first glyph that has it.
+	    if(glyph.image != glyph_index) {
+		continue;
+	    }
+
+	    if(glyph.rows > 0) {
+		const unsigned int first_band = rects[glyph_index].y / PNG_BAND_ROWS;
+		const unsigned int last_band = (rects[glyph_index].y + glyph.rows - 1) / PNG_BAND_ROWS;
+		for(unsigned int b = first_band; b <= last_band; ++b) {
+		    bands.glyphs[b].push_back(glyph_index);
+		}
+	    }
+
+	    glyph_area += glyph.width * glyph.rows;
+	    ++num_packed;
+	}
+
+	const string image_file = output_file_prefix + page_file_suffix(p, pages.size());
+	file_suffixes.push_back(page_file_suffix(p, pages.size()));
 
-     system(("open " + output_file_prefix+string(".png")).c_str() );
+	printf("%s: packed %u glyphs into a %ux%u atlas using %s. Packing efficiency: %.1f%%\n",
+	       image_file.c_str(), num_packed, atlas_width, atlas_height, pack_heuristic_name(options.heuristic),
+	       100.0 * (double)glyph_area / ((double)atlas_width * atlas_height));
+
+	LodePNGColorMode file_color;
+	lodepng_color_mode_init(&file_color);
+
+	PngStats stats;
+	unsigned int error = choose_atlas_color_mode(options.format, store, page,
+						     glyph_area < (unsigned long long)atlas_width * atlas_height, file_color);
+	if(!error) {
+	    error = encode_png_bands(image_file.c_str(), compose_atlas_band, &bands, atlas_width, atlas_height,
+				     channels == 1 ? LCT_GREY : (channels == 3 ? LCT_RGB : LCT_RGBA), file_color,
+				     options.png_speed, (unsigned int)faces.faces.size(), stats);
+	}
+
+	lodepng_color_mode_cleanup(&file_color);
+
+	/*if there's an error, display it*/
+	if(error) {
+	    printf("error %u: %s\n", error, lodepng_error_text(error));
+	    exit(1);
+	}
+
+	printf("%s: encoded %zu bytes into %zu bytes in %.1f ms with the %s preset. %.1f MB/s\n",
+	       image_file.c_str(), stats.raw_size, stats.encoded_size, stats.seconds * 1000.0, png_speed_name(options.png_speed),
+	       stats.seconds > 0.0 ? (double)stats.raw_size / stats.seconds / 1e6 : 0.0);
+    }
 }
 
 void check_ft_error(const FT_Error error, const char* filename, const int line) {
@@ -336,82 +608,181 @@ void check_ft_error(const FT_Error error, const char* filename, const int line)
     exit(1);
 }
 
-void copy_font_bitmap(unsigned char atlas_buffer[], FT_Bitmap bitmap,
+void copy_font_bitmap(unsigned char band_buffer[], unsigned int atlas_width, unsigned int band_y, unsigned int band_rows,
+		      AtlasFormat format, const GlyphStore& store, const Glyph& glyph,
 		      unsigned int start_x, unsigned int start_y) {
 
-    // atlas row width in bytes.
-    unsigned int atlas_row_size = atlas_width * 4;
+    const unsigned int channels = atlas_format_channels(format);
 
-    unsigned int atlas_i = atlas_row_size * start_y + start_x * 4;
-
-    const unsigned int bitmap_width = bitmap.width;
-    const unsigned int bitmap_height = bitmap.rows;
-    const unsigned int bitmap_num_pixels = bitmap_width * bitmap_height;
-
-    unsigned int bitmap_x = 0;
+    // atlas row width in bytes.
+    const size_t atlas_row_size = (size_t)atlas_width * channels;
 
-    for(int bitmap_i = 0; bitmap_i < bitmap_num_pixels; ++bitmap_i) {
+    // the rows of the glyph that are inside the band.
+    const unsigned int first_row = start_y > band_y ? start_y : band_y;
+    const unsigned int end_row = start_y + glyph.rows < band_y + band_rows ? start_y + glyph.rows : band_y + band_rows;
 
-	// for this value, a value of 255, means fully opaque.
-	// 0 means fully transparent.
-	// so it is the alpha value.
-	unsigned char a = bitmap.buffer[bitmap_i];
+    if(first_row >= end_row) {
+	return;
+    }
 
-	atlas_buffer[atlas_i + 0] = 255;
-	atlas_buffer[atlas_i + 1] = 255;
-	atlas_buffer[atlas_i + 2] = 255;
-	atlas_buffer[atlas_i + 3] = a;
+    blit_bitmap(band_buffer + atlas_row_size * (first_row - band_y) + (size_t)start_x * channels, atlas_row_size,
+		store.bitmap(glyph) + (size_t)glyph.pitch * (first_row - start_y), glyph.pitch,
+		glyph.width, end_row - first_row, atlas_blit_mode(format));
+}
 
-	if( ( (bitmap_i+1) % bitmap_width) ==0 && bitmap_i != 0 ) {
-	    // start new row:
-	    atlas_i += atlas_row_size - 4 * bitmap_width + 4;
-	} else {
-	    atlas_i += 4;
+void compose_atlas_band(unsigned char* band, unsigned int y, unsigned int rows, void* context) {
+    const AtlasBands& bands = *(const AtlasBands*)context;
+
+    const unsigned int channels = atlas_format_channels(bands.format);
+    const size_t num_pixels = (size_t)bands.width * rows;
+
+    if(channels != 4) {
+	// initially, nothing is covered, or everything is far outside of the glyphs.
+	memset(band, 0, num_pixels * channels);
+    } else {
+	// initially, set all atlas pixels to fully transparent white: (1,1,1,0).
+	for(size_t i = 0; i < num_pixels; ++i) {
+	    band[4*i + 0] = 255;
+	    band[4*i + 1] = 255;
+	    band[4*i + 2] = 255;
+	    band[4*i + 3] = 0;
 	}
+    }
 
+    const std::vector<unsigned int>& glyphs = bands.glyphs[y / PNG_BAND_ROWS];
+    for(size_t i = 0; i < glyphs.size(); ++i) {
+	const PackRect& rect = (*bands.rects)[glyphs[i]];
+	copy_font_bitmap(band, bands.width, y, rows, bands.format, *bands.store, bands.store->glyphs[glyphs[i]], rect.x, rect.y);
     }
 }
 
-
-string strip_file_extension(const string& str) {
-    size_t last_dot = str.find_last_of(".");
-
-    return str.substr(0,last_dot);
+BlitMode atlas_blit_mode(AtlasFormat format) {
+    if(format == ATLAS_GREY || format == ATLAS_SDF) {
+	return BLIT_GREY_TO_GREY;
+    } else if(format == ATLAS_LCD) {
+	return BLIT_LCD_TO_RGBA;
+    } else if(format == ATLAS_MSDF) {
+	return BLIT_RGB_TO_RGB;
+    }
+    return BLIT_GREY_TO_RGBA;
 }
 
-unsigned int find_atlas_size(unsigned int max_width, unsigned int max_height) {
+unsigned choose_atlas_color_mode(AtlasFormat format, const GlyphStore& store, const PackPage& page,
+				 bool has_background, LodePNGColorMode& mode) {
+    const unsigned int channels = atlas_format_channels(format);
 
-    // an atlas smaller than 128x128 will probably not exist :)
-    unsigned int atlas_size = 128;
+    LodePNGColorMode raw;
+    lodepng_color_mode_init(&raw);
+    raw.colortype = channels == 1 ? LCT_GREY : (channels == 3 ? LCT_RGB : LCT_RGBA);
+    raw.bitdepth = 8;
 
-    while(true) {
+    // grey and distance field atlases use all 256 levels, so they are always written as 8-bit grey.
+    if(channels == 1) {
+	return lodepng_color_mode_copy(&mode, &raw);
+    }
 
-	// total amount of vertical space required for all characters.
-	unsigned int total_width = max_width * (END_CHAR - START_CHAR);
+    LodePNGColorProfile profile;
+    lodepng_color_profile_init(&profile);
+    unsigned error = 0;
 
-	// we round upwards, so add 1.
-	unsigned int rows = (total_width / atlas_size) + 1;
+    // the pixels that no glyph covers, as compose_atlas_band sets them.
+    if(has_background) {
+	const unsigned char background[4] = { 255, 255, 255, 0 };
+	const unsigned char black[3] = { 0, 0, 0 };
+	error = lodepng_get_color_profile(&profile, channels == 4 ? background : black, 1, 1, &raw);
+    }
 
-	if(rows * max_height < atlas_size) {
-	    // enough rows. So we found an atlas size big enough.
-	    break;
+    // every bitmap as it ends up in the atlas. Shared bitmaps are on the page once.
+    std::vector<unsigned char> pixels;
+    for(size_t i = 0; i < page.rects.size() && !error; ++i) {
+	const Glyph& glyph = store.glyphs[page.rects[i]];
+	if(glyph.image != page.rects[i] || glyph.width == 0 || glyph.rows == 0) {
+	    continue;
 	}
 
-	atlas_size *= 2;
+	pixels.resize((size_t)glyph.width * glyph.rows * channels);
+	blit_bitmap(&pixels[0], (size_t)glyph.width * channels, store.bitmap(glyph), glyph.pitch,
+		    glyph.width, glyph.rows, atlas_blit_mode(format));
+	error = lodepng_get_color_profile(&profile, &pixels[0], glyph.width, glyph.rows, &raw);
+    }
+
+    if(!error) {
+	error = lodepng_auto_choose_color_profile(&mode, &profile, (size_t)page.width * page.height, &raw);
+    }
+
+    lodepng_color_mode_cleanup(&raw);
+    return error;
+}
+
+
+AmfbHeader amfb_header(const AtlasOptions& options, FT_F26Dot6 font_size, const GlyphStore& store, size_t num_pages) {
+    AmfbHeader header;
+    memset(&header, 0, sizeof(header));
+
+    header.page_count = (uint32_t)num_pages;
+    header.format = AMFB_FORMAT_RGBA;
+    if(options.format == ATLAS_GREY) {
+	header.format = AMFB_FORMAT_GREY;
+    } else if(options.format == ATLAS_LCD) {
+	header.format = AMFB_FORMAT_LCD;
+    } else if(options.format == ATLAS_SDF) {
+	header.format = AMFB_FORMAT_SDF;
+	header.distance_range = options.sdf_spread;
+    } else if(options.format == ATLAS_MSDF) {
+	header.format = AMFB_FORMAT_MSDF;
+	header.distance_range = options.sdf_spread;
     }
+    header.font_size = (int32_t)font_size;
+    header.ascender = store.ascender;
+    header.descender = store.descender;
+    header.line_height = store.line_height;
+
+    return header;
+}
 
-    return atlas_size;
+std::vector<AmfbGlyph> amfb_glyphs(const GlyphStore& store, const std::vector<PackRect>& rects) {
+    std::vector<AmfbGlyph> glyphs(store.glyphs.size());
+
+    for(size_t i = 0; i < store.glyphs.size(); ++i) {
+	const Glyph& glyph = store.glyphs[i];
+
+	glyphs[i].codepoint = glyph.codepoint;
+	glyphs[i].x = (uint16_t)rects[i].x;
+	glyphs[i].y = (uint16_t)rects[i].y;
+	glyphs[i].width = (uint16_t)glyph.width;
+	glyphs[i].height = (uint16_t)glyph.rows;
+	glyphs[i].left = (int16_t)glyph.bitmap_left;
+	glyphs[i].top = (int16_t)glyph.bitmap_top;
+	glyphs[i].advance = (int16_t)glyph.advance;
+	glyphs[i].page = (uint16_t)rects[i].page;
+	glyphs[i].reserved = 0;
+    }
 
+    return glyphs;
 }
 
-void print_help() {
-    printf("Usage:\n");
-    printf("font_creator_cpp [FLAGS] input-file\n\n");
+std::vector<AmfbKerningPair> amfb_kerning_pairs(const std::vector<KerningPair>& pairs) {
+    std::vector<AmfbKerningPair> kerning(pairs.size());
+
+    for(size_t i = 0; i < pairs.size(); ++i) {
+	kerning[i].left = pairs[i].left;
+	kerning[i].right = pairs[i].right;
+	kerning[i].value = pairs[i].value;
+    }
 
-    printf("Flags:\n");
+    return kerning;
+}
 
+string strip_file_extension(const string& str) {
+    size_t last_dot = str.find_last_of(".");
 
-    printf("\t-h,--help\t\tPrint this message\n");
-    printf( "\t-fs,--font-size\t\tFont size. Default value: %d\n", FONT_SIZE_DEFALT );
+    return str.substr(0,last_dot);
+}
 
+string page_file_suffix(size_t page, size_t num_pages) {
+    if(num_pages == 1) {
+	return string(".png");
+    } else {
+	return string("-") + std::to_string(page) + string(".png");
+    }
 }
@@ -0,0 +1,667 @@
+#include "msdf.h"
+#include "ft_check.h"
+
+#include FT_OUTLINE_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+// the channel masks of the edge colors.
+#define MSDF_RED 1
+#define MSDF_GREEN 2
+#define MSDF_BLUE 4
+#define MSDF_YELLOW (MSDF_RED | MSDF_GREEN)
+#define MSDF_MAGENTA (MSDF_RED | MSDF_BLUE)
+#define MSDF_CYAN (MSDF_GREEN | MSDF_BLUE)
+#define MSDF_WHITE (MSDF_RED | MSDF_GREEN | MSDF_BLUE)
+
+// two edges meet at a corner if their directions differ by more than about 8 degrees.
+#define MSDF_CORNER_SINE 0.141f
+
+// curves are flattened into pieces that are about this long, in pixels.
+#define MSDF_PIECE_LENGTH 0.5f
+#define MSDF_MAX_PIECES 64
+
+static int floor_div(int a, int b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static MsdfPoint make_point(float x, float y) {
+    MsdfPoint point = { x, y };
+    return point;
+}
+
+static MsdfPoint to_point(const FT_Vector* v) {
+    return make_point((float)v->x / 64.0f, (float)v->y / 64.0f);
+}
+
+static MsdfPoint sub(MsdfPoint a, MsdfPoint b) {
+    return make_point(a.x - b.x, a.y - b.y);
+}
+
+static float dot(MsdfPoint a, MsdfPoint b) {
+    return a.x * b.x + a.y * b.y;
+}
+
+static float cross(MsdfPoint a, MsdfPoint b) {
+    return a.x * b.y - a.y * b.x;
+}
+
+static float length(MsdfPoint a) {
+    return sqrtf(dot(a, a));
+}
+
+static MsdfPoint normalize(MsdfPoint a) {
+    const float len = length(a);
+    return len > 0.0f ? make_point(a.x / len, a.y / len) : make_point(0.0f, 0.0f);
+}
+
+/*
+  Turning the outline into edges.
+*/
+
+struct DecomposeState {
+    MsdfScratch* scratch;
+    MsdfPoint current;
+};
+
+// append an edge that starts at the current point. The rest of its points have been appended already.
+static void finish_edge(DecomposeState* state, unsigned int first_point) {
+    MsdfScratch& scratch = *state->scratch;
+
+    MsdfEdge edge;
+    edge.first_point = first_point;
+    edge.num_pieces = (unsigned int)(scratch.points.size() - first_point - 1);
+    edge.channels = MSDF_WHITE;
+
+    state->current = scratch.points.back();
+
+    if(edge.num_pieces == 0) {
+	scratch.points.pop_back();
+	return;
+    }
+
+    scratch.edges.push_back(edge);
+    ++scratch.contours.back().num_edges;
+}
+
+// append a point, unless it is the same as the one before it, which would give a piece without a direction.
+static void add_point(MsdfScratch& scratch, MsdfPoint point) {
+    const MsdfPoint& last = scratch.points.back();
+    if(point.x != last.x || point.y != last.y) {
+	scratch.points.push_back(point);
+    }
+}
+
+static unsigned int num_curve_pieces(float polygon_length) {
+    const unsigned int pieces = (unsigned int)ceilf(polygon_length / MSDF_PIECE_LENGTH);
+    return pieces < 2 ? 2 : (pieces > MSDF_MAX_PIECES ? MSDF_MAX_PIECES : pieces);
+}
+
+static int move_to(const FT_Vector* to, void* user) {
+    DecomposeState* state = (DecomposeState*)user;
+
+    MsdfContour contour;
+    contour.first_edge = (unsigned int)state->scratch->edges.size();
+    contour.num_edges = 0;
+    state->scratch->contours.push_back(contour);
+
+    state->current = to_point(to);
+    return 0;
+}
+
+static int line_to(const FT_Vector* to, void* user) {
+    DecomposeState* state = (DecomposeState*)user;
+    MsdfScratch& scratch = *state->scratch;
+
+    const unsigned int first_point = (unsigned int)scratch.points.size();
+    scratch.points.push_back(state->current);
+    add_point(scratch, to_point(to));
+
+    finish_edge(state, first_point);
+    return 0;
+}
+
+static int conic_to(const FT_Vector* control, const FT_Vector* to, void* user) {
+    DecomposeState* state = (DecomposeState*)user;
+    MsdfScratch& scratch = *state->scratch;
+
+    const MsdfPoint p0 = state->current;
+    const MsdfPoint p1 = to_point(control);
+    const MsdfPoint p2 = to_point(to);
+
+    const unsigned int n = num_curve_pieces(length(sub(p1, p0)) + length(sub(p2, p1)));
+
+    const unsigned int first_point = (unsigned int)scratch.points.size();
+    scratch.points.push_back(p0);
+
+    for(unsigned int i = 1; i <= n; ++i) {
+	const float t = (float)i / (float)n;
+	const float u = 1.0f - t;
+	add_point(scratch, make_point(u * u * p0.x + 2.0f * u * t * p1.x + t * t * p2.x,
+				      u * u * p0.y + 2.0f * u * t * p1.y + t * t * p2.y));
+    }
+
+    finish_edge(state, first_point);
+    return 0;
+}
+
+static int cubic_to(const FT_Vector* control1, const FT_Vector* control2, const FT_Vector* to, void* user) {
+    DecomposeState* state = (DecomposeState*)user;
+    MsdfScratch& scratch = *state->scratch;
+
+    const MsdfPoint p0 = state->current;
+    const MsdfPoint p1 = to_point(control1);
+    const MsdfPoint p2 = to_point(control2);
+    const MsdfPoint p3 = to_point(to);
+
+    const unsigned int n = num_curve_pieces(length(sub(p1, p0)) + length(sub(p2, p1)) + length(sub(p3, p2)));
+
+    const unsigned int first_point = (unsigned int)scratch.points.size();
+    scratch.points.push_back(p0);
+
+    for(unsigned int i = 1; i <= n; ++i) {
+	const float t = (float)i / (float)n;
+	const float u = 1.0f - t;
+	const float a = u * u * u, b = 3.0f * u * u * t, c = 3.0f * u * t * t, d = t * t * t;
+	add_point(scratch, make_point(a * p0.x + b * p1.x + c * p2.x + d * p3.x,
+				      a * p0.y + b * p1.y + c * p2.y + d * p3.y));
+    }
+
+    finish_edge(state, first_point);
+    return 0;
+}
+
+/*
+  Edge coloring, as in the simple scheme of msdfgen.
+*/
+
+static MsdfPoint start_direction(const MsdfScratch& scratch, const MsdfEdge& edge) {
+    return normalize(sub(scratch.points[edge.first_point + 1], scratch.points[edge.first_point]));
+}
+
+static MsdfPoint end_direction(const MsdfScratch& scratch, const MsdfEdge& edge) {
+    const unsigned int last = edge.first_point + edge.num_pieces;
+    return normalize(sub(scratch.points[last], scratch.points[last - 1]));
+}
+
+static bool is_corner(MsdfPoint a, MsdfPoint b) {
+    return dot(a, b) <= 0.0f || fabsf(cross(a, b)) > MSDF_CORNER_SINE;
+}
+
+/*
+  Change to another color. seed decides which one, and is used up as the colors are switched,
+  so that the colors are the same for every run. banned is a color that is not wanted.
+*/
+static void switch_color(unsigned int& color, unsigned long long& seed, unsigned int banned) {
+    const unsigned int combined = color & banned;
+
+    if(combined == MSDF_RED || combined == MSDF_GREEN || combined == MSDF_BLUE) {
+	color = combined ^ MSDF_WHITE;
+	return;
+    }
+
+    if(color == 0 || color == MSDF_WHITE) {
+	static const unsigned int start[3] = { MSDF_CYAN, MSDF_MAGENTA, MSDF_YELLOW };
+	color = start[seed % 3];
+	seed /= 3;
+	return;
+    }
+
+    const unsigned int shifted = color << (1 + (seed & 1));
+    color = (shifted | (shifted >> 3)) & MSDF_WHITE;
+    seed >>= 1;
+}
+
+/*
+  Split an edge into three edges, of about the same number of pieces.
+*/
+static void split_edge_in_three(MsdfScratch& scratch, const MsdfEdge& edge, MsdfEdge parts[3]) {
+
+    unsigned int first_point = edge.first_point;
+    unsigned int num_pieces = edge.num_pieces;
+
+    if(num_pieces < 3) {
+	// cut every piece into three first.
+	const unsigned int new_first_point = (unsigned int)scratch.points.size();
+
+	for(unsigned int i = 0; i < num_pieces; ++i) {
+	    const MsdfPoint a = scratch.points[first_point + i];
+	    const MsdfPoint b = scratch.points[first_point + i + 1];
+
+	    for(unsigned int k = 0; k < 3; ++k) {
+		const float t = (float)k / 3.0f;
+		scratch.points.push_back(make_point(a.x + t * (b.x - a.x), a.y + t * (b.y - a.y)));
+	    }
+	}
+	const MsdfPoint end = scratch.points[first_point + num_pieces];
+	scratch.points.push_back(end);
+
+	first_point = new_first_point;
+	num_pieces *= 3;
+    }
+
+    const unsigned int cuts[4] = { 0, num_pieces / 3, 2 * num_pieces / 3, num_pieces };
+    for(unsigned int k = 0; k < 3; ++k) {
+	parts[k].first_point = first_point + cuts[k];
+	parts[k].num_pieces = cuts[k + 1] - cuts[k];
+	parts[k].channels = edge.channels;
+    }
+}
+
+static void color_contour(MsdfScratch& scratch, MsdfContour& contour, unsigned long long& seed) {
+
+    const unsigned int first_colored = (unsigned int)scratch.colored_edges.size();
+    const MsdfEdge* edges = &scratch.edges[contour.first_edge];
+    const unsigned int m = contour.num_edges;
+
+    // the edges that start at a corner.
+    std::vector<unsigned int> corners;
+    for(unsigned int i = 0; i < m; ++i) {
+	if(is_corner(end_direction(scratch, edges[(i + m - 1) % m]), start_direction(scratch, edges[i]))) {
+	    corners.push_back(i);
+	}
+    }
+
+    if(corners.empty()) {
+	// a smooth contour can not have sharp corners in any channel.
+	for(unsigned int i = 0; i < m; ++i) {
+	    scratch.colored_edges.push_back(edges[i]);
+	}
+    } else if(corners.size() == 1) {
+	/*
+	  A teardrop. The edges are given three colors, so that the channels still meet at the
+	  corner. There have to be at least three edges for that, so shorter contours are split up.
+	*/
+	unsigned int colors[3] = { MSDF_WHITE, MSDF_WHITE, MSDF_WHITE };
+	switch_color(colors[0], seed, 0);
+	colors[2] = colors[0];
+	switch_color(colors[2], seed, 0);
+
+	std::vector<MsdfEdge> ring;
+	for(unsigned int i = 0; i < m; ++i) {
+	    const MsdfEdge& edge = edges[(corners[0] + i) % m];
+
+	    if(m < 3) {
+		MsdfEdge parts[3];
+		split_edge_in_three(scratch, edge, parts);
+		ring.insert(ring.end(), parts, parts + 3);
+	    } else {
+		ring.push_back(edge);
+	    }
+	}
+
+	const unsigned int n = (unsigned int)ring.size();
+	for(unsigned int i = 0; i < n; ++i) {
+	    // spread the three colors evenly over the edges.
+	    const int color = (int)(3.0 + 2.875 * i / (n - 1) - 1.4375 + 0.5) - 3;
+	    ring[i].channels = colors[color + 1];
+	    scratch.colored_edges.push_back(ring[i]);
+	}
+    } else {
+	// switch to another color at every corner. The last color must also differ from the first.
+	unsigned int color = MSDF_WHITE;
+	switch_color(color, seed, 0);
+	const unsigned int initial_color = color;
+
+	size_t spline = 0;
+	for(unsigned int i = 0; i < m; ++i) {
+	    const unsigned int index = (corners[0] + i) % m;
+
+	    if(spline + 1 < corners.size() && corners[spline + 1] == index) {
+		++spline;
+		switch_color(color, seed, spline == corners.size() - 1 ? initial_color : 0);
+	    }
+
+	    MsdfEdge edge = edges[index];
+	    edge.channels = color;
+	    scratch.colored_edges.push_back(edge);
+	}
+    }
+
+    contour.first_edge = first_colored;
+    contour.num_edges = (unsigned int)scratch.colored_edges.size() - first_colored;
+}
+
+/*
+  Distances.
+*/
+
+struct EdgeDistance {
+    // positive on the inside of the outline, if it is oriented as in TrueType fonts.
+    float distance;
+
+    // how far the point is from being perpendicular to the edge. Breaks ties at corners.
+    float alignment;
+
+    // the nearest piece, and where the point projects onto its line. 0 is the start of the piece, 1 its end.
+    unsigned int piece;
+    float param;
+};
+
+static bool closer(const EdgeDistance& a, const EdgeDistance& b) {
+    const float da = fabsf(a.distance);
+    const float db = fabsf(b.distance);
+    return da < db || (da == db && a.alignment < b.alignment);
+}
+
+static EdgeDistance piece_distance(MsdfPoint a, MsdfPoint b, MsdfPoint p) {
+    const MsdfPoint ab = sub(b, a);
+    const MsdfPoint aq = sub(p, a);
+
+    EdgeDistance result;
+    result.piece = 0;
+    result.param = dot(aq, ab) / dot(ab, ab);
+
+    const MsdfPoint eq = sub(result.param > 0.5f ? b : a, p);
+    const float endpoint_distance = length(eq);
+
+    if(result.param > 0.0f && result.param < 1.0f) {
+	const float perpendicular = cross(aq, ab) / length(ab);
+	if(fabsf(perpendicular) < endpoint_distance) {
+	    result.distance = perpendicular;
+	    result.alignment = 0.0f;
+	    return result;
+	}
+    }
+
+    result.distance = cross(aq, ab) > 0.0f ? endpoint_distance : -endpoint_distance;
+    result.alignment = fabsf(dot(normalize(ab), normalize(eq)));
+    return result;
+}
+
+static void find_bounds(const MsdfScratch& scratch, MsdfEdge& edge) {
+    edge.min = edge.max = scratch.points[edge.first_point];
+
+    for(unsigned int i = 1; i <= edge.num_pieces; ++i) {
+	const MsdfPoint& point = scratch.points[edge.first_point + i];
+	edge.min.x = fminf(edge.min.x, point.x);
+	edge.min.y = fminf(edge.min.y, point.y);
+	edge.max.x = fmaxf(edge.max.x, point.x);
+	edge.max.y = fmaxf(edge.max.y, point.y);
+    }
+}
+
+// no point of the edge is nearer to p than this.
+static float bounds_distance(const MsdfEdge& edge, MsdfPoint p) {
+    const float dx = fmaxf(fmaxf(edge.min.x - p.x, p.x - edge.max.x), 0.0f);
+    const float dy = fmaxf(fmaxf(edge.min.y - p.y, p.y - edge.max.y), 0.0f);
+    return sqrtf(dx * dx + dy * dy);
+}
+
+static EdgeDistance edge_distance(const MsdfScratch& scratch, const MsdfEdge& edge, MsdfPoint p) {
+    const MsdfPoint* points = &scratch.points[edge.first_point];
+
+    EdgeDistance best = piece_distance(points[0], points[1], p);
+
+    for(unsigned int i = 1; i < edge.num_pieces; ++i) {
+	EdgeDistance distance = piece_distance(points[i], points[i + 1], p);
+	distance.piece = i;
+
+	if(closer(distance, best)) {
+	    best = distance;
+	}
+    }
+
+    return best;
+}
+
+/*
+  Beyond the ends of the edge, the distance is measured to the line that continues the edge,
+  instead of to its end point. This is what keeps the corners sharp.
+*/
+static float pseudo_distance(const MsdfScratch& scratch, const MsdfEdge& edge, const EdgeDistance& distance, MsdfPoint p) {
+
+    if(distance.piece == 0 && distance.param < 0.0f) {
+	const MsdfPoint start = scratch.points[edge.first_point];
+	const MsdfPoint direction = start_direction(scratch, edge);
+	const MsdfPoint aq = sub(p, start);
+
+	if(dot(aq, direction) < 0.0f) {
+	    const float pseudo = cross(aq, direction);
+	    if(fabsf(pseudo) <= fabsf(distance.distance)) {
+		return pseudo;
+	    }
+	}
+    } else if(distance.piece == edge.num_pieces - 1 && distance.param > 1.0f) {
+	const MsdfPoint end = scratch.points[edge.first_point + edge.num_pieces];
+	const MsdfPoint direction = end_direction(scratch, edge);
+	const MsdfPoint bq = sub(p, end);
+
+	if(dot(bq, direction) > 0.0f) {
+	    const float pseudo = cross(bq, direction);
+	    if(fabsf(pseudo) <= fabsf(distance.distance)) {
+		return pseudo;
+	    }
+	}
+    }
+
+    return distance.distance;
+}
+
+static float median(float a, float b, float c) {
+    return fmaxf(fminf(a, b), fminf(fmaxf(a, b), c));
+}
+
+static float distance_value(float distance, unsigned int spread) {
+    const float value = 0.5f + distance / (float)(2 * spread);
+    return value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+}
+
+/*
+  Whether interpolating between the pixels a and b would make an artifact, and a is the one of
+  the two that should be fixed. That is when two of the channels change a lot between them,
+  which happens where the nearest edges of the channels differ.
+*/
+static bool clashes(const float* a, const float* b, float threshold) {
+    float a0 = a[0], a1 = a[1], a2 = a[2];
+    float b0 = b[0], b1 = b[1], b2 = b[2];
+
+    // order the channels by how much they change, the most first.
+    if(fabsf(b0 - a0) < fabsf(b1 - a1)) {
+	std::swap(a0, a1);
+	std::swap(b0, b1);
+    }
+    if(fabsf(b1 - a1) < fabsf(b2 - a2)) {
+	std::swap(a1, a2);
+	std::swap(b1, b2);
+	if(fabsf(b0 - a0) < fabsf(b1 - a1)) {
+	    std::swap(a0, a1);
+	    std::swap(b0, b1);
+	}
+    }
+
+    // b has been fixed already, or a is nearer to the outline than b is.
+    return fabsf(b1 - a1) >= threshold && !(b0 == b1 && b0 == b2) && fabsf(a2 - 0.5f) >= fabsf(b2 - 0.5f);
+}
+
+static void correct_clashes(MsdfScratch& scratch, unsigned int width, unsigned int rows, unsigned int spread) {
+    // a change of a little more than a pixel in the distance.
+    const float threshold = 1.001f / (float)(2 * spread);
+
+    float* field = &scratch.field[0];
+    scratch.clashes.clear();
+
+    for(unsigned int y = 0; y < rows; ++y) {
+	for(unsigned int x = 0; x < width; ++x) {
+	    const float* pixel = field + 3 * ((size_t)y * width + x);
+
+	    if((x > 0 && clashes(pixel, pixel - 3, threshold)) ||
+	       (x + 1 < width && clashes(pixel, pixel + 3, threshold)) ||
+	       (y > 0 && clashes(pixel, pixel - 3 * width, threshold)) ||
+	       (y + 1 < rows && clashes(pixel, pixel + 3 * width, threshold))) {
+		scratch.clashes.push_back(y * width + x);
+	    }
+	}
+    }
+
+    for(size_t i = 0; i < scratch.clashes.size(); ++i) {
+	float* pixel = field + 3 * (size_t)scratch.clashes[i];
+	pixel[0] = pixel[1] = pixel[2] = median(pixel[0], pixel[1], pixel[2]);
+    }
+}
+
+Glyph store_msdf_glyph(std::vector<unsigned char>& pixels, unsigned int ch, FT_GlyphSlot slot,
+		       unsigned int spread, MsdfScratch& scratch) {
+
+    if(slot->format != FT_GLYPH_FORMAT_OUTLINE) {
+	printf("ERROR: the glyph of character %u has no outline, so no distance field can be made of it.\n", ch);
+	exit(1);
+    }
+
+    FT_Outline& outline = slot->outline;
+
+    Glyph glyph;
+    glyph.codepoint = ch;
+    glyph.advance = (int)(slot->advance.x >> 6);
+    glyph.offset = pixels.size();
+    glyph.width = 0;
+    glyph.rows = 0;
+    glyph.bitmap_left = 0;
+    glyph.bitmap_top = 0;
+    glyph.pitch = 0;
+
+    /*
+      Decompose the outline into colored edges.
+    */
+
+    scratch.points.clear();
+    scratch.edges.clear();
+    scratch.contours.clear();
+    scratch.colored_edges.clear();
+
+    DecomposeState state;
+    state.scratch = &scratch;
+    state.current = make_point(0.0f, 0.0f);
+
+    FT_Outline_Funcs funcs;
+    funcs.move_to = move_to;
+    funcs.line_to = line_to;
+    funcs.conic_to = conic_to;
+    funcs.cubic_to = cubic_to;
+    funcs.shift = 0;
+    funcs.delta = 0;
+
+    FT_C(FT_Outline_Decompose(&outline, &funcs, &state));
+
+    if(scratch.edges.empty()) {
+	return glyph;
+    }
+
+    unsigned long long seed = 0;
+    for(size_t c = 0; c < scratch.contours.size(); ++c) {
+	if(scratch.contours[c].num_edges > 0) {
+	    color_contour(scratch, scratch.contours[c], seed);
+	}
+    }
+    scratch.edges.swap(scratch.colored_edges);
+
+    for(size_t e = 0; e < scratch.edges.size(); ++e) {
+	find_bounds(scratch, scratch.edges[e]);
+    }
+
+    // the distances are positive inside of TrueType outlines, which run clockwise.
+    const float sign = FT_Outline_Get_Orientation(&outline) == FT_ORIENTATION_POSTSCRIPT ? -1.0f : 1.0f;
+
+    /*
+      The field covers the outline, and spread more pixels on every side.
+    */
+
+    FT_BBox box;
+    FT_Outline_Get_CBox(&outline, &box);
+
+    const int x0 = floor_div((int)box.xMin, 64) - (int)spread;
+    const int x1 = -floor_div(-(int)box.xMax, 64) + (int)spread;
+    const int y0 = floor_div((int)box.yMin, 64) - (int)spread;
+    const int y1 = -floor_div(-(int)box.yMax, 64) + (int)spread;
+
+    glyph.width = (unsigned int)(x1 - x0);
+    glyph.rows = (unsigned int)(y1 - y0);
+    glyph.bitmap_left = x0;
+    glyph.bitmap_top = y1;
+    glyph.pitch = 3 * glyph.width;
+
+    scratch.field.resize((size_t)glyph.pitch * glyph.rows);
+
+    const unsigned int channel_masks[3] = { MSDF_RED, MSDF_GREEN, MSDF_BLUE };
+
+    for(unsigned int row = 0; row < glyph.rows; ++row) {
+	for(unsigned int x = 0; x < glyph.width; ++x) {
+
+	    // the center of the pixel. Rows run downwards.
+	    const MsdfPoint p = make_point((float)x0 + (float)x + 0.5f, (float)y1 - (float)row - 0.5f);
+
+	    // the nearest edge of every channel, and the nearest edge of any channel.
+	    int nearest[3] = { -1, -1, -1 };
+	    EdgeDistance nearest_distance[3];
+	    int nearest_any = -1;
+	    EdgeDistance nearest_any_distance;
+
+	    for(size_t e = 0; e < scratch.edges.size(); ++e) {
+		const MsdfEdge& edge = scratch.edges[e];
+
+		// skip edges that can not be nearer than the ones found so far, in any of their channels.
+		if(nearest_any >= 0) {
+		    float farthest = fabsf(nearest_any_distance.distance);
+		    for(unsigned int c = 0; c < 3; ++c) {
+			if(edge.channels & channel_masks[c]) {
+			    farthest = nearest[c] < 0 ? HUGE_VALF : fmaxf(farthest, fabsf(nearest_distance[c].distance));
+			}
+		    }
+
+		    if(bounds_distance(edge, p) > farthest) {
+			continue;
+		    }
+		}
+
+		const EdgeDistance distance = edge_distance(scratch, edge, p);
+
+		for(unsigned int c = 0; c < 3; ++c) {
+		    if((edge.channels & channel_masks[c]) && (nearest[c] < 0 || closer(distance, nearest_distance[c]))) {
+			nearest[c] = (int)e;
+			nearest_distance[c] = distance;
+		    }
+		}
+
+		if(nearest_any < 0 || closer(distance, nearest_any_distance)) {
+		    nearest_any = (int)e;
+		    nearest_any_distance = distance;
+		}
+	    }
+
+	    const float any = sign * pseudo_distance(scratch, scratch.edges[nearest_any], nearest_any_distance, p);
+
+	    float channels[3];
+	    for(unsigned int c = 0; c < 3; ++c) {
+		channels[c] = nearest[c] < 0 ? any :
+		    sign * pseudo_distance(scratch, scratch.edges[nearest[c]], nearest_distance[c], p);
+	    }
+
+	    // where the channels disagree with the nearest edge about the side of the outline,
+	    // they would leave artifacts, so they are replaced by the single-channel distance.
+	    const float true_distance = sign * nearest_any_distance.distance;
+	    if((median(channels[0], channels[1], channels[2]) > 0.0f) != (true_distance > 0.0f)) {
+		channels[0] = channels[1] = channels[2] = any;
+	    }
+
+	    float* out = &scratch.field[(size_t)row * glyph.pitch + 3 * x];
+	    for(unsigned int c = 0; c < 3; ++c) {
+		out[c] = distance_value(channels[c], spread);
+	    }
+	}
+    }
+
+    correct_clashes(scratch, glyph.width, glyph.rows, spread);
+
+    pixels.resize(pixels.size() + (size_t)glyph.pitch * glyph.rows);
+    unsigned char* dst = &pixels[glyph.offset];
+
+    for(size_t i = 0; i < scratch.field.size(); ++i) {
+	dst[i] = (unsigned char)(scratch.field[i] * 255.0f + 0.5f);
+    }
+
+    return glyph;
+}
@@ -0,0 +1,70 @@
+#ifndef MSDF_H
+#define MSDF_H
+
+#include "glyph_store.h"
+
+#include <vector>
+
+/*
+  A point of a flattened outline, in pixels, with y growing upwards.
+*/
+struct MsdfPoint {
+    float x;
+    float y;
+};
+
+/*
+  A segment of the outline, as it was in the font: a line, or a conic or cubic curve. Curves
+  are flattened into several pieces. The channels of the edge are a bit mask of red, green
+  and blue, and the edge only adds to the distances of those channels.
+*/
+struct MsdfEdge {
+    // the pieces run from points[first_point] to points[first_point + num_pieces].
+    unsigned int first_point;
+    unsigned int num_pieces;
+
+    unsigned int channels;
+
+    // the bounding box of the points.
+    MsdfPoint min;
+    MsdfPoint max;
+};
+
+struct MsdfContour {
+    unsigned int first_edge;
+    unsigned int num_edges;
+};
+
+/*
+  Buffers for computing multi-channel distance fields. Every rendering thread has its own, and
+  reuses them for all of its glyphs.
+*/
+struct MsdfScratch {
+    std::vector<MsdfPoint> points;
+    std::vector<MsdfEdge> edges;
+    std::vector<MsdfContour> contours;
+
+    // the edges, while they are colored, and some of them are split up.
+    std::vector<MsdfEdge> colored_edges;
+
+    // the three distances of every pixel, in the range 0 to 1, before they are corrected and stored.
+    std::vector<float> field;
+    std::vector<unsigned int> clashes;
+};
+
+/*
+  Make a multi-channel signed distance field of the outline in the glyph slot, and append it to
+  the pixel arena, with 3 bytes per pixel. The glyph must have been loaded without rendering.
+
+  The edges of every contour are given colors, such that the two edges at every corner differ
+  in at least two channels. Every channel then holds the distance to the nearest edge of its
+  color, and the median of the three channels keeps the corners sharp. Pixels whose channels
+  would make artifacts when they are interpolated with a neighbour are set to the median.
+  128 is on the outline,
+  and the values reach 255 and 0 at spread pixels inside and outside of it. The field has a
+  border of spread pixels around the outline.
+*/
+Glyph store_msdf_glyph(std::vector<unsigned char>& pixels, unsigned int ch, FT_GlyphSlot slot,
+		       unsigned int spread, MsdfScratch& scratch);
+
+#endif
@@ -0,0 +1,299 @@
+#include "options.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <thread>
+
+using std::string;
+
+AtlasOptions::AtlasOptions() :
+    padding(PADDING_DEFAULT),
+    heuristic(PACK_SKYLINE_BOTTOM_LEFT),
+    max_page_size(MAX_PAGE_SIZE_DEFAULT),
+    size_constraint(SIZE_ANY),
+    format(ATLAS_RGBA),
+    sdf_spread(SDF_SPREAD_DEFAULT),
+    png_speed(PNG_SPEED_BALANCED),
+    num_threads(std::thread::hardware_concurrency()) {
+
+    font_sizes.push_back(FONT_SIZE_DEFALT);
+
+    CharRange range = { DEFAULT_START_CHAR, DEFAULT_END_CHAR };
+    char_ranges.push_back(range);
+
+    if(num_threads == 0) {
+	num_threads = 1;
+    }
+}
+
+/*
+  Get the value that follows the flag at args[i], and skip it.
+  Returns NULL, after printing an error, if there is no value.
+*/
+static const char* flag_value(const std::vector<string>& args, size_t& i, const char* what) {
+    if( (i+1) == args.size() ) {
+	printf("ERROR: no %s has been provided\n", what);
+	return NULL;
+    }
+
+    ++i;
+    return args[i].c_str();
+}
+
+/*
+  Parse a positive number. Returns false if str is not one.
+*/
+static bool parse_positive(const char* str, unsigned int& value) {
+    char* end;
+    const long number = strtol(str, &end, 10);
+
+    if(end == str || *end != '\0' || number <= 0) {
+	return false;
+    }
+
+    value = (unsigned int)number;
+    return true;
+}
+
+/*
+  Parse a comma separated list of font sizes, such as "16,32,64".
+*/
+static bool parse_font_sizes(const char* str, std::vector<FT_F26Dot6>& font_sizes) {
+    while(true) {
+	char* end;
+	const long font_size = strtol(str, &end, 10);
+
+	if(end == str || font_size <= 0) {
+	    return false;
+	}
+
+	font_sizes.push_back(font_size);
+
+	if(*end == '\0') {
+	    return true;
+	} else if(*end != ',') {
+	    return false;
+	}
+
+	str = end + 1;
+    }
+}
+
+bool parse_options(const std::vector<string>& args, AtlasOptions& options) {
+
+    // given sizes and characters replace the current ones, rather than adding to them.
+    std::vector<FT_F26Dot6> font_sizes;
+    std::vector<CharRange> char_ranges;
+
+    for (size_t i = 0; i < args.size(); i++) {
+
+	const char* arg = args[i].c_str();
+	const char* value;
+
+	if(strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0  ) {
+	    print_help();
+	    exit(0);
+	} else if(strcmp(arg, "-fs") == 0 || strcmp(arg, "--font-size") == 0  ) {
+	    if( (value = flag_value(args, i, "font size")) == NULL) {
+		return false;
+	    }
+
+	    if(!parse_font_sizes(value, font_sizes)) {
+		printf("ERROR: invalid font size specified.\n");
+		return false;
+	    }
+	} else if(strcmp(arg, "-j") == 0 || strcmp(arg, "--threads") == 0  ) {
+	    if( (value = flag_value(args, i, "number of threads")) == NULL) {
+		return false;
+	    }
+
+	    if(!parse_positive(value, options.num_threads)) {
+		printf("ERROR: invalid number of threads specified.\n");
+		return false;
+	    }
+	} else if(strcmp(arg, "-p") == 0 || strcmp(arg, "--padding") == 0  ) {
+	    if( (value = flag_value(args, i, "padding")) == NULL) {
+		return false;
+	    }
+
+	    // zero padding is allowed.
+	    if(strcmp(value, "0") == 0) {
+		options.padding = 0;
+	    } else if(!parse_positive(value, options.padding)) {
+		printf("ERROR: invalid padding specified.\n");
+		return false;
+	    }
+	} else if(strcmp(arg, "--packer") == 0) {
+	    if( (value = flag_value(args, i, "packer")) == NULL) {
+		return false;
+	    }
+
+	    if(!parse_pack_heuristic(value, options.heuristic)) {
+		printf("ERROR: unknown packer %s.\n", value);
+		return false;
+	    }
+	} else if(strcmp(arg, "-r") == 0 || strcmp(arg, "--range") == 0  ) {
+	    if( (value = flag_value(args, i, "character range")) == NULL) {
+		return false;
+	    }
+
+	    if(!parse_char_range(value, char_ranges)) {
+		printf("ERROR: invalid character range %s.\n", value);
+		return false;
+	    }
+	} else if(strcmp(arg, "-c") == 0 || strcmp(arg, "--charset") == 0  ) {
+	    if( (value = flag_value(args, i, "charset file")) == NULL) {
+		return false;
+	    }
+
+	    if(!load_charset_file(value, char_ranges)) {
+		printf("ERROR: could not read the charset file %s.\n", value);
+		return false;
+	    }
+	} else if(strcmp(arg, "--max-page-size") == 0) {
+	    if( (value = flag_value(args, i, "page size")) == NULL) {
+		return false;
+	    }
+
+	    if(!parse_positive(value, options.max_page_size) || options.max_page_size > MAX_ATLAS_SIZE) {
+		printf("ERROR: invalid page size specified.\n");
+		return false;
+	    }
+	} else if(strcmp(arg, "--size-constraint") == 0) {
+	    if( (value = flag_value(args, i, "size constraint")) == NULL) {
+		return false;
+	    }
+
+	    if(!parse_size_constraint(value, options.size_constraint)) {
+		printf("ERROR: unknown size constraint %s.\n", value);
+		return false;
+	    }
+	} else if(strcmp(arg, "--format") == 0) {
+	    if( (value = flag_value(args, i, "format")) == NULL) {
+		return false;
+	    }
+
+	    if(strcmp(value, "rgba") == 0) {
+		options.format = ATLAS_RGBA;
+	    } else if(strcmp(value, "grey") == 0) {
+		options.format = ATLAS_GREY;
+	    } else if(strcmp(value, "lcd") == 0) {
+		options.format = ATLAS_LCD;
+	    } else if(strcmp(value, "sdf") == 0) {
+		options.format = ATLAS_SDF;
+	    } else if(strcmp(value, "msdf") == 0) {
+		options.format = ATLAS_MSDF;
+	    } else {
+		printf("ERROR: unknown format %s.\n", value);
+		return false;
+	    }
+	} else if(strcmp(arg, "--sdf") == 0) {
+	    options.format = ATLAS_SDF;
+	} else if(strcmp(arg, "--msdf") == 0) {
+	    options.format = ATLAS_MSDF;
+	} else if(strcmp(arg, "--sdf-spread") == 0) {
+	    if( (value = flag_value(args, i, "spread")) == NULL) {
+		return false;
+	    }
+
+	    if(!parse_positive(value, options.sdf_spread)) {
+		printf("ERROR: invalid spread specified.\n");
+		return false;
+	    }
+	} else if(strcmp(arg, "--png-speed") == 0) {
+	    if( (value = flag_value(args, i, "png speed")) == NULL) {
+		return false;
+	    }
+
+	    if(!parse_png_speed(value, options.png_speed)) {
+		printf("ERROR: unknown png speed %s.\n", value);
+		return false;
+	    }
+	} else if(strcmp(arg, "-b") == 0 || strcmp(arg, "--batch") == 0  ) {
+	    if( (value = flag_value(args, i, "batch file")) == NULL) {
+		return false;
+	    }
+
+	    options.batch_file = value;
+	} else if(strcmp(arg, "--cache-dir") == 0) {
+	    if( (value = flag_value(args, i, "cache directory")) == NULL) {
+		return false;
+	    }
+
+	    options.cache_dir = value;
+	} else if(strcmp(arg, "--amf-to-amfb") == 0) {
+	    if( (value = flag_value(args, i, ".amf-file")) == NULL) {
+		return false;
+	    }
+
+	    options.amf_to_convert = value;
+	} else if(arg[0] == '-') {
+	    printf("ERROR: unknown flag %s.\n", arg);
+	    return false;
+	} else {
+	    options.input_file = arg;
+	}
+    }
+
+    if(!font_sizes.empty()) {
+	options.font_sizes = font_sizes;
+    }
+
+    if(!char_ranges.empty()) {
+	options.char_ranges = char_ranges;
+    }
+
+    return true;
+}
+
+unsigned int atlas_format_channels(AtlasFormat format) {
+    if(format == ATLAS_GREY || format == ATLAS_SDF) {
+	return 1;
+    } else if(format == ATLAS_MSDF) {
+	return 3;
+    }
+    return 4;
+}
+
+string options_settings(const AtlasOptions& options) {
+    return
+	string("font_creator_cpp ") + PROGRAM_VERSION + "\n" +
+	"padding " + std::to_string(options.padding) + "\n" +
+	"packer " + pack_heuristic_name(options.heuristic) + "\n" +
+	"max-page-size " + std::to_string(options.max_page_size) + "\n" +
+	"size-constraint " + std::to_string((int)options.size_constraint) + "\n" +
+	"format " + std::to_string((int)options.format) + "\n" +
+	"sdf-spread " + std::to_string(options.sdf_spread) + "\n" +
+	"png-speed " + png_speed_name(options.png_speed) + "\n";
+}
+
+void print_help() {
+    printf("Usage:\n");
+    printf("font_creator_cpp [FLAGS] input-file\n");
+    printf("font_creator_cpp [FLAGS] --batch batch-file\n");
+    printf("font_creator_cpp --amf-to-amfb amf-file\n\n");
+
+    printf("Flags:\n");
+
+
+    printf("\t-h,--help\t\tPrint this message\n");
+    printf( "\t-fs,--font-size\t\tFont size, or comma separated list of font sizes. Default value: %d\n", FONT_SIZE_DEFALT );
+    printf( "\t-p,--padding\t\tNumber of empty pixels between the glyphs. Default value: %d\n", PADDING_DEFAULT );
+    printf( "\t--packer\t\tGlyph packing heuristic: skyline, maxrects or guillotine. Default value: skyline\n" );
+    printf( "\t-r,--range\t\tCharacters to include, such as U+0400-U+04FF. Can be given many times. Default value: U+0020-U+007E\n" );
+    printf( "\t-c,--charset\t\tUTF-8 text file with the characters to include. Can be given many times\n" );
+    printf( "\t--max-page-size\t\tMaximum width and height of an atlas page. Default value: %d\n", MAX_PAGE_SIZE_DEFAULT );
+    printf( "\t--size-constraint\tAtlas size constraint: none, mul4 or pot. Default value: none\n" );
+    printf( "\t--format\t\tPixel format of the atlas: rgba, grey for only the coverage, lcd for subpixel coverage, sdf or msdf. Default value: rgba\n" );
+    printf( "\t--sdf\t\t\tCreate a single channel signed distance field atlas. The same as --format sdf\n" );
+    printf( "\t--msdf\t\t\tCreate a three channel signed distance field atlas from the glyph outlines. The same as --format msdf\n" );
+    printf( "\t--sdf-spread\t\tHow many pixels a distance field reaches out of and into the glyphs. Default value: %d\n", SDF_SPREAD_DEFAULT );
+    printf( "\t--png-speed\t\tAtlas image compression: fastest, balanced or smallest. Default value: balanced\n" );
+    printf( "\t--cache-dir\t\tReuse atlases that were created before with the same font and flags from this directory\n" );
+    printf( "\t-b,--batch\t\tRun every line of the batch file as a job. The flags on a line override the flags on the command line\n" );
+    printf( "\t--amf-to-amfb\t\tConvert an .amf-file to the binary .amfb format\n" );
+    printf( "\t-j,--threads\t\tNumber of threads used for rendering and for running jobs. Default value: number of cores\n" );
+
+}
@@ -0,0 +1,124 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "charset.h"
+#include "packer.h"
+#include "png_encode.h"
+
+#include <string>
+#include <vector>
+
+/*
+  Part of the key of every cached atlas. It has to be changed whenever a change to the
+  program changes the files it creates.
+*/
+#define PROGRAM_VERSION "1.12.0"
+
+// the characters that are put into the atlas, if no --range or --charset is given.
+#define DEFAULT_START_CHAR 32
+#define DEFAULT_END_CHAR 126
+
+#define FONT_SIZE_DEFALT 64
+
+#define PADDING_DEFAULT 1
+
+#define SDF_SPREAD_DEFAULT 4
+
+// the largest atlas width and height that we will ever try.
+#define MAX_ATLAS_SIZE 32768
+
+#define MAX_PAGE_SIZE_DEFAULT MAX_ATLAS_SIZE
+
+/*
+  The pixel format of the atlas images.
+*/
+enum AtlasFormat {
+    // white, with the glyph coverage in the alpha channel.
+    ATLAS_RGBA,
+
+    // only the glyph coverage, in a single channel.
+    ATLAS_GREY,
+
+    // rendered for LCD screens. RGB is the coverage of the three subpixels, and alpha is the largest of them.
+    ATLAS_LCD,
+
+    // a signed distance field in a single channel, that can be scaled to any size.
+    ATLAS_SDF,
+
+    // a signed distance field with three channels in RGB, that keeps the corners sharp.
+    ATLAS_MSDF
+};
+
+/*
+  Everything that can be set from the command line, or from a line in a batch file.
+*/
+struct AtlasOptions {
+    // the font file to create atlases for.
+    std::string input_file;
+
+    // one atlas is created for every font size.
+    std::vector<FT_F26Dot6> font_sizes;
+
+    // the characters to put into the atlas.
+    std::vector<CharRange> char_ranges;
+
+    // the number of empty pixels kept between the glyphs in the atlas.
+    unsigned int padding;
+
+    // the heuristic used for placing the glyphs in the atlas.
+    PackHeuristic heuristic;
+
+    // the maximum width and height of an atlas page.
+    unsigned int max_page_size;
+
+    // the constraint on the atlas dimensions.
+    SizeConstraint size_constraint;
+
+    AtlasFormat format;
+
+    // how many pixels a distance field reaches out of and into the glyphs. Used by both kinds of distance field.
+    unsigned int sdf_spread;
+
+    // how hard the atlas images are compressed.
+    PngSpeed png_speed;
+
+    // the number of threads used for rendering the glyphs, and for running batch jobs.
+    unsigned int num_threads;
+
+    // if not empty, the file that lists the jobs to run.
+    std::string batch_file;
+
+    // if not empty, the directory where created atlases are cached.
+    std::string cache_dir;
+
+    // if not empty, the .amf-file to convert to an .amfb-file.
+    std::string amf_to_convert;
+
+    AtlasOptions();
+};
+
+/*
+  Parse arguments into options. Options that are not in the arguments keep their values, so a
+  line in a batch file only has to give what differs from the command line.
+
+  If something is wrong with the arguments, an error message is printed, and false is returned.
+*/
+bool parse_options(const std::vector<std::string>& args, AtlasOptions& options);
+
+/*
+  The number of bytes per pixel of an atlas image.
+*/
+unsigned int atlas_format_channels(AtlasFormat format);
+
+/*
+  All the options that affect the created files, except for the input file, the font sizes and
+  the characters, written out as text. Used as part of the cache key.
+*/
+std::string options_settings(const AtlasOptions& options);
+
+void print_help();
+
+#endif
@@ -0,0 +1,662 @@
+#include "packer.h"
+
+#include <algorithm>
+#include <climits>
+#include <math.h>
+#include <string.h>
+
+/*
+  The number of different atlas widths that find_bin_size tries.
+*/
+#define SIZE_SEARCH_WIDTHS 16
+
+/*
+  Free space, as used by the MaxRects and guillotine packers.
+*/
+struct FreeRect {
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+};
+
+/*
+  A horizontal segment of the skyline, at height y.
+*/
+struct SkylineNode {
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+};
+
+/*
+  All packers work offline: rectangles are placed from tallest to shortest,
+  which gives much tighter results than placing them in character order.
+  Ties are broken by the original index, so the result is always the same.
+*/
+struct HeightGreater {
+    const std::vector<PackRect>* rects;
+
+    bool operator()(unsigned int a, unsigned int b) const {
+	const PackRect& ra = (*rects)[a];
+	const PackRect& rb = (*rects)[b];
+
+	if(ra.height != rb.height) {
+	    return ra.height > rb.height;
+	}
+	if(ra.width != rb.width) {
+	    return ra.width > rb.width;
+	}
+	return a < b;
+    }
+};
+
+/*
+  Skyline bottom-left.
+*/
+
+/*
+  Find the lowest y at which a rectangle of the given width can rest, if its left edge
+  is at the left edge of skyline node i. Returns false if it does not fit horizontally.
+*/
+static bool skyline_fit(const std::vector<SkylineNode>& skyline, size_t i,
+			unsigned int width, unsigned int bin_width, unsigned int& y) {
+
+    const unsigned int x = skyline[i].x;
+    if(x + width > bin_width) {
+	return false;
+    }
+
+    unsigned int width_left = width;
+    y = skyline[i].y;
+
+    while(width_left > 0) {
+	if(skyline[i].y > y) {
+	    y = skyline[i].y;
+	}
+
+	if(skyline[i].width >= width_left) {
+	    break;
+	}
+
+	width_left -= skyline[i].width;
+	++i;
+    }
+
+    return true;
+}
+
+/*
+  Raise the skyline below the newly placed rectangle.
+*/
+static void skyline_add_level(std::vector<SkylineNode>& skyline, size_t i, const PackRect& rect) {
+
+    SkylineNode node;
+    node.x = rect.x;
+    node.y = rect.y + rect.height;
+    node.width = rect.width;
+    skyline.insert(skyline.begin() + i, node);
+
+    // shrink or remove the nodes that are now covered by the new node.
+    for(size_t j = i + 1; j < skyline.size(); ) {
+	const unsigned int node_end = node.x + node.width;
+
+	if(skyline[j].x >= node_end) {
+	    break;
+	}
+
+	const unsigned int shrink = node_end - skyline[j].x;
+	if(skyline[j].width <= shrink) {
+	    skyline.erase(skyline.begin() + j);
+	} else {
+	    skyline[j].x += shrink;
+	    skyline[j].width -= shrink;
+	    break;
+	}
+    }
+
+    // merge neighbouring nodes at the same height.
+    for(size_t j = 0; j + 1 < skyline.size(); ) {
+	if(skyline[j].y == skyline[j+1].y) {
+	    skyline[j].width += skyline[j+1].width;
+	    skyline.erase(skyline.begin() + j + 1);
+	} else {
+	    ++j;
+	}
+    }
+}
+
+static bool pack_skyline(std::vector<PackRect>& rects, const std::vector<unsigned int>& order,
+			 unsigned int bin_width, unsigned int bin_height) {
+
+    std::vector<SkylineNode> skyline;
+    SkylineNode ground = { 0, 0, bin_width };
+    skyline.push_back(ground);
+
+    for(size_t k = 0; k < order.size(); ++k) {
+	PackRect& rect = rects[order[k]];
+
+	unsigned int best_top = UINT_MAX;
+	unsigned int best_width = UINT_MAX;
+	size_t best_node = 0;
+
+	for(size_t i = 0; i < skyline.size(); ++i) {
+	    unsigned int y;
+	    if(!skyline_fit(skyline, i, rect.width, bin_width, y)) {
+		continue;
+	    }
+
+	    const unsigned int top = y + rect.height;
+	    if(top > bin_height) {
+		continue;
+	    }
+
+	    if(top < best_top || (top == best_top && skyline[i].width < best_width)) {
+		best_top = top;
+		best_width = skyline[i].width;
+		best_node = i;
+		rect.x = skyline[i].x;
+		rect.y = y;
+	    }
+	}
+
+	if(best_top == UINT_MAX) {
+	    return false;
+	}
+
+	skyline_add_level(skyline, best_node, rect);
+    }
+
+    return true;
+}
+
+/*
+  MaxRects, best short side fit.
+*/
+
+static bool contains(const FreeRect& a, const FreeRect& b) {
+    return b.x >= a.x && b.y >= a.y &&
+	b.x + b.width <= a.x + a.width &&
+	b.y + b.height <= a.y + a.height;
+}
+
+/*
+  If the placed rectangle overlaps the free rectangle, add the up to four maximal
+  free rectangles that remain of it to new_free, and return true.
+*/
+static bool maxrects_split(const FreeRect& free_rect, const PackRect& used, std::vector<FreeRect>& new_free) {
+
+    if(used.x >= free_rect.x + free_rect.width || used.x + used.width <= free_rect.x ||
+       used.y >= free_rect.y + free_rect.height || used.y + used.height <= free_rect.y) {
+	return false;
+    }
+
+    if(used.x > free_rect.x) {
+	FreeRect r = free_rect;
+	r.width = used.x - free_rect.x;
+	new_free.push_back(r);
+    }
+    if(used.x + used.width < free_rect.x + free_rect.width) {
+	FreeRect r = free_rect;
+	r.x = used.x + used.width;
+	r.width = free_rect.x + free_rect.width - r.x;
+	new_free.push_back(r);
+    }
+    if(used.y > free_rect.y) {
+	FreeRect r = free_rect;
+	r.height = used.y - free_rect.y;
+	new_free.push_back(r);
+    }
+    if(used.y + used.height < free_rect.y + free_rect.height) {
+	FreeRect r = free_rect;
+	r.y = used.y + used.height;
+	r.height = free_rect.y + free_rect.height - r.y;
+	new_free.push_back(r);
+    }
+
+    return true;
+}
+
+static bool pack_maxrects(std::vector<PackRect>& rects, const std::vector<unsigned int>& order,
+			  unsigned int bin_width, unsigned int bin_height) {
+
+    std::vector<FreeRect> free_rects;
+    FreeRect bin = { 0, 0, bin_width, bin_height };
+    free_rects.push_back(bin);
+
+    std::vector<FreeRect> kept;
+    std::vector<FreeRect> new_free;
+
+    for(size_t k = 0; k < order.size(); ++k) {
+	PackRect& rect = rects[order[k]];
+
+	unsigned int best_short = UINT_MAX;
+	unsigned int best_long = UINT_MAX;
+
+	for(size_t i = 0; i < free_rects.size(); ++i) {
+	    const FreeRect& f = free_rects[i];
+	    if(f.width < rect.width || f.height < rect.height) {
+		continue;
+	    }
+
+	    const unsigned int leftover_x = f.width - rect.width;
+	    const unsigned int leftover_y = f.height - rect.height;
+	    const unsigned int short_side = std::min(leftover_x, leftover_y);
+	    const unsigned int long_side = std::max(leftover_x, leftover_y);
+
+	    if(short_side < best_short || (short_side == best_short && long_side < best_long)) {
+		best_short = short_side;
+		best_long = long_side;
+		rect.x = f.x;
+		rect.y = f.y;
+	    }
+	}
+
+	if(best_short == UINT_MAX) {
+	    return false;
+	}
+
+	// split every free rectangle that the new rectangle overlaps.
+	kept.clear();
+	new_free.clear();
+	for(size_t i = 0; i < free_rects.size(); ++i) {
+	    if(!maxrects_split(free_rects[i], rect, new_free)) {
+		kept.push_back(free_rects[i]);
+	    }
+	}
+
+	// the new free rectangles are maximal within their parent, but may be contained in another free rectangle.
+	for(size_t i = 0; i < new_free.size(); ++i) {
+	    bool redundant = false;
+
+	    for(size_t j = 0; j < kept.size() && !redundant; ++j) {
+		redundant = contains(kept[j], new_free[i]);
+	    }
+	    for(size_t j = 0; j < new_free.size() && !redundant; ++j) {
+		if(j != i && contains(new_free[j], new_free[i])) {
+		    // of two identical rectangles, only keep the first one.
+		    redundant = !contains(new_free[i], new_free[j]) || j < i;
+		}
+	    }
+
+	    if(!redundant) {
+		kept.push_back(new_free[i]);
+	    }
+	}
+
+	free_rects.swap(kept);
+    }
+
+    return true;
+}
+
+/*
+  Guillotine, best area fit, with the leftover split along the shorter axis.
+*/
+
+static bool pack_guillotine(std::vector<PackRect>& rects, const std::vector<unsigned int>& order,
+			    unsigned int bin_width, unsigned int bin_height) {
+
+    std::vector<FreeRect> free_rects;
+    FreeRect bin = { 0, 0, bin_width, bin_height };
+    free_rects.push_back(bin);
+
+    for(size_t k = 0; k < order.size(); ++k) {
+	PackRect& rect = rects[order[k]];
+
+	unsigned long long best_area = ULLONG_MAX;
+	size_t best = 0;
+
+	for(size_t i = 0; i < free_rects.size(); ++i) {
+	    const FreeRect& f = free_rects[i];
+	    if(f.width < rect.width || f.height < rect.height) {
+		continue;
+	    }
+
+	    const unsigned long long area = (unsigned long long)f.width * f.height;
+	    if(area < best_area) {
+		best_area = area;
+		best = i;
+	    }
+	}
+
+	if(best_area == ULLONG_MAX) {
+	    return false;
+	}
+
+	const FreeRect f = free_rects[best];
+	free_rects.erase(free_rects.begin() + best);
+
+	rect.x = f.x;
+	rect.y = f.y;
+
+	const unsigned int leftover_x = f.width - rect.width;
+	const unsigned int leftover_y = f.height - rect.height;
+
+	FreeRect right = { f.x + rect.width, f.y, leftover_x, 0 };
+	FreeRect bottom = { f.x, f.y + rect.height, 0, leftover_y };
+
+	// cut along the shorter leftover axis, so that the larger leftover stays in one piece.
+	if(leftover_x < leftover_y) {
+	    right.height = rect.height;
+	    bottom.width = f.width;
+	} else {
+	    right.height = f.height;
+	    bottom.width = rect.width;
+	}
+
+	if(right.width > 0 && right.height > 0) {
+	    free_rects.push_back(right);
+	}
+	if(bottom.width > 0 && bottom.height > 0) {
+	    free_rects.push_back(bottom);
+	}
+    }
+
+    return true;
+}
+
+bool pack_rects(std::vector<PackRect>& rects, unsigned int bin_width, unsigned int bin_height, PackHeuristic heuristic) {
+
+    std::vector<unsigned int> order;
+    order.reserve(rects.size());
+
+    for(unsigned int i = 0; i < rects.size(); ++i) {
+	if(rects[i].width == 0 || rects[i].height == 0) {
+	    rects[i].x = 0;
+	    rects[i].y = 0;
+	} else {
+	    order.push_back(i);
+	}
+    }
+
+    HeightGreater height_greater;
+    height_greater.rects = &rects;
+    std::sort(order.begin(), order.end(), height_greater);
+
+    switch(heuristic) {
+    case PACK_MAXRECTS_BEST_SHORT_SIDE_FIT:
+	return pack_maxrects(rects, order, bin_width, bin_height);
+    case PACK_GUILLOTINE:
+	return pack_guillotine(rects, order, bin_width, bin_height);
+    case PACK_SKYLINE_BOTTOM_LEFT:
+    default:
+	return pack_skyline(rects, order, bin_width, bin_height);
+    }
+}
+
+/*
+  Every constraint allows an increasing sequence of sizes. A size is identified by its step
+  in that sequence, which makes it possible to binary search over the allowed sizes only.
+*/
+
+static unsigned int size_of_step(unsigned int step, SizeConstraint constraint) {
+    switch(constraint) {
+    case SIZE_POWER_OF_TWO:
+	return 1u << step;
+    case SIZE_MULTIPLE_OF_4:
+	return 4 * (step + 1);
+    case SIZE_ANY:
+    default:
+	return step + 1;
+    }
+}
+
+// the step of the smallest allowed size that is at least size.
+static unsigned int step_at_least(unsigned int size, SizeConstraint constraint) {
+    if(size <= 1) {
+	size = 1;
+    }
+
+    switch(constraint) {
+    case SIZE_POWER_OF_TWO: {
+	unsigned int step = 0;
+	while((1u << step) < size) {
+	    ++step;
+	}
+	return step;
+    }
+    case SIZE_MULTIPLE_OF_4:
+	return (size + 3) / 4 - 1;
+    case SIZE_ANY:
+    default:
+	return size - 1;
+    }
+}
+
+// the step of the largest allowed size that is at most size. size must be at least the smallest allowed size.
+static unsigned int step_at_most(unsigned int size, SizeConstraint constraint) {
+    const unsigned int step = step_at_least(size, constraint);
+    return size_of_step(step, constraint) > size ? step - 1 : step;
+}
+
+bool find_bin_size(std::vector<PackRect>& rects, PackHeuristic heuristic, SizeConstraint constraint,
+		   unsigned int max_size, unsigned int& bin_width, unsigned int& bin_height) {
+
+    unsigned long long total_area = 0;
+    unsigned int max_width = 1;
+    unsigned int max_height = 1;
+
+    for(size_t i = 0; i < rects.size(); ++i) {
+	if(rects[i].width == 0 || rects[i].height == 0) {
+	    continue;
+	}
+
+	total_area += (unsigned long long)rects[i].width * rects[i].height;
+	max_width = std::max(max_width, rects[i].width);
+	max_height = std::max(max_height, rects[i].height);
+    }
+
+    if(max_size < size_of_step(0, constraint) || max_width > max_size || max_height > max_size) {
+	return false;
+    }
+    const unsigned int max_step = step_at_most(max_size, constraint);
+
+    /*
+      The width of the smallest bin is probably not far from the square root of the total area.
+      So we try a range of widths around it, and for each width, binary search the smallest
+      height that works.
+    */
+
+    const double side = sqrt((double)total_area);
+    const unsigned int lowest_step = step_at_least(std::max(max_width, (unsigned int)(side / 2)), constraint);
+    if(lowest_step > max_step) {
+	return false;
+    }
+    const unsigned int highest_step = std::max(lowest_step, std::min(max_step, step_at_least((unsigned int)ceil(side * 2), constraint)));
+
+    std::vector<unsigned int> width_steps;
+    if(highest_step - lowest_step < SIZE_SEARCH_WIDTHS) {
+	for(unsigned int step = lowest_step; step <= highest_step; ++step) {
+	    width_steps.push_back(step);
+	}
+    } else {
+	const double lowest = size_of_step(lowest_step, constraint);
+	const double highest = size_of_step(highest_step, constraint);
+
+	for(unsigned int i = 0; i < SIZE_SEARCH_WIDTHS; ++i) {
+	    const double width = lowest * pow(highest / lowest, i / (double)(SIZE_SEARCH_WIDTHS - 1));
+	    const unsigned int step = std::min(highest_step, step_at_least((unsigned int)(width + 0.5), constraint));
+
+	    if(width_steps.empty() || width_steps.back() != step) {
+		width_steps.push_back(step);
+	    }
+	}
+    }
+
+    unsigned long long best_area = ULLONG_MAX;
+
+    for(size_t i = 0; i < width_steps.size(); ++i) {
+	const unsigned int width = size_of_step(width_steps[i], constraint);
+
+	// no height below this can hold all the rectangles.
+	unsigned long long min_height = std::max((unsigned long long)max_height, (total_area + width - 1) / width);
+	if(min_height > max_size) {
+	    continue;
+	}
+	unsigned int lo = step_at_least((unsigned int)min_height, constraint);
+	if(lo > max_step) {
+	    continue;
+	}
+
+	// only heights that would beat the best bin so far are interesting.
+	unsigned int hi = max_step;
+	if(best_area != ULLONG_MAX) {
+	    const unsigned long long beating = (best_area - 1) / width;
+	    if(beating < size_of_step(lo, constraint)) {
+		continue;
+	    }
+	    hi = std::min(hi, step_at_most((unsigned int)std::min(beating, (unsigned long long)max_size), constraint));
+	}
+
+	if(!pack_rects(rects, width, size_of_step(hi, constraint), heuristic)) {
+	    continue;
+	}
+
+	while(lo < hi) {
+	    const unsigned int mid = lo + (hi - lo) / 2;
+
+	    if(pack_rects(rects, width, size_of_step(mid, constraint), heuristic)) {
+		hi = mid;
+	    } else {
+		lo = mid + 1;
+	    }
+	}
+
+	const unsigned int height = size_of_step(hi, constraint);
+	best_area = (unsigned long long)width * height;
+	bin_width = width;
+	bin_height = height;
+    }
+
+    if(best_area == ULLONG_MAX) {
+	return false;
+    }
+
+    // the last attempt was not necessarily the best bin, so pack again.
+    return pack_rects(rects, bin_width, bin_height, heuristic);
+}
+
+/*
+  Copy the rectangles [begin, end) into subset, and check if they fit into a square bin.
+*/
+static bool fits_page(const std::vector<PackRect>& rects, size_t begin, size_t end,
+		      PackHeuristic heuristic, unsigned int page_size, std::vector<PackRect>& subset) {
+    subset.assign(rects.begin() + begin, rects.begin() + end);
+    return pack_rects(subset, page_size, page_size, heuristic);
+}
+
+bool pack_pages(std::vector<PackRect>& rects, const std::vector<bool>& preferred_break,
+		PackHeuristic heuristic, SizeConstraint constraint, unsigned int max_page_size,
+		std::vector<PackPage>& pages) {
+
+    if(max_page_size < size_of_step(0, constraint)) {
+	return false;
+    }
+    // the largest page that satisfies the constraint.
+    const unsigned int page_size = size_of_step(step_at_most(max_page_size, constraint), constraint);
+
+    for(size_t i = 0; i < rects.size(); ++i) {
+	if(rects[i].width > page_size || rects[i].height > page_size) {
+	    return false;
+	}
+    }
+
+    pages.clear();
+    std::vector<PackRect> subset;
+
+    size_t begin = 0;
+    do {
+	size_t end = rects.size();
+
+	if(!fits_page(rects, begin, end, heuristic, page_size, subset)) {
+
+	    // binary search the longest run of rectangles that fits on a full page.
+	    size_t lo = begin + 1;
+	    size_t hi = end - 1;
+
+	    while(lo < hi) {
+		const size_t mid = lo + (hi - lo + 1) / 2;
+
+		if(fits_page(rects, begin, mid, heuristic, page_size, subset)) {
+		    lo = mid;
+		} else {
+		    hi = mid - 1;
+		}
+	    }
+	    end = lo;
+
+	    // rather end the page a bit early, than split up a group of rectangles that belong together.
+	    const size_t earliest = begin + (end - begin) * 3 / 4 + 1;
+	    for(size_t i = end; i >= earliest; --i) {
+		if(i < preferred_break.size() && preferred_break[i]) {
+		    end = i;
+		    break;
+		}
+	    }
+	}
+
+	PackPage page;
+	subset.assign(rects.begin() + begin, rects.begin() + end);
+
+	if(!find_bin_size(subset, heuristic, constraint, page_size, page.width, page.height)) {
+	    // the size search only tries widths near the square root of the area, but a full page always works.
+	    page.width = page_size;
+	    page.height = page_size;
+
+	    if(!pack_rects(subset, page_size, page_size, heuristic)) {
+		return false;
+	    }
+	}
+
+	for(size_t i = begin; i < end; ++i) {
+	    rects[i].x = subset[i - begin].x;
+	    rects[i].y = subset[i - begin].y;
+	    rects[i].page = (unsigned int)pages.size();
+	    page.rects.push_back((unsigned int)i);
+	}
+
+	pages.push_back(page);
+	begin = end;
+    } while(begin < rects.size());
+
+    return true;
+}
+
+bool parse_pack_heuristic(const char* name, PackHeuristic& heuristic) {
+    if(strcmp(name, "skyline") == 0) {
+	heuristic = PACK_SKYLINE_BOTTOM_LEFT;
+    } else if(strcmp(name, "maxrects") == 0) {
+	heuristic = PACK_MAXRECTS_BEST_SHORT_SIDE_FIT;
+    } else if(strcmp(name, "guillotine") == 0) {
+	heuristic = PACK_GUILLOTINE;
+    } else {
+	return false;
+    }
+    return true;
+}
+
+const char* pack_heuristic_name(PackHeuristic heuristic) {
+    switch(heuristic) {
+    case PACK_MAXRECTS_BEST_SHORT_SIDE_FIT:
+	return "maxrects";
+    case PACK_GUILLOTINE:
+	return "guillotine";
+    case PACK_SKYLINE_BOTTOM_LEFT:
+    default:
+	return "skyline";
+    }
+}
+
+bool parse_size_constraint(const char* name, SizeConstraint& constraint) {
+    if(strcmp(name, "none") == 0) {
+	constraint = SIZE_ANY;
+    } else if(strcmp(name, "mul4") == 0) {
+	constraint = SIZE_MULTIPLE_OF_4;
+    } else if(strcmp(name, "pot") == 0) {
+	constraint = SIZE_POWER_OF_TWO;
+    } else {
+	return false;
+    }
+    return true;
+}
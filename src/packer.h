@@ -0,0 +1,100 @@
+#ifndef PACKER_H
+#define PACKER_H
+
+#include <vector>
+
+/*
+  The heuristics that can be used for placing the glyph rectangles in the atlas.
+*/
+enum PackHeuristic {
+    // keep track of the top edge of the used area, and put every rectangle as low, and then as far left, as possible.
+    PACK_SKYLINE_BOTTOM_LEFT,
+
+    // keep a list of maximal free rectangles, and pick the one where the shorter leftover side is smallest.
+    PACK_MAXRECTS_BEST_SHORT_SIDE_FIT,
+
+    // keep a list of disjoint free rectangles, pick the one with the smallest area, and split the leftover in two.
+    PACK_GUILLOTINE
+};
+
+/*
+  Constraints on the dimensions of the atlas.
+*/
+enum SizeConstraint {
+    SIZE_ANY,
+
+    // needed by block-compressed texture formats, which work on 4x4 blocks.
+    SIZE_MULTIPLE_OF_4,
+
+    SIZE_POWER_OF_TWO
+};
+
+/*
+  A rectangle to be packed. width and height are inputs, x, y and page are outputs.
+*/
+struct PackRect {
+    unsigned int width;
+    unsigned int height;
+
+    unsigned int x;
+    unsigned int y;
+
+    // only set by pack_pages.
+    unsigned int page;
+};
+
+/*
+  A page of a multi-page atlas.
+*/
+struct PackPage {
+    unsigned int width;
+    unsigned int height;
+
+    // indices of the rectangles on this page.
+    std::vector<unsigned int> rects;
+};
+
+/*
+  Try to place all the rectangles into a bin of size bin_width x bin_height, without any overlaps.
+  Returns true if all rectangles were placed. Otherwise false is returned, and the positions are undefined.
+
+  Rectangles with a zero width or height take up no space, and are all placed at (0,0).
+*/
+bool pack_rects(std::vector<PackRect>& rects, unsigned int bin_width, unsigned int bin_height, PackHeuristic heuristic);
+
+/*
+  Find the bin with the smallest area, that satisfies the constraint, and that the packer can fit
+  all the rectangles into. The bin may be neither square nor a power of two, and its sides are at
+  most max_size. Returns false if no such bin could be found.
+
+  On success, the rectangles are left packed into the returned bin.
+*/
+bool find_bin_size(std::vector<PackRect>& rects, PackHeuristic heuristic, SizeConstraint constraint,
+		   unsigned int max_size, unsigned int& bin_width, unsigned int& bin_height);
+
+/*
+  Pack the rectangles into as many pages of at most max_page_size x max_page_size as needed, and
+  size every page with find_bin_size. Pages are filled with the rectangles in order, so runs of
+  neighbouring rectangles end up on the same page. If a page has to end in the middle of the
+  last quarter of its run, it instead ends before the last rectangle i in that quarter
+  for which preferred_break[i] is set.
+
+  Returns false if a rectangle is larger than a page.
+*/
+bool pack_pages(std::vector<PackRect>& rects, const std::vector<bool>& preferred_break,
+		PackHeuristic heuristic, SizeConstraint constraint, unsigned int max_page_size,
+		std::vector<PackPage>& pages);
+
+/*
+  Parse the name of a heuristic, as given on the command line. Returns false if the name is unknown.
+*/
+bool parse_pack_heuristic(const char* name, PackHeuristic& heuristic);
+
+const char* pack_heuristic_name(PackHeuristic heuristic);
+
+/*
+  Parse the name of a size constraint, as given on the command line. Returns false if the name is unknown.
+*/
+bool parse_size_constraint(const char* name, SizeConstraint& constraint);
+
+#endif
@@ -0,0 +1,134 @@
+#include "png_encode.h"
+
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+/*
+  The region that the temporary buffers of the deflate code come from. Every thread that encodes images
+  has one, which is reset after every image, and keeps the size that the largest image needed, so that
+  the later images of a batch do not allocate them again.
+*/
+struct PngArena {
+    LodePNGArena arena;
+
+    PngArena() {
+	lodepng_arena_init(&arena);
+    }
+
+    ~PngArena() {
+	lodepng_arena_cleanup(&arena);
+    }
+};
+
+static thread_local PngArena png_arena;
+
+bool parse_png_speed(const char* name, PngSpeed& speed) {
+    if(strcmp(name, "fastest") == 0) {
+	speed = PNG_SPEED_FASTEST;
+    } else if(strcmp(name, "balanced") == 0) {
+	speed = PNG_SPEED_BALANCED;
+    } else if(strcmp(name, "smallest") == 0) {
+	speed = PNG_SPEED_SMALLEST;
+    } else {
+	return false;
+    }
+    return true;
+}
+
+const char* png_speed_name(PngSpeed speed) {
+    switch(speed) {
+    case PNG_SPEED_FASTEST:
+	return "fastest";
+    case PNG_SPEED_SMALLEST:
+	return "smallest";
+    case PNG_SPEED_BALANCED:
+    default:
+	return "balanced";
+    }
+}
+
+/*
+  Measured against balanced in a Release build on one thread, on a 726x1885 atlas of DejaVu Sans at
+  200 pixels and a 4492x1171 atlas of DejaVu Serif at 96 pixels with U+0020-U+04FF:
+
+	  fastest                   smallest
+  rgba    10-38% larger, 0.8-1x     8-24% smaller, 2.6x
+  grey    5-10% larger, 0.6-0.8x    6-7% smaller, 3.7-3.8x
+  lcd     1-5% larger, 0.7-0.9x     7-10% smaller, 1.3-1.5x
+  sdf     9-17% larger, 0.7x        12-16% smaller, 3-3.7x
+  msdf    5-9% larger, 0.6-0.7x     23-28% smaller, 0.9-2.5x
+
+  RGBA atlases mostly have few colors and are written as palette images, which are not filtered, so
+  their long runs of one index make up most of the matches.
+*/
+void png_speed_settings(PngSpeed speed, LodePNGEncoderSettings& settings) {
+    lodepng_encoder_settings_init(&settings);
+
+    LodePNGCompressSettings& zlib = settings.zlibsettings;
+
+    switch(speed) {
+    case PNG_SPEED_FASTEST:
+	zlib.windowsize = 512;
+	zlib.nicematch = 32;
+	zlib.lazymatching = 0;
+	break;
+    case PNG_SPEED_SMALLEST:
+	zlib.windowsize = 32768;
+	zlib.nicematch = 258;
+	zlib.lazymatching = 1;
+	break;
+    case PNG_SPEED_BALANCED:
+    default:
+	break;
+    }
+
+    // the glyphs are smooth, so predicting from the neighbours pays off in every preset.
+    settings.filter_strategy = LFS_MINSUM;
+}
+
+unsigned encode_png_bands(const char* filename, PngBandFunction band_function, void* context,
+			  unsigned int width, unsigned int height, LodePNGColorType color_type,
+			  const LodePNGColorMode& file_color, PngSpeed speed, unsigned int num_threads, PngStats& stats) {
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    lodepng::State state;
+    png_speed_settings(speed, state.encoder);
+    state.encoder.zlibsettings.num_threads = num_threads > 0 ? num_threads : 1;
+    state.encoder.zlibsettings.arena = &png_arena.arena;
+    state.info_raw.colortype = color_type;
+    state.info_raw.bitdepth = 8;
+
+    const unsigned int channels = color_type == LCT_GREY ? 1 : (color_type == LCT_GREY_ALPHA ? 2 : (color_type == LCT_RGB ? 3 : 4));
+    const size_t row_size = (size_t)width * channels;
+
+    stats.raw_size = row_size * height;
+    stats.encoded_size = 0;
+
+    std::vector<unsigned char> band(row_size * PNG_BAND_ROWS);
+
+    unsigned error = lodepng_color_mode_copy(&state.info_png.color, &file_color);
+
+    LodePNGStreamEncoder* encoder = NULL;
+    if(!error) {
+	error = lodepng_stream_encoder_open(&encoder, filename, width, height, &state);
+    }
+
+    if(!error) {
+	for(unsigned int y = 0; y < height && !error; y += PNG_BAND_ROWS) {
+	    const unsigned int rows = height - y < PNG_BAND_ROWS ? height - y : PNG_BAND_ROWS;
+	    band_function(&band[0], y, rows, context);
+	    error = lodepng_stream_encoder_push(encoder, &band[0], rows);
+	}
+	const unsigned finish_error = lodepng_stream_encoder_finish(encoder, &stats.encoded_size);
+	error = error ? error : finish_error;
+    }
+
+    lodepng_arena_reset(&png_arena.arena);
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return error;
+}
@@ -0,0 +1,67 @@
+#ifndef PNG_ENCODE_H
+#define PNG_ENCODE_H
+
+#include "lodepng.h"
+
+#include <stddef.h>
+
+/*
+  How much time is spent on making the atlas images small.
+*/
+enum PngSpeed {
+    // little filtering effort, a short window and greedy matching. For quick iteration.
+    PNG_SPEED_FASTEST,
+
+    // the defaults of lodepng.
+    PNG_SPEED_BALANCED,
+
+    // the longest window and matches, for release builds.
+    PNG_SPEED_SMALLEST
+};
+
+/*
+  What encoding an image cost, and what it gave.
+*/
+struct PngStats {
+    double seconds;
+
+    // the size of the raw pixels, and of the PNG file, in bytes.
+    size_t raw_size;
+    size_t encoded_size;
+};
+
+/*
+  Parse the name of a preset, as given on the command line. Returns false if the name is unknown.
+*/
+bool parse_png_speed(const char* name, PngSpeed& speed);
+
+const char* png_speed_name(PngSpeed speed);
+
+/*
+  Set the compression and filter settings of the preset.
+*/
+void png_speed_settings(PngSpeed speed, LodePNGEncoderSettings& settings);
+
+/*
+  The images are composed and encoded in bands of this many rows, so that only a band has to be in memory.
+*/
+#define PNG_BAND_ROWS 64u
+
+/*
+  Fill band with the rows y up to y + rows of the image, tightly packed. y is a multiple of PNG_BAND_ROWS,
+  and rows is PNG_BAND_ROWS, except for the last band. context is passed on from encode_png_bands.
+*/
+typedef void (*PngBandFunction)(unsigned char* band, unsigned int y, unsigned int rows, void* context);
+
+/*
+  Encode an 8-bit image of color_type with the settings of the preset, and write it to a file in the
+  color mode file_color, which the pixels must fit, as one chosen by lodepng_auto_choose_color_profile.
+  The image is never in memory at once: band_function is asked for every band once, while the rows
+  are streamed into the file. The image data is deflated in chunks on num_threads threads; the file
+  does not depend on their number. Returns the lodepng error code, which is 0 on success.
+*/
+unsigned encode_png_bands(const char* filename, PngBandFunction band_function, void* context,
+			  unsigned int width, unsigned int height, LodePNGColorType color_type,
+			  const LodePNGColorMode& file_color, PngSpeed speed, unsigned int num_threads, PngStats& stats);
+
+#endif
@@ -0,0 +1,216 @@
+#include "sdf.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// the distance to a pixel that does not exist. It is finite, so that the transform never subtracts infinities.
+#define SDF_FAR 1e20f
+
+static int floor_div(int a, int b) {
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/*
+  The first pass: the distance along the column to the nearest feature pixel. row is the
+  current row of distances, and prev the one that was done before it. Feature pixels have
+  already been set to zero, and every other pixel to SDF_FAR.
+*/
+static void column_pass_row(float* row, const float* prev, unsigned int width) {
+    unsigned int x = 0;
+
+#if defined(__SSE2__)
+    const __m128 ones = _mm_set1_ps(1.0f);
+
+    for(; x + 4 <= width; x += 4) {
+	const __m128 from_prev = _mm_add_ps(_mm_loadu_ps(prev + x), ones);
+	_mm_storeu_ps(row + x, _mm_min_ps(_mm_loadu_ps(row + x), from_prev));
+    }
+#endif
+
+    for(; x < width; ++x) {
+	const float from_prev = prev[x] + 1.0f;
+	if(from_prev < row[x]) {
+	    row[x] = from_prev;
+	}
+    }
+}
+
+static void column_pass(float* grid, unsigned int width, unsigned int rows) {
+    for(unsigned int y = 1; y < rows; ++y) {
+	column_pass_row(grid + (size_t)y * width, grid + (size_t)(y - 1) * width, width);
+    }
+
+    for(unsigned int y = rows - 1; y-- > 0; ) {
+	column_pass_row(grid + (size_t)y * width, grid + (size_t)(y + 1) * width, width);
+    }
+}
+
+/*
+  The second pass, on a single row: the squared distance to the nearest feature pixel, found
+  from the lower envelope of the parabolas that are rooted at the column distances.
+*/
+static void row_pass(float* row, unsigned int width, SdfScratch& scratch) {
+    float* f = &scratch.row[0];
+    float* z = &scratch.envelope_z[0];
+    int* v = &scratch.envelope_v[0];
+
+    for(unsigned int x = 0; x < width; ++x) {
+	f[x] = row[x] >= SDF_FAR ? SDF_FAR : row[x] * row[x];
+    }
+
+    int k = 0;
+    v[0] = 0;
+    z[0] = -HUGE_VALF;
+    z[1] = HUGE_VALF;
+
+    for(int q = 1; q < (int)width; ++q) {
+	// where the parabola of q starts to be below the one of v[k]. The values are finite, so
+	// this never goes past z[0].
+	float s;
+	while(true) {
+	    const int r = v[k];
+	    s = ((f[q] + (float)(q * q)) - (f[r] + (float)(r * r))) / (float)(2 * q - 2 * r);
+	    if(s > z[k]) {
+		break;
+	    }
+	    --k;
+	}
+
+	++k;
+	v[k] = q;
+	z[k] = s;
+	z[k + 1] = HUGE_VALF;
+    }
+
+    k = 0;
+    for(int q = 0; q < (int)width; ++q) {
+	while(z[k + 1] < (float)q) {
+	    ++k;
+	}
+	const float dx = (float)(q - v[k]);
+	row[q] = dx * dx + f[v[k]];
+    }
+}
+
+static void distance_transform(float* grid, unsigned int width, unsigned int rows, SdfScratch& scratch) {
+    column_pass(grid, width, rows);
+
+    for(unsigned int y = 0; y < rows; ++y) {
+	row_pass(grid + (size_t)y * width, width, scratch);
+    }
+}
+
+Glyph store_sdf_glyph(std::vector<unsigned char>& pixels, unsigned int ch, FT_GlyphSlot slot,
+		      unsigned int spread, SdfScratch& scratch) {
+
+    const FT_Bitmap& bitmap = slot->bitmap;
+    const int scale = SDF_OVERSAMPLING;
+
+    Glyph glyph;
+    glyph.codepoint = ch;
+    glyph.advance = (int)((slot->advance.x / scale) >> 6);
+    glyph.offset = pixels.size();
+
+    if(bitmap.width == 0 || bitmap.rows == 0) {
+	glyph.width = 0;
+	glyph.rows = 0;
+	glyph.bitmap_left = 0;
+	glyph.bitmap_top = 0;
+	glyph.pitch = 0;
+	return glyph;
+    }
+
+    /*
+      The output pixels cover the bitmap, and spread more pixels on every side. Their corners
+      are on multiples of the oversampling, so that the fields of all glyphs are aligned to the
+      same grid. y grows downwards from the baseline.
+    */
+
+    const int x0 = floor_div(slot->bitmap_left, scale) - (int)spread;
+    const int x1 = floor_div(slot->bitmap_left + (int)bitmap.width - 1, scale) + 1 + (int)spread;
+    const int y0 = floor_div(-slot->bitmap_top, scale) - (int)spread;
+    const int y1 = floor_div(-slot->bitmap_top + (int)bitmap.rows - 1, scale) + 1 + (int)spread;
+
+    glyph.width = (unsigned int)(x1 - x0);
+    glyph.rows = (unsigned int)(y1 - y0);
+    glyph.bitmap_left = x0;
+    glyph.bitmap_top = -y0;
+    glyph.pitch = glyph.width;
+
+    const unsigned int grid_width = glyph.width * scale;
+    const unsigned int grid_rows = glyph.rows * scale;
+    const size_t grid_size = (size_t)grid_width * grid_rows;
+
+    const int bitmap_x = slot->bitmap_left - x0 * scale;
+    const int bitmap_y = -slot->bitmap_top - y0 * scale;
+
+    scratch.to_inside.assign(grid_size, SDF_FAR);
+    scratch.to_outside.assign(grid_size, 0.0f);
+    if(scratch.row.size() < grid_width) {
+	scratch.row.resize(grid_width);
+	scratch.envelope_z.resize(grid_width + 1);
+	scratch.envelope_v.resize(grid_width);
+    }
+
+    // a pixel is inside of the glyph if it is at least half covered.
+    for(unsigned int row = 0; row < bitmap.rows; ++row) {
+	const unsigned char* src = bitmap.buffer + (ptrdiff_t)row * bitmap.pitch;
+	const size_t start = (size_t)(bitmap_y + row) * grid_width + bitmap_x;
+
+	for(unsigned int x = 0; x < bitmap.width; ++x) {
+	    if(src[x] >= 128) {
+		scratch.to_inside[start + x] = 0.0f;
+		scratch.to_outside[start + x] = SDF_FAR;
+	    }
+	}
+    }
+
+    distance_transform(&scratch.to_inside[0], grid_width, grid_rows, scratch);
+    distance_transform(&scratch.to_outside[0], grid_width, grid_rows, scratch);
+
+    /*
+      Every output pixel is the average of the signed distances of the oversampled pixels it
+      covers. The distances are measured from pixel centers, so half a pixel is taken off.
+    */
+
+    scratch.sums.resize(glyph.width);
+    pixels.resize(pixels.size() + (size_t)glyph.width * glyph.rows);
+    unsigned char* dst = &pixels[glyph.offset];
+
+    const float to_output = 1.0f / (float)(scale * scale * scale);
+
+    for(unsigned int out_y = 0; out_y < glyph.rows; ++out_y) {
+
+	std::fill(scratch.sums.begin(), scratch.sums.end(), 0.0f);
+
+	for(unsigned int y = out_y * scale; y < (out_y + 1) * scale; ++y) {
+	    const float* to_inside = &scratch.to_inside[(size_t)y * grid_width];
+	    const float* to_outside = &scratch.to_outside[(size_t)y * grid_width];
+
+	    for(unsigned int x = 0; x < grid_width; ++x) {
+		// positive outside of the glyph, negative inside.
+		const float distance = to_inside[x] > 0.0f ?
+		    sqrtf(to_inside[x]) - 0.5f :
+		    0.5f - sqrtf(to_outside[x]);
+		scratch.sums[x / scale] += distance;
+	    }
+	}
+
+	for(unsigned int x = 0; x < glyph.width; ++x) {
+	    const float distance = scratch.sums[x] * to_output;
+
+	    float value = 0.5f - distance / (float)(2 * spread);
+	    value = value < 0.0f ? 0.0f : (value > 1.0f ? 1.0f : value);
+
+	    dst[(size_t)out_y * glyph.width + x] = (unsigned char)(value * 255.0f + 0.5f);
+	}
+    }
+
+    return glyph;
+}
@@ -0,0 +1,44 @@
+#ifndef SDF_H
+#define SDF_H
+
+#include "glyph_store.h"
+
+#include <vector>
+
+/*
+  Distance fields are computed from glyphs that are rendered this many times larger than the
+  font size, and then scaled down.
+*/
+#define SDF_OVERSAMPLING 8
+
+/*
+  Buffers for computing distance fields. Every rendering thread has its own, and reuses them
+  for all of its glyphs.
+*/
+struct SdfScratch {
+    // squared distances to the nearest pixel inside and outside of the glyph, for the whole oversampled grid.
+    std::vector<float> to_inside;
+    std::vector<float> to_outside;
+
+    // the distance transform of a single row.
+    std::vector<float> row;
+    std::vector<float> envelope_z;
+    std::vector<int> envelope_v;
+
+    // the sums of the signed distances of the output pixels of a row.
+    std::vector<float> sums;
+};
+
+/*
+  Make a signed distance field of the oversampled coverage bitmap in the glyph slot, and append
+  it to the pixel arena. The field is SDF_OVERSAMPLING times smaller than the bitmap, and has a
+  border of spread pixels. 128 is on the outline, 255 is spread or more pixels inside of it,
+  and 0 is spread or more pixels outside of it. The metrics are scaled down to match.
+
+  The exact Euclidean distance transform of Meijster et al. is used, which is linear in the
+  number of pixels. Its first pass runs down the columns, and does a whole row of columns at a time with SSE2.
+*/
+Glyph store_sdf_glyph(std::vector<unsigned char>& pixels, unsigned int ch, FT_GlyphSlot slot,
+		      unsigned int spread, SdfScratch& scratch);
+
+#endif
@@ -0,0 +1,134 @@
+/*
+  Checks that the index of an .amfb-file, as write_amfb_file builds it, finds the same glyphs as a
+  binary search over the glyph records.
+*/
+
+#include "../src/amfb_writer.h"
+#include "../src/lodepng.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+static unsigned int num_failures = 0;
+
+#define CHECK(condition, ...) do { \
+	if(!(condition)) { \
+	    printf("FAILED: "); \
+	    printf(__VA_ARGS__); \
+	    printf("\n"); \
+	    ++num_failures; \
+	} \
+    } while(0)
+
+/*
+  A small xorshift generator, so that every run tests the same data.
+*/
+static unsigned int random_state = 2463534242u;
+
+static unsigned int random_number() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+// all code points up to here are looked up.
+#define MAX_CODEPOINT 0x30000u
+
+/*
+  Write the glyphs of the code points to an .amfb-file, and check that amfb_find_glyph and
+  amfb_search_glyph give the same record for every code point below MAX_CODEPOINT, and that it
+  is the glyph of that code point.
+*/
+static void test_lookup(const char* name, const std::vector<uint32_t>& codepoints) {
+    const char* filename = "amfb_tests.amfb";
+
+    AmfbHeader header;
+    memset(&header, 0, sizeof(header));
+    header.page_count = 1;
+
+    // the glyphs are written in reverse order, write_amfb_file sorts them.
+    std::vector<AmfbGlyph> glyphs(codepoints.size());
+    for(size_t i = 0; i < codepoints.size(); ++i) {
+	AmfbGlyph& glyph = glyphs[codepoints.size() - 1 - i];
+	memset(&glyph, 0, sizeof(glyph));
+	glyph.codepoint = codepoints[i];
+	glyph.x = (uint16_t)(codepoints[i] & 0xFFFF);
+	glyph.advance = (int16_t)(codepoints[i] % 100);
+    }
+
+    if(!write_amfb_file(filename, header, glyphs, std::vector<AmfbKerningPair>())) {
+	CHECK(false, "%s: could not write %s", name, filename);
+	return;
+    }
+
+    unsigned char* data = NULL;
+    size_t size = 0;
+    const unsigned error = lodepng_load_file(&data, &size, filename);
+    remove(filename);
+    const AmfbHeader* file = error == 0 ? amfb_header(data, size) : NULL;
+    CHECK(file != NULL, "%s: the file is not valid", name);
+
+    if(file != NULL) {
+	CHECK(file->glyph_count == codepoints.size(), "%s: %u glyphs, expected %u", name, file->glyph_count,
+	      (unsigned int)codepoints.size());
+
+	std::vector<bool> present(MAX_CODEPOINT, false);
+	for(size_t i = 0; i < codepoints.size(); ++i) {
+	    present[codepoints[i]] = true;
+	}
+
+	for(uint32_t codepoint = 0; codepoint < MAX_CODEPOINT; ++codepoint) {
+	    const AmfbGlyph* found = amfb_find_glyph(file, codepoint);
+	    const AmfbGlyph* searched = amfb_search_glyph(file, codepoint);
+
+	    CHECK(found == searched, "%s: U+%04X is found at another glyph than by searching", name, codepoint);
+	    if(present[codepoint]) {
+		CHECK(found != NULL && found->codepoint == codepoint && found->x == (codepoint & 0xFFFF)
+		      && found->advance == (int16_t)(codepoint % 100), "%s: U+%04X has the wrong glyph", name, codepoint);
+	    } else {
+		CHECK(found == NULL, "%s: U+%04X has a glyph, but is not in the file", name, codepoint);
+	    }
+	}
+    }
+
+    free(data);
+}
+
+int main() {
+    // sparse blocks, the edges of the blocks of the index, and the last code point that is looked up.
+    std::vector<uint32_t> sparse;
+    for(uint32_t c = 0x20; c < 0x7F; ++c) {
+	sparse.push_back(c);
+    }
+    const uint32_t edges[] = { 0xFF, 0x100, 0x1FF, 0x4E00, 0x4E01, 0x9FFF, 0xFFFD, 0x10000, 0x1F600, 0x2FFFF };
+    for(size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); ++i) {
+	sparse.push_back(edges[i]);
+    }
+    // and code points at random, some of which share a block.
+    for(unsigned int i = 0; i < 300; ++i) {
+	const uint32_t c = random_number() % MAX_CODEPOINT;
+	bool known = false;
+	for(size_t j = 0; j < sparse.size() && !known; ++j) {
+	    known = sparse[j] == c;
+	}
+	if(!known) {
+	    sparse.push_back(c);
+	}
+    }
+    test_lookup("sparse", sparse);
+
+    test_lookup("only U+0000", std::vector<uint32_t>(1, 0));
+    test_lookup("empty", std::vector<uint32_t>());
+
+    if(num_failures > 0) {
+	printf("%u checks failed.\n", num_failures);
+	return 1;
+    }
+
+    printf("All checks passed.\n");
+    return 0;
+}
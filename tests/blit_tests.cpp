@@ -0,0 +1,220 @@
+/*
+  Checks the SIMD row functions of blit.cpp against the scalar ones, and measures how fast
+  every path of every BlitMode is. blit.cpp is included, so that its static functions can
+  be called.
+*/
+
+#include "../src/blit.cpp"
+
+#include <stdio.h>
+
+#include <chrono>
+#include <vector>
+
+static unsigned int num_failures = 0;
+
+#define CHECK(condition, ...) do { \
+	if(!(condition)) { \
+	    printf("FAILED: "); \
+	    printf(__VA_ARGS__); \
+	    printf("\n"); \
+	    ++num_failures; \
+	} \
+    } while(0)
+
+/*
+  A small xorshift generator, so that every run tests the same data.
+*/
+static unsigned int random_state = 2463534242u;
+
+static unsigned int random_number() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static void random_bytes(std::vector<unsigned char>& data) {
+    for(size_t i = 0; i < data.size(); ++i) {
+	data[i] = (unsigned char)random_number();
+    }
+}
+
+struct RowPath {
+    const char* name;
+    BlitMode mode;
+    RowFunction function;
+    const char* feature;
+};
+
+static bool cpu_has(const char* feature) {
+#ifdef BLIT_X86
+    __builtin_cpu_init();
+    if(strcmp(feature, "sse2") == 0) {
+	return __builtin_cpu_supports("sse2");
+    } else if(strcmp(feature, "ssse3") == 0) {
+	return __builtin_cpu_supports("ssse3");
+    } else if(strcmp(feature, "avx2") == 0) {
+	return __builtin_cpu_supports("avx2");
+    }
+#else
+    (void)feature;
+#endif
+    return false;
+}
+
+// the scalar function of every mode comes first.
+static const RowPath row_paths[] = {
+    { "grey_to_rgba_row", BLIT_GREY_TO_RGBA, grey_to_rgba_row, NULL },
+#ifdef BLIT_X86
+    { "grey_to_rgba_row_sse2", BLIT_GREY_TO_RGBA, grey_to_rgba_row_sse2, "sse2" },
+    { "grey_to_rgba_row_avx2", BLIT_GREY_TO_RGBA, grey_to_rgba_row_avx2, "avx2" },
+#endif
+    { "lcd_to_rgba_row", BLIT_LCD_TO_RGBA, lcd_to_rgba_row, NULL },
+#ifdef BLIT_X86
+    { "lcd_to_rgba_row_ssse3", BLIT_LCD_TO_RGBA, lcd_to_rgba_row_ssse3, "ssse3" },
+#endif
+};
+
+static const unsigned int num_row_paths = sizeof(row_paths) / sizeof(row_paths[0]);
+
+static unsigned int source_bytes(BlitMode mode) {
+    return mode == BLIT_LCD_TO_RGBA || mode == BLIT_RGB_TO_RGB ? 3 : 1;
+}
+
+/*
+  Every SIMD row function must write the same bytes as the scalar one, for every width up to
+  a few times its block size and at every alignment, and nothing past the end of the row.
+*/
+static void test_row_functions() {
+    const unsigned int max_width = 200;
+
+    std::vector<unsigned char> src(3 * max_width + 32);
+    random_bytes(src);
+
+    for(unsigned int p = 0; p < num_row_paths; ++p) {
+	const RowPath& path = row_paths[p];
+	if(path.feature == NULL) {
+	    continue;
+	}
+	if(!cpu_has(path.feature)) {
+	    printf("%s is not tested, the CPU does not have %s.\n", path.name, path.feature);
+	    continue;
+	}
+
+	const RowFunction scalar = path.mode == BLIT_LCD_TO_RGBA ? lcd_to_rgba_row : grey_to_rgba_row;
+
+	for(unsigned int width = 0; width <= max_width; ++width) {
+	    const unsigned int offset = width % 16;
+
+	    std::vector<unsigned char> expected(4 * max_width + 64, 0xA5);
+	    std::vector<unsigned char> actual(4 * max_width + 64, 0xA5);
+
+	    scalar(&expected[offset], &src[offset], width);
+	    path.function(&actual[offset], &src[offset], width);
+
+	    CHECK(expected == actual, "%s, width %u, offset %u", path.name, width, offset);
+	}
+    }
+}
+
+/*
+  blit_bitmap must copy every row to its place in the atlas, with pitches larger than the rows.
+*/
+static void test_blit_bitmap() {
+    const BlitMode modes[4] = { BLIT_GREY_TO_GREY, BLIT_GREY_TO_RGBA, BLIT_LCD_TO_RGBA, BLIT_RGB_TO_RGB };
+
+    for(unsigned int m = 0; m < 4; ++m) {
+	const BlitMode mode = modes[m];
+	const unsigned int width = 37;
+	const unsigned int rows = 11;
+	const unsigned int src_bytes = source_bytes(mode);
+	const unsigned int dst_bytes = mode == BLIT_GREY_TO_RGBA || mode == BLIT_LCD_TO_RGBA ? 4 : src_bytes;
+	const size_t src_pitch = src_bytes * width + 5;
+	const size_t dst_pitch = dst_bytes * width + 9;
+
+	std::vector<unsigned char> src(src_pitch * rows);
+	random_bytes(src);
+
+	std::vector<unsigned char> expected(dst_pitch * rows, 0xA5);
+	std::vector<unsigned char> actual(dst_pitch * rows, 0xA5);
+
+	for(unsigned int row = 0; row < rows; ++row) {
+	    unsigned char* dst = &expected[row * dst_pitch];
+	    const unsigned char* line = &src[row * src_pitch];
+
+	    if(mode == BLIT_GREY_TO_RGBA) {
+		grey_to_rgba_row(dst, line, width);
+	    } else if(mode == BLIT_LCD_TO_RGBA) {
+		lcd_to_rgba_row(dst, line, width);
+	    } else {
+		memcpy(dst, line, src_bytes * width);
+	    }
+	}
+
+	blit_bitmap(&actual[0], dst_pitch, &src[0], src_pitch, width, rows, mode);
+
+	CHECK(expected == actual, "blit_bitmap, mode %u", (unsigned int)mode);
+    }
+}
+
+/*
+  Blit a large bitmap a few times, and print the best throughput in pixels.
+*/
+static void benchmark(const char* name, BlitMode mode, RowFunction function) {
+    const unsigned int width = 4096;
+    const unsigned int rows = 1024;
+    const unsigned int src_bytes = source_bytes(mode);
+
+    std::vector<unsigned char> src((size_t)src_bytes * width * rows);
+    random_bytes(src);
+    std::vector<unsigned char> dst((size_t)4 * width * rows);
+
+    double best = 0.0;
+
+    for(unsigned int run = 0; run < 5; ++run) {
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if(function == NULL) {
+	    blit_bitmap(&dst[0], (size_t)src_bytes * width, &src[0], (size_t)src_bytes * width, width, rows, mode);
+	} else {
+	    for(unsigned int row = 0; row < rows; ++row) {
+		function(&dst[(size_t)row * 4 * width], &src[(size_t)row * src_bytes * width], width);
+	    }
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if(best == 0.0 || seconds < best) {
+	    best = seconds;
+	}
+    }
+
+    printf("%-24s %8.1f Mpixels/s\n", name, (double)width * rows / best / 1e6);
+}
+
+static void benchmark_blits() {
+    benchmark("BLIT_GREY_TO_GREY", BLIT_GREY_TO_GREY, NULL);
+    benchmark("BLIT_RGB_TO_RGB", BLIT_RGB_TO_RGB, NULL);
+
+    for(unsigned int p = 0; p < num_row_paths; ++p) {
+	const RowPath& path = row_paths[p];
+	if(path.feature == NULL || cpu_has(path.feature)) {
+	    benchmark(path.name, path.mode, path.function);
+	}
+    }
+}
+
+int main() {
+    test_row_functions();
+    test_blit_bitmap();
+
+    benchmark_blits();
+
+    if(num_failures > 0) {
+	printf("%u checks failed.\n", num_failures);
+	return 1;
+    }
+
+    printf("All checks passed.\n");
+    return 0;
+}
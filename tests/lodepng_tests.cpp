@@ -0,0 +1,743 @@
+/*
+  Checks the SIMD code in lodepng against the scalar code it stands in for, and measures
+  how fast both are. lodepng.cpp is included, so that its static functions can be called.
+*/
+
+#include "../src/lodepng.cpp"
+
+#include <stdio.h>
+
+#include <chrono>
+#include <vector>
+
+static unsigned int num_failures = 0;
+
+#define CHECK(condition, ...) do { \
+	if(!(condition)) { \
+	    printf("FAILED: "); \
+	    printf(__VA_ARGS__); \
+	    printf("\n"); \
+	    ++num_failures; \
+	} \
+    } while(0)
+
+/*
+  A small xorshift generator, so that every run tests the same data.
+*/
+static unsigned int random_state = 2463534242u;
+
+static unsigned int random_number() {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static void random_bytes(std::vector<unsigned char>& data) {
+    for(size_t i = 0; i < data.size(); ++i) {
+	data[i] = (unsigned char)random_number();
+    }
+}
+
+/*
+  Data that deflate can find matches in: runs of one byte, copies of earlier data at distances
+  of up to 40000 bytes, and random bytes, as in the rows of an atlas.
+*/
+static void compressible_bytes(std::vector<unsigned char>& data) {
+    size_t i = 0;
+    while(i < data.size()) {
+	const unsigned int kind = random_number() % 3;
+	size_t length = 1 + random_number() % 300;
+	if(length > data.size() - i) {
+	    length = data.size() - i;
+	}
+
+	if(kind == 0) {
+	    const unsigned char value = (unsigned char)random_number();
+	    for(size_t j = 0; j < length; ++j) {
+		data[i + j] = value;
+	    }
+	} else if(kind == 1 && i > 0) {
+	    const size_t distance = 1 + random_number() % (i < 40000 ? i : 40000);
+	    for(size_t j = 0; j < length; ++j) {
+		data[i + j] = data[i + j - distance];
+	    }
+	} else {
+	    for(size_t j = 0; j < length; ++j) {
+		data[i + j] = (unsigned char)random_number();
+	    }
+	}
+	i += length;
+    }
+}
+
+/*
+  Time a checksum over the buffer a few times, and print the best throughput.
+*/
+template<typename Function>
+static void benchmark(const char* name, const std::vector<unsigned char>& data, Function function) {
+    double best = 0.0;
+    unsigned int result = 0;
+
+    for(unsigned int run = 0; run < 5; ++run) {
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	result ^= function(&data[0], data.size());
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if(best == 0.0 || seconds < best) {
+	    best = seconds;
+	}
+    }
+
+    printf("%-24s %6.2f GB/s (%08x)\n", name, data.size() / best / 1e9, result);
+}
+
+#ifdef LODEPNG_COMPILE_X86_SIMD
+static bool has_pclmul() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+#endif
+
+/*
+  crc32_slice8 and crc32_pclmul must give the same CRC as crc32_bytewise, for any length,
+  start value and alignment. crc32_pclmul only takes lengths of at least 64 that are a
+  multiple of 16; lodepng_crc32 covers the other lengths.
+*/
+static void test_crc32() {
+    std::vector<unsigned char> data(70000 + 16);
+    random_bytes(data);
+
+#ifdef LODEPNG_COMPILE_X86_SIMD
+    const bool pclmul = has_pclmul();
+    if(!pclmul) {
+	printf("crc32_pclmul is not tested, the CPU does not have PCLMUL and SSE4.1.\n");
+    }
+#endif
+
+    for(unsigned int i = 0; i < 3000; ++i) {
+	// every length up to 1024, then random lengths up to the size of the buffer.
+	const size_t len = i <= 1024 ? i : random_number() % (data.size() - 16);
+	const size_t offset = random_number() % 16;
+	const unsigned char* buf = &data[offset];
+	const unsigned int start = i % 2 == 0 ? 0xffffffffu : random_number();
+
+	const unsigned int expected = crc32_bytewise(start, buf, len);
+
+	CHECK(crc32_slice8(start, buf, len) == expected,
+	      "crc32_slice8, length %u, offset %u", (unsigned int)len, (unsigned int)offset);
+
+	CHECK(lodepng_crc32(buf, len) == (crc32_bytewise(0xffffffffu, buf, len) ^ 0xffffffffu),
+	      "lodepng_crc32, length %u, offset %u", (unsigned int)len, (unsigned int)offset);
+
+#ifdef LODEPNG_COMPILE_X86_SIMD
+	const size_t blocks = len & ~(size_t)15;
+	if(pclmul && blocks >= 64) {
+	    CHECK(crc32_pclmul(start, buf, blocks) == crc32_bytewise(start, buf, blocks),
+		  "crc32_pclmul, length %u, offset %u", (unsigned int)blocks, (unsigned int)offset);
+	}
+#endif
+    }
+}
+
+static void benchmark_crc32() {
+    std::vector<unsigned char> data(32u << 20);
+    random_bytes(data);
+
+    benchmark("crc32_bytewise", data, [](const unsigned char* buf, size_t len) {
+	return crc32_bytewise(0xffffffffu, buf, len);
+    });
+    benchmark("crc32_slice8", data, [](const unsigned char* buf, size_t len) {
+	return crc32_slice8(0xffffffffu, buf, len);
+    });
+#ifdef LODEPNG_COMPILE_X86_SIMD
+    if(has_pclmul()) {
+	benchmark("crc32_pclmul", data, [](const unsigned char* buf, size_t len) {
+	    return crc32_pclmul(0xffffffffu, buf, len);
+	});
+    }
+#endif
+}
+
+#ifdef LODEPNG_COMPILE_X86_SIMD
+/*
+  update_adler32_ssse3 and update_adler32_avx2 must give the same checksum as
+  update_adler32_scalar for every length up to past one interval of 173 blocks of 32 bytes
+  (5536 bytes), after which the sums are reduced. All 0xFF bytes, and the largest sums to
+  start from, make the sums grow as fast as they can.
+*/
+static void test_adler32() {
+    __builtin_cpu_init();
+    const bool ssse3 = __builtin_cpu_supports("ssse3");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+
+    if(!ssse3) {
+	printf("update_adler32_ssse3 is not tested, the CPU does not have SSSE3.\n");
+    }
+    if(!avx2) {
+	printf("update_adler32_avx2 is not tested, the CPU does not have AVX2.\n");
+    }
+
+    const unsigned int max_length = 6200;
+    const unsigned int starts[3] = { 1, 0xFFF0FFF0u, 0 };
+
+    std::vector<unsigned char> random(max_length + 32);
+    random_bytes(random);
+    const std::vector<unsigned char> full(max_length + 32, 0xFF);
+
+    for(unsigned int input = 0; input < 2; ++input) {
+	const std::vector<unsigned char>& data = input == 0 ? full : random;
+
+	for(unsigned int len = 0; len <= max_length; ++len) {
+	    // the start sums, and where in the buffer the data starts, change with the length.
+	    const unsigned int adler = starts[len % 3];
+	    const unsigned int offset = len % 32;
+	    const unsigned char* buf = &data[offset];
+
+	    const unsigned int expected = update_adler32_scalar(adler, buf, len);
+
+	    if(ssse3) {
+		CHECK(update_adler32_ssse3(adler, buf, len) == expected,
+		      "update_adler32_ssse3, length %u, offset %u, input %u", len, offset, input);
+	    }
+	    if(avx2) {
+		CHECK(update_adler32_avx2(adler, buf, len) == expected,
+		      "update_adler32_avx2, length %u, offset %u, input %u", len, offset, input);
+	    }
+	}
+    }
+
+    // many intervals in one call.
+    const std::vector<unsigned char> large(1u << 20, 0xFF);
+    const unsigned int expected = update_adler32_scalar(0xFFF0FFF0u, &large[1], (unsigned int)large.size() - 1);
+    if(ssse3) {
+	CHECK(update_adler32_ssse3(0xFFF0FFF0u, &large[1], (unsigned int)large.size() - 1) == expected,
+	      "update_adler32_ssse3, 1 MiB");
+    }
+    if(avx2) {
+	CHECK(update_adler32_avx2(0xFFF0FFF0u, &large[1], (unsigned int)large.size() - 1) == expected,
+	      "update_adler32_avx2, 1 MiB");
+    }
+}
+#endif
+
+#ifdef LODEPNG_COMPILE_X86_SIMD
+/*
+  filterScanlineSum_sse2 and filterScanlineSum_avx2 must write the same bytes and give the same
+  score as filterScanlineSum, for every filter type, for pixels of 1 to 4 bytes, for every length
+  from one pixel up to a few times the 32 bytes of a block, and for the first row, where prevline
+  is null. filterScanline always writes the first pixel, so shorter lengths are not tested.
+  Bytes near 0, 127, 128 and 255 make the sums of the Average and Paeth predictors overflow where
+  they can.
+*/
+static void test_filter_functions() {
+    __builtin_cpu_init();
+    const bool sse2 = __builtin_cpu_supports("sse2");
+    const bool avx2 = __builtin_cpu_supports("avx2");
+
+    if(!sse2) {
+	printf("filterScanlineSum_sse2 is not tested, the CPU does not have SSE2.\n");
+    }
+    if(!avx2) {
+	printf("filterScanlineSum_avx2 is not tested, the CPU does not have AVX2.\n");
+    }
+
+    const unsigned int max_length = 150;
+    const unsigned char extremes[6] = { 0, 1, 127, 128, 254, 255 };
+
+    std::vector<unsigned char> random(2 * max_length);
+    random_bytes(random);
+    std::vector<unsigned char> extreme(2 * max_length);
+    for(size_t i = 0; i < extreme.size(); ++i) {
+	extreme[i] = extremes[random_number() % 6];
+    }
+
+    for(unsigned int input = 0; input < 2; ++input) {
+	const std::vector<unsigned char>& data = input == 0 ? random : extreme;
+	const unsigned char* scanline = &data[max_length];
+
+	for(unsigned int bytewidth = 1; bytewidth <= 4; ++bytewidth) {
+	    for(unsigned int length = bytewidth; length <= max_length; ++length) {
+		for(unsigned char type = 0; type < 5; ++type) {
+		    for(unsigned int first = 0; first < 2; ++first) {
+			const unsigned char* prevline = first ? NULL : &data[0];
+
+			std::vector<unsigned char> expected(max_length + 1, 0xA5);
+			const size_t sum = filterScanlineSum(&expected[0], scanline, prevline, length, bytewidth, type);
+
+			if(sse2) {
+			    std::vector<unsigned char> actual(max_length + 1, 0xA5);
+			    CHECK(filterScanlineSum_sse2(&actual[0], scanline, prevline, length, bytewidth, type) == sum
+				  && actual == expected,
+				  "filterScanlineSum_sse2, type %u, bytewidth %u, length %u, prevline %s, input %u",
+				  type, bytewidth, length, first ? "null" : "set", input);
+			}
+			if(avx2) {
+			    std::vector<unsigned char> actual(max_length + 1, 0xA5);
+			    CHECK(filterScanlineSum_avx2(&actual[0], scanline, prevline, length, bytewidth, type) == sum
+				  && actual == expected,
+				  "filterScanlineSum_avx2, type %u, bytewidth %u, length %u, prevline %s, input %u",
+				  type, bytewidth, length, first ? "null" : "set", input);
+			}
+		    }
+		}
+	    }
+	}
+    }
+}
+#endif
+
+/*
+  Filtering in bands of scanlines on several threads must give the same rows as one band, for
+  every strategy, with and without a row before the first one, and with more bands than rows.
+*/
+static void test_filter_bands() {
+    const unsigned int width = 53;
+    const unsigned int bytewidth = 4;
+    const size_t linebytes = width * bytewidth;
+    const LodePNGFilterStrategy strategies[4] = { LFS_ZERO, LFS_MINSUM, LFS_ENTROPY, LFS_PREDEFINED };
+    const unsigned int heights[3] = { 1, 3, 37 };
+
+    for(unsigned int hi = 0; hi < 3; ++hi) {
+	const unsigned int h = heights[hi];
+
+	std::vector<unsigned char> image(linebytes * (h + 1));
+	compressible_bytes(image);
+	std::vector<unsigned char> predefined(h);
+	for(unsigned int y = 0; y < h; ++y) {
+	    predefined[y] = (unsigned char)(random_number() % 5);
+	}
+
+	for(unsigned int s = 0; s < 4; ++s) {
+	    for(unsigned int first = 0; first < 2; ++first) {
+		// the stream encoder passes the last row of the push before as prevline.
+		const unsigned char* prevline = first ? NULL : &image[0];
+		const unsigned char* in = &image[linebytes];
+
+		LodePNGEncoderSettings settings;
+		lodepng_encoder_settings_init(&settings);
+		settings.predefined_filters = &predefined[0];
+
+		std::vector<unsigned char> expected(h * (linebytes + 1));
+		unsigned error = filterRowsParallel(&expected[0], in, prevline, h, linebytes, bytewidth,
+						    strategies[s], &settings, NULL);
+		CHECK(error == 0, "filterRowsParallel, one band, strategy %u: error %u", (unsigned int)strategies[s], error);
+
+		const unsigned int thread_counts[2] = { 3, 8 };
+		for(unsigned int t = 0; t < 2; ++t) {
+		    settings.zlibsettings.num_threads = thread_counts[t];
+
+		    std::vector<unsigned char> actual(h * (linebytes + 1));
+		    error = filterRowsParallel(&actual[0], in, prevline, h, linebytes, bytewidth,
+					       strategies[s], &settings, NULL);
+		    CHECK(error == 0 && actual == expected,
+			  "filterRowsParallel, %u bands, %u rows, strategy %u, prevline %s: error %u",
+			  thread_counts[t], h, (unsigned int)strategies[s], first ? "null" : "set", error);
+		}
+
+#ifdef LODEPNG_COMPILE_THREADS
+		ThreadPool* pool = threadPoolCreate(3);
+		std::vector<unsigned char> actual(h * (linebytes + 1));
+		error = filterRowsParallel(&actual[0], in, prevline, h, linebytes, bytewidth,
+					   strategies[s], &settings, pool);
+		threadPoolDestroy(pool);
+		CHECK(error == 0 && actual == expected,
+		      "filterRowsParallel, pool of 3 threads, %u rows, strategy %u, prevline %s: error %u",
+		      h, (unsigned int)strategies[s], first ? "null" : "set", error);
+#endif
+	    }
+	}
+    }
+}
+
+/*
+  The zlib data deflated in chunks must inflate to the input again, for inputs that end at, just
+  past and well past the end of a chunk of 256 KiB, and for every window size. It must not depend
+  on the number of threads.
+*/
+static void test_zlib_chunks() {
+    const size_t sizes[5] = { 0, 1000, DEFLATE_CHUNK_SIZE, DEFLATE_CHUNK_SIZE + 1, 3 * DEFLATE_CHUNK_SIZE + 12345 };
+
+    for(unsigned int s = 0; s < 5; ++s) {
+	std::vector<unsigned char> data(sizes[s]);
+	compressible_bytes(data);
+
+	for(unsigned int windowsize = 1; windowsize <= 32768; windowsize *= 2) {
+	    LodePNGCompressSettings settings;
+	    lodepng_compress_settings_init(&settings);
+	    settings.windowsize = windowsize;
+
+	    std::vector<unsigned char> first;
+	    const unsigned int thread_counts[2] = { 1, 4 };
+
+	    for(unsigned int t = 0; t < 2; ++t) {
+		settings.num_threads = thread_counts[t];
+
+		unsigned char* compressed = NULL;
+		size_t compressed_size = 0;
+		unsigned error = lodepng_zlib_compress(&compressed, &compressed_size,
+						       data.empty() ? NULL : &data[0], data.size(), &settings);
+		CHECK(error == 0, "lodepng_zlib_compress, size %u, window %u, %u threads: error %u",
+		      (unsigned int)data.size(), windowsize, settings.num_threads, error);
+		if(error != 0) {
+		    lodepng_free(compressed);
+		    continue;
+		}
+
+		unsigned char* decompressed = NULL;
+		size_t decompressed_size = 0;
+		error = lodepng_zlib_decompress(&decompressed, &decompressed_size, compressed, compressed_size,
+						&lodepng_default_decompress_settings);
+		CHECK(error == 0 && decompressed_size == data.size()
+		      && (data.empty() || memcmp(decompressed, &data[0], data.size()) == 0),
+		      "zlib round trip, size %u, window %u, %u threads: error %u",
+		      (unsigned int)data.size(), windowsize, settings.num_threads, error);
+
+		const std::vector<unsigned char> output(compressed, compressed + compressed_size);
+		if(t == 0) {
+		    first = output;
+		} else {
+		    CHECK(output == first, "zlib data differs between 1 and %u threads, size %u, window %u",
+			  settings.num_threads, (unsigned int)data.size(), windowsize);
+		}
+
+		lodepng_free(decompressed);
+		lodepng_free(compressed);
+	    }
+	}
+    }
+}
+
+/*
+  The allocations of an arena: from the heap while the region is too small, where heapsize counts
+  them and peak the most in use at once, in place for the last allocation of the region that
+  grows, and from a region that lodepng_arena_reset grew to the peak.
+*/
+static void test_arena() {
+    LodePNGArena arena;
+    lodepng_arena_init(&arena);
+    ArenaScope scope;
+
+    // without a region, everything comes from the heap.
+    arena_enter(&scope, &arena);
+    void* first = arena_malloc(1000);
+    void* second = arena_malloc(3000);
+    CHECK(first != NULL && second != NULL && !arena_owns(&arena, first) && !arena_owns(&arena, second),
+	  "arena without a region, allocations not from the heap");
+    CHECK(arena.heapsize == 1008 + 3008 && arena.peak == 1008 + 3008,
+	  "arena heap fallback, heapsize %u and peak %u", (unsigned int)arena.heapsize, (unsigned int)arena.peak);
+    arena_free(first, 1000);
+    CHECK(arena.heapsize == 3008 && arena.peak == 1008 + 3008,
+	  "arena heap fallback after a free, heapsize %u and peak %u",
+	  (unsigned int)arena.heapsize, (unsigned int)arena.peak);
+    arena_free(second, 3000);
+    arena_leave(&scope);
+    CHECK(arena.heapsize == 0, "arena heap fallback, heapsize %u after freeing all", (unsigned int)arena.heapsize);
+
+    // the reset grows the region to the peak.
+    lodepng_arena_reset(&arena);
+    CHECK(arena.data != NULL && arena.size == 1008 + 3008 && arena.used == 0 && arena.peak == 0,
+	  "arena after the first reset, size %u", (unsigned int)arena.size);
+
+    arena_enter(&scope, &arena);
+    unsigned char* small = (unsigned char*)arena_malloc(10);
+    unsigned char* last = (unsigned char*)arena_malloc(100);
+    CHECK(arena_owns(&arena, small) && arena_owns(&arena, last) && last == small + 16 && arena.used == 16 + 112,
+	  "arena allocations from the region");
+    for(unsigned int i = 0; i < 100; ++i) {
+	last[i] = (unsigned char)i;
+    }
+
+    // the last allocation grows in place, others move.
+    unsigned char* grown = (unsigned char*)arena_realloc(last, 100, 2000);
+    CHECK(grown == last && arena.used == 16 + 2000 && arena.heapsize == 0,
+	  "arena growth of the last allocation in place, used %u", (unsigned int)arena.used);
+    small[0] = 42;
+    unsigned char* moved = (unsigned char*)arena_realloc(small, 10, 20);
+    CHECK(moved != small && moved != NULL && moved[0] == 42,
+	  "arena growth of an allocation that is not the last");
+
+    // growing past the end of the region moves to the heap.
+    unsigned char* heap = (unsigned char*)arena_realloc(grown, 2000, 5000);
+    bool same = heap != NULL && !arena_owns(&arena, heap);
+    for(unsigned int i = 0; same && i < 100; ++i) {
+	same = heap[i] == (unsigned char)i;
+    }
+    CHECK(same && arena.heapsize == 5008, "arena growth past the region, heapsize %u", (unsigned int)arena.heapsize);
+    const size_t peak = arena.used + arena.heapsize;
+    CHECK(arena.peak == peak, "arena peak %u, expected %u", (unsigned int)arena.peak, (unsigned int)peak);
+    arena_free(heap, 5000);
+    arena_leave(&scope);
+    CHECK(arena.used == 0 && arena.heapsize == 0, "arena after leaving, used %u and heapsize %u",
+	  (unsigned int)arena.used, (unsigned int)arena.heapsize);
+
+    // the next reset grows the region again, after which the same allocations fit.
+    lodepng_arena_reset(&arena);
+    CHECK(arena.size == peak, "arena after the second reset, size %u, expected %u",
+	  (unsigned int)arena.size, (unsigned int)peak);
+    arena_enter(&scope, &arena);
+    void* fits = arena_malloc(peak);
+    CHECK(arena_owns(&arena, fits) && arena.heapsize == 0, "arena allocation of the peak after the reset");
+    arena_leave(&scope);
+
+    lodepng_arena_cleanup(&arena);
+}
+
+/*
+  Whether the region of every arena of the threads was large enough for the encode since the last
+  reset, so that nothing came from the heap.
+*/
+static bool arenas_settled(const LodePNGArena* arena) {
+    for(; arena; arena = arena->next) {
+	if(arena->size == 0 || arena->peak > arena->size) {
+	    return false;
+	}
+    }
+    return true;
+}
+
+/*
+  Deflating with an arena must give the same bytes as without, on one thread and on several, both
+  while the region is still too small and once it has grown. Allocations that are not the last one
+  cannot be given back within the region, so it takes a few resets before it stops growing.
+*/
+static void test_arena_deflate() {
+    std::vector<unsigned char> data(2 * DEFLATE_CHUNK_SIZE + 777);
+    compressible_bytes(data);
+
+    const unsigned int thread_counts[2] = { 0, 3 };
+    for(unsigned int t = 0; t < 2; ++t) {
+	LodePNGCompressSettings settings;
+	lodepng_compress_settings_init(&settings);
+	settings.num_threads = thread_counts[t];
+
+	unsigned char* expected = NULL;
+	size_t expected_size = 0;
+	unsigned error = lodepng_zlib_compress(&expected, &expected_size, &data[0], data.size(), &settings);
+	CHECK(error == 0, "lodepng_zlib_compress without an arena, %u threads: error %u", settings.num_threads, error);
+
+	LodePNGArena arena;
+	lodepng_arena_init(&arena);
+	settings.arena = &arena;
+
+	const unsigned int max_runs = 16;
+	unsigned int run = 0;
+	bool settled = false;
+	for(; run < max_runs && !settled; ++run) {
+	    unsigned char* actual = NULL;
+	    size_t actual_size = 0;
+	    error = lodepng_zlib_compress(&actual, &actual_size, &data[0], data.size(), &settings);
+	    CHECK(error == 0 && actual_size == expected_size && memcmp(actual, expected, expected_size) == 0,
+		  "lodepng_zlib_compress with an arena, %u threads, run %u: error %u",
+		  settings.num_threads, run, error);
+	    CHECK(arena.heapsize == 0 && arena.used == 0, "arena in use after deflating, %u threads, run %u",
+		  settings.num_threads, run);
+	    lodepng_free(actual);
+
+	    settled = arenas_settled(&arena);
+	    lodepng_arena_reset(&arena);
+	}
+	CHECK(settled, "arena still growing after %u runs, %u threads", max_runs, settings.num_threads);
+
+	lodepng_arena_cleanup(&arena);
+	lodepng_free(expected);
+    }
+}
+
+#ifdef LODEPNG_COMPILE_DISK
+/*
+  The image data of a PNG file: the data of all its IDAT chunks, one after the other.
+*/
+static std::vector<unsigned char> idat_data(const unsigned char* png, size_t size) {
+    std::vector<unsigned char> data;
+    const unsigned char* chunk = png + 8;
+    while(chunk + 12 <= png + size) {
+	if(lodepng_chunk_type_equals(chunk, "IDAT")) {
+	    const unsigned char* begin = lodepng_chunk_data_const(chunk);
+	    data.insert(data.end(), begin, begin + lodepng_chunk_length(chunk));
+	}
+	if(lodepng_chunk_type_equals(chunk, "IEND")) {
+	    break;
+	}
+	chunk = lodepng_chunk_next_const(chunk);
+    }
+    return data;
+}
+
+static void stream_state_init(LodePNGState& state, LodePNGColorType colortype, unsigned int num_threads) {
+    lodepng_state_init(&state);
+    state.info_raw.colortype = colortype;
+    state.info_raw.bitdepth = 8;
+    if(colortype == LCT_PALETTE) {
+	for(unsigned int i = 0; i < 16; ++i) {
+	    lodepng_palette_add(&state.info_raw, (unsigned char)(i * 17), (unsigned char)(255 - i * 17),
+				(unsigned char)(i * 5), (unsigned char)(i < 8 ? 255 : i * 16));
+	}
+    }
+    lodepng_color_mode_copy(&state.info_png.color, &state.info_raw);
+    state.encoder.auto_convert = 0;
+    state.encoder.zlibsettings.num_threads = num_threads;
+}
+
+/*
+  Scanlines pushed in uneven numbers into the stream encoder must give a file that decodes to the
+  same pixels, with the same image data as lodepng_encode with threads, for any number of threads.
+*/
+static void test_stream_encoder() {
+    const char* filename = "lodepng_tests_stream.png";
+    const unsigned int w = 301;
+    const unsigned int h = 700;
+    const LodePNGColorType colortypes[4] = { LCT_GREY, LCT_RGB, LCT_RGBA, LCT_PALETTE };
+    const unsigned int thread_counts[3] = { 0, 1, 3 };
+
+    for(unsigned int c = 0; c < 4; ++c) {
+	LodePNGState reference;
+	stream_state_init(reference, colortypes[c], 1);
+
+	std::vector<unsigned char> image((size_t)w * h * lodepng_get_bpp(&reference.info_raw) / 8);
+	compressible_bytes(image);
+	if(colortypes[c] == LCT_PALETTE) {
+	    for(size_t i = 0; i < image.size(); ++i) {
+		image[i] %= 16;
+	    }
+	}
+
+	unsigned char* expected = NULL;
+	size_t expected_size = 0;
+	unsigned error = lodepng_encode(&expected, &expected_size, &image[0], w, h, &reference);
+	CHECK(error == 0, "lodepng_encode, color type %u: error %u", (unsigned int)colortypes[c], error);
+	const std::vector<unsigned char> expected_idat = idat_data(expected, expected_size);
+	lodepng_free(expected);
+
+	for(unsigned int t = 0; t < 3; ++t) {
+	    LodePNGState state;
+	    stream_state_init(state, colortypes[c], thread_counts[t]);
+	    const size_t linebytes = image.size() / h;
+
+	    LodePNGStreamEncoder* encoder;
+	    error = lodepng_stream_encoder_open(&encoder, filename, w, h, &state);
+	    size_t filesize = 0;
+	    if(error == 0) {
+		for(unsigned int y = 0; y < h; ) {
+		    unsigned int numrows = 1 + random_number() % 97;
+		    if(numrows > h - y) {
+			numrows = h - y;
+		    }
+		    lodepng_stream_encoder_push(encoder, &image[y * linebytes], numrows);
+		    y += numrows;
+		}
+		error = lodepng_stream_encoder_finish(encoder, &filesize);
+	    }
+	    CHECK(error == 0, "stream encoder, color type %u, %u threads: error %u",
+		  (unsigned int)colortypes[c], thread_counts[t], error);
+
+	    unsigned char* png = NULL;
+	    size_t pngsize = 0;
+	    if(error == 0) {
+		error = lodepng_load_file(&png, &pngsize, filename);
+	    }
+
+	    unsigned char* decoded = NULL;
+	    unsigned int decoded_w = 0, decoded_h = 0;
+	    if(error == 0) {
+		error = lodepng_decode(&decoded, &decoded_w, &decoded_h, &state, png, pngsize);
+		CHECK(error == 0 && pngsize == filesize && decoded_w == w && decoded_h == h
+		      && memcmp(decoded, &image[0], image.size()) == 0,
+		      "stream encoder round trip, color type %u, %u threads: error %u",
+		      (unsigned int)colortypes[c], thread_counts[t], error);
+		CHECK(idat_data(png, pngsize) == expected_idat,
+		      "stream encoder image data differs from lodepng_encode, color type %u, %u threads",
+		      (unsigned int)colortypes[c], thread_counts[t]);
+	    }
+
+	    lodepng_free(decoded);
+	    lodepng_free(png);
+	    lodepng_state_cleanup(&state);
+	}
+	lodepng_state_cleanup(&reference);
+    }
+
+    remove(filename);
+}
+
+/*
+  Pushing more scanlines than h, or finishing before all are pushed, is error 95. A file that
+  cannot be written is error 96, also when the writer thread writes it.
+*/
+static void test_stream_encoder_errors() {
+    const char* filename = "lodepng_tests_stream.png";
+    const unsigned int w = 1000;
+    const unsigned int h = 1000;
+    std::vector<unsigned char> image((size_t)w * h);
+    compressible_bytes(image);
+
+    const unsigned int thread_counts[2] = { 0, 2 };
+    for(unsigned int t = 0; t < 2; ++t) {
+	LodePNGState state;
+	stream_state_init(state, LCT_GREY, thread_counts[t]);
+	LodePNGStreamEncoder* encoder;
+
+	unsigned error = lodepng_stream_encoder_open(&encoder, filename, w, h, &state);
+	if(error == 0) {
+	    lodepng_stream_encoder_push(encoder, &image[0], h - 5);
+	    const unsigned push_error = lodepng_stream_encoder_push(encoder, &image[0], 10);
+	    error = lodepng_stream_encoder_finish(encoder, NULL);
+	    CHECK(push_error == 95 && error == 95, "too many scanlines, %u threads: errors %u and %u",
+		  thread_counts[t], push_error, error);
+	}
+
+	error = lodepng_stream_encoder_open(&encoder, filename, w, h, &state);
+	if(error == 0) {
+	    const unsigned push_error = lodepng_stream_encoder_push(encoder, &image[0], h - 1);
+	    error = lodepng_stream_encoder_finish(encoder, NULL);
+	    CHECK(push_error == 0 && error == 95, "too few scanlines, %u threads: errors %u and %u",
+		  thread_counts[t], push_error, error);
+	}
+
+	FILE* full = fopen("/dev/full", "wb");
+	if(full == NULL) {
+	    printf("Writing to a full disk is not tested, there is no /dev/full.\n");
+	} else {
+	    fclose(full);
+	    error = lodepng_stream_encoder_open(&encoder, "/dev/full", w, h, &state);
+	    if(error == 0) {
+		for(unsigned int y = 0; y < h; y += 100) {
+		    lodepng_stream_encoder_push(encoder, &image[y * w], 100);
+		}
+		error = lodepng_stream_encoder_finish(encoder, NULL);
+	    }
+	    CHECK(error == 96, "writing to /dev/full, %u threads: error %u", thread_counts[t], error);
+	}
+
+	lodepng_state_cleanup(&state);
+    }
+
+    remove(filename);
+}
+#endif
+
+int main() {
+    test_crc32();
+#ifdef LODEPNG_COMPILE_X86_SIMD
+    test_adler32();
+    test_filter_functions();
+#endif
+    test_filter_bands();
+    test_zlib_chunks();
+    test_arena();
+    test_arena_deflate();
+#ifdef LODEPNG_COMPILE_DISK
+    test_stream_encoder();
+    test_stream_encoder_errors();
+#endif
+
+    benchmark_crc32();
+
+    if(num_failures > 0) {
+	printf("%u checks failed.\n", num_failures);
+	return 1;
+    }
+
+    printf("All checks passed.\n");
+    return 0;
+}